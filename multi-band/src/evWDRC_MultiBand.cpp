@@ -0,0 +1,362 @@
+/*
+  WDRC_MultiBand
+
+  Built on WDRC_SingleBand (Chip Audette (OpenAudio), Feb 2017), which is
+    primarly built upon CHAPRO "Generic Hearing Aid" from
+    Boys Town National Research Hospital (BTNRH): https://github.com/BTNRH/chapro
+
+  Purpose: Implements BTNRH's Wide Dynamic Range Compressor in N_BANDS
+    frequency bands (2 to 16).  A Linkwitz-Riley crossover filterbank
+    splits the input into bands, each band gets its own compressor (with
+    its own expansion stage) and the bands are summed back together, with
+    the phase of the crossovers lined up so that the sum is flat.  Every
+    band shows up as its own channel in the ExtendedSerialManager.
+
+    Building with WDRC_FFT_FILTERBANK defined replaces the IIR filters,
+    compressors and summing stage with a single FFT-based filterbank
+    (AudioEffectWDRCFilterbank_F32) that shares its analysis between all
+    of the bands.
+
+  User Controls:
+    Potentiometer on Tympan controls the active knob of the active channel (band)
+
+   MIT License.  use at your own risk.
+*/
+
+// Include the required libraries
+#include <Arduino.h>
+#include <Tympan_Library.h>
+#include "../../shared/ExtendedSerialManager.h"
+#include "../../shared/AudioMemoryPlanner.h"
+#include "../../shared/AudioEffectCompWDRCBuffered_F32.h"
+#include "../../shared/AudioCrossover_F32.h"
+#include "../../shared/AudioEffectWDRCFilterbank_F32.h"
+#include "../../shared/AudioProfiler_F32.h"
+
+#define N_BANDS 8  //number of bands, 2 to 16
+#define N_KNOBS 7  //knobs per band
+
+#if (N_BANDS < 2) || (N_BANDS > 16)
+  #error "N_BANDS must be between 2 and 16"
+#endif
+
+void setupTympanHardware(void);
+void setupFilterbank(void);
+void computeCrossovers(float *crossover_Hz);
+void allocateAudioMemory(void);
+void servicePotentiometer(unsigned long curTime_millis,unsigned long updatePeriod_millis);
+void applyConfiguration(void);
+void printLatencyReport(int algorithm_samples);
+void activateKnob(int channel, int knob);
+bool runCommand(char c);
+bool printMemoryReport(char c);
+bool buildOptions(void);
+
+#define OPTION_ATTACK       0
+#define OPTION_RELEASE      1
+#define OPTION_EXP_CR       2
+#define OPTION_EXP_END_KNEE 3
+#define OPTION_TKGAIN       4
+#define OPTION_TK           5
+#define OPTION_CR           6
+
+int selectedChannel = 0;
+int selectedOption = OPTION_CR;
+
+//the audio runs at this rate...everything rate-dependent (time constants, filters) is derived from it
+const float sample_rate_Hz = 44117.0f; //16000, 22050, 24000, 32000, 44117, 48000 or 96000 (see the table in AudioOutputI2S_F32)
+
+//samples per audio block...smaller blocks mean less latency but more per-block overhead (see printLatencyReport())
+const int audio_block_samples = AUDIO_BLOCK_SAMPLES; //8 to MAX_AUDIO_BLOCK_SAMPLES_F32 (128 unless the library is built with more)
+static_assert((audio_block_samples >= 8) && (audio_block_samples <= MAX_AUDIO_BLOCK_SAMPLES_F32), "audio_block_samples must be between 8 and MAX_AUDIO_BLOCK_SAMPLES_F32");
+AudioSettings_F32 audio_settings(sample_rate_Hz, audio_block_samples);
+
+//starting point for every band
+const BTNRH_WDRC::CHA_WDRC ghaDefault = {
+  1.0f, // attack time (ms)
+  50.0f,     // release time (ms)
+  sample_rate_Hz, // fs, sampling rate (Hz)
+  119.0f,    // maxdB, maximum signal (dB SPL)
+  0.1f,      // compression ratio for lowest-SPL region (ie, the expansion region)
+  40.0f,      // expansion ending kneepoint (see small to defeat the expansion)
+  0.0f,      // tkgain, compression-start gain
+  105.0f,    // tk, compression-start kneepoint
+  1.0f,     // cr, compression ratio
+  105.0f     // bolt, broadband output limiting threshold
+};
+
+//the filterbank spans these frequencies, with the crossovers spaced logarithmically across them
+const float filterbankLow_Hz = 250.0f;
+const float filterbankHigh_Hz = 8000.0f;
+const int filterbankFFTSize = 512; //only used by the FFT filterbank
+
+BTNRH_WDRC::CHA_WDRC gha[N_BANDS];
+CONFIGURABLE options[N_BANDS * N_KNOBS];
+bool optionsBuilt = buildOptions(); //must be filled in before the serial managers are constructed
+
+COMMAND commands[] = {
+  { 'd', "do a thing", runCommand },
+  { 'm', "print audio memory use", printMemoryReport }
+};
+
+ExtendedSerialManager esm(options, N_BANDS, N_KNOBS, commands, 2, applyConfiguration, activateKnob, 0, OPTION_CR);
+ExtendedSerialManager esm1(options, N_BANDS, N_KNOBS, commands, 2, applyConfiguration, activateKnob, 0, OPTION_CR);
+
+//spare audio blocks on top of what the graph needs (see AudioMemoryPlanner.h)
+const int audio_memory_margin = 4;
+
+//create audio library objects for handling the audio
+Tympan                  myTympan(TympanRev::D, audio_settings);  //TympanRev::D or TympanRev::C
+AudioInputI2S_F32       i2s_in(audio_settings);
+#if defined(WDRC_FFT_FILTERBANK)
+AudioEffectWDRCFilterbank_F32 filterbank;
+AudioOutputI2S_F32      i2s_out(audio_settings);
+AudioConnectionPlanned_F32 patchCordIn(i2s_in, 0, filterbank, 0);
+AudioConnectionPlanned_F32 patchCordOutL(filterbank, 0, i2s_out, 0);
+AudioConnectionPlanned_F32 patchCordOutR(filterbank, 0, i2s_out, 1);
+#else
+AudioCrossoverSplit_F32<N_BANDS> splitBands;
+AudioEffectCompWDRCBuffered_F32 compWDRC[N_BANDS];
+AudioCrossoverSum_F32<N_BANDS> sumBands;
+AudioOutputI2S_F32      i2s_out(audio_settings);
+AudioConnectionPlanned_F32 patchCordIn(i2s_in, 0, splitBands, 0);
+AudioConnectionPlanned_F32 *patchCordBand[N_BANDS]; //splitBands -> compWDRC, made in setupFilterbank()
+AudioConnectionPlanned_F32 *patchCordSum[N_BANDS];  //compWDRC -> sumBands
+AudioConnectionPlanned_F32 patchCordOutL(sumBands, 0, i2s_out, 0);
+AudioConnectionPlanned_F32 patchCordOutR(sumBands, 0, i2s_out, 1);
+#endif
+AudioProfiler_F32       profiler; //constructed last, so that it runs after everything it profiles
+#if defined(WDRC_FFT_FILTERBANK)
+AudioConnectionPlanned_F32 patchCordProfiler(filterbank, 0, profiler, 0); //only to keep the profiler running
+#else
+AudioConnectionPlanned_F32 patchCordProfiler(sumBands, 0, profiler, 0); //only to keep the profiler running
+#endif
+
+bool buildOptions(void) {
+  for (int ii = 0; ii < N_BANDS; ii++) {
+    gha[ii] = ghaDefault;
+    CONFIGURABLE *band = &options[ii * N_KNOBS];
+    band[OPTION_ATTACK] = { "attack time", &gha[ii].attack, "ms", 1.0f, 100.0f };
+    band[OPTION_RELEASE] = { "release time", &gha[ii].release, "ms", 10.0f, 500.0f };
+    band[OPTION_EXP_CR] = { "expansion ratio", &gha[ii].exp_cr, "", 0.01f, 2.0f };
+    band[OPTION_EXP_END_KNEE] = { "expansion kneepoint", &gha[ii].exp_end_knee, "dB", 0.0f, 100.0f };
+    band[OPTION_TKGAIN] = { "tkgain", &gha[ii].tkgain, "dB", 0.0f, 20.0f };
+    band[OPTION_TK] = { "tk", &gha[ii].tk, "dB", 0.0f, 100.0f };
+    band[OPTION_CR] = { "cr", &gha[ii].cr, "", 0.01f, 5.0f };
+  }
+  return true;
+}
+
+void applyConfiguration(void) {
+  for (int ii = 0; ii < N_BANDS; ii++) {
+    //picked up by the audio processing at the start of its next block
+    #if defined(WDRC_FFT_FILTERBANK)
+      filterbank.publishParams(ii, &gha[ii]);
+    #else
+      compWDRC[ii].publishParams(&gha[ii]);
+    #endif
+  }
+}
+
+void activateKnob(int channel, int knob) {
+  selectedChannel = channel;
+  selectedOption = knob;
+}
+
+bool runCommand(char c) {
+  myTympan.println("We did a thing");
+  return true;
+}
+
+bool printMemoryReport(char c) {
+  AudioMemoryPlanner &planner = AudioMemoryPlanner::instance();
+  myTympan.printf("Memory: %i blocks (%i planned for %i connections + %i margin), at most %i used, %i now\n",
+      planner.getAllocatedBlocks(), planner.getPlannedBlocks(), planner.getConnections(), planner.getMargin(),
+      AudioMemoryUsageMax_F32(), AudioMemoryUsage_F32());
+  return true;
+}
+
+//size the audio block pool from the connections made so far
+void allocateAudioMemory(void) {
+  AudioMemoryPlanner &planner = AudioMemoryPlanner::instance();
+  planner.reserve(AUDIO_MEMORY_I2S_INPUT_BLOCKS + AUDIO_MEMORY_I2S_OUTPUT_BLOCKS);
+  if (!planner.allocate(audio_memory_margin, audio_settings)) {
+    myTympan.println("Unable to allocate the audio memory");
+  }
+  printMemoryReport('m');
+}
+
+//the N_BANDS - 1 crossovers, spread logarithmically across filterbankLow_Hz to filterbankHigh_Hz
+//(or to a bit below Nyquist, at low sample rates)
+void computeCrossovers(float *crossover_Hz) {
+  float high_Hz = (filterbankHigh_Hz < 0.4f * sample_rate_Hz) ? filterbankHigh_Hz : 0.4f * sample_rate_Hz;
+  for (int ii = 0; ii < N_BANDS - 1; ii++) {
+    crossover_Hz[ii] = filterbankLow_Hz * powf(high_Hz / filterbankLow_Hz, (ii + 0.5f) / (N_BANDS - 1));
+  }
+}
+
+#if defined(WDRC_FFT_FILTERBANK)
+//every band is a range of FFT bins between two crossovers
+void setupFilterbank(void) {
+  float crossover_Hz[N_BANDS - 1];
+  computeCrossovers(crossover_Hz);
+  if (!filterbank.setup(N_BANDS, crossover_Hz, filterbankFFTSize, audio_block_samples, sample_rate_Hz)) {
+    myTympan.println("Unable to set up the FFT filterbank, passing the audio through unprocessed");
+  }
+}
+#else
+//4th-order Linkwitz-Riley crossovers, with the allpass compensation in the summing stage
+void setupFilterbank(void) {
+  float crossover_Hz[N_BANDS - 1];
+  computeCrossovers(crossover_Hz);
+  if (!splitBands.setup(crossover_Hz, sample_rate_Hz) || !sumBands.setup(crossover_Hz, sample_rate_Hz)) {
+    myTympan.println("Unable to design the crossovers");
+  }
+
+  for (int ii = 0; ii < N_BANDS; ii++) {
+    patchCordBand[ii] = new AudioConnectionPlanned_F32(splitBands, ii, compWDRC[ii], 0);
+    patchCordSum[ii] = new AudioConnectionPlanned_F32(compWDRC[ii], 0, sumBands, ii);
+  }
+}
+#endif
+
+//report what the block size costs: the input has to fill a whole block before it is processed and
+//the output takes a whole block to play out, on top of whatever delay the algorithm itself adds; and
+//every block pays a fixed cost to run the graph at all (measured by the profiler), whatever its size
+void printLatencyReport(int algorithm_samples) {
+  static AUDIO_PROFILE profile;
+  int io_samples = 2 * audio_block_samples;
+  int total_samples = io_samples + algorithm_samples;
+  myTympan.printf("Block size: %i samples (%.2f ms, %.0f blocks/sec)\n",
+      audio_block_samples, 1000.0f * audio_block_samples / sample_rate_Hz, sample_rate_Hz / audio_block_samples);
+  myTympan.printf("Latency: %i samples (%.2f ms) = %i of block I/O + %i in the algorithm\n",
+      total_samples, 1000.0f * total_samples / sample_rate_Hz, io_samples, algorithm_samples);
+  profiler.getSnapshot(&profile);
+  if (profile.blocks > 1 && profile.budget_cycles > 0.0f) {
+    myTympan.printf("Fixed cost per block: %.1f us mean, %.1f us max = %.1f%% CPU at this block size\n",
+        profile.mean_overhead_cycles / (F_CPU / 1000000.0f), profile.max_overhead_cycles / (F_CPU / 1000000.0f),
+        100.0f * profile.mean_overhead_cycles / profile.budget_cycles);
+  } else {
+    myTympan.println("Fixed cost per block: not measured (no audio yet)");
+  }
+}
+
+//define a function to setup the Teensy Audio Board how I like it
+void setupTympanHardware(void) {
+  // Setup the Tympan audio hardware
+  myTympan.enable(); // activate AIC
+
+  // Choose the desired input
+  myTympan.inputSelect(TYMPAN_INPUT_ON_BOARD_MIC); // use the on board microphones // default
+  //  myTympan.inputSelect(TYMPAN_INPUT_JACK_AS_MIC); // use the microphone jack - defaults to mic bias 2.5V
+  //  myTympan.inputSelect(TYMPAN_INPUT_JACK_AS_LINEIN); // use the microphone jack - defaults to mic bias OFF
+  //  myTympan.inputSelect(TYMPAN_INPUT_LINE_IN); // use the line in pads on the TYMPAN board - defaults to mic bias OFF
+
+  // VOLUMES
+  myTympan.volume_dB(0.0);  // -63.6 to +24 dB in 0.5dB steps.  uses float
+  myTympan.setInputGain_dB(10.0); // set MICPGA volume, 0-47.5dB in 0.5dB setps
+}
+
+//The setup function is called once when the system starts up
+void setup(void) {
+  //begin the serial comms (for debugging)
+  myTympan.beginBothSerial(); delay(1000); //let's use the print functions in "myTympan" so it goes to BT, too!
+  myTympan.println("Setup starting...");
+  myTympan.printf("Bands: %i\n", N_BANDS);
+  myTympan.printf("Sample rate: %.0f Hz\n", sample_rate_Hz);
+
+  //setup the filterbank and the compressors
+  setupFilterbank();
+
+  //allocate the dynamic memory for audio processing blocks...only now that all of the
+  //connections (including the filterbank's) have been made
+  allocateAudioMemory();
+  #if !defined(WDRC_FFT_FILTERBANK)
+    for (int ii = 0; ii < N_BANDS; ii++) {
+      compWDRC[ii].setRampTime_msec(20.0f); //ramp gain changes so that big knob jumps don't click
+    }
+  #endif
+  applyConfiguration();
+
+  //profile every node, so that what is left over is the fixed cost of running a block
+  profiler.addNode(&i2s_in, "i2s_in");
+  #if defined(WDRC_FFT_FILTERBANK)
+    profiler.addNode(&filterbank, "filterbank");
+  #else
+    static char bandNames[N_BANDS][16];
+    profiler.addNode(&splitBands, "splitBands");
+    for (int ii = 0; ii < N_BANDS; ii++) {
+      snprintf(bandNames[ii], sizeof(bandNames[ii]), "compWDRC[%i]", ii);
+      profiler.addNode(&compWDRC[ii], bandNames[ii]);
+    }
+    profiler.addNode(&sumBands, "sumBands");
+  #endif
+  profiler.addNode(&i2s_out, "i2s_out");
+
+  //coalesce bursts of knob changes...apply at most every 50 msec
+  esm.setApplyInterval(50);
+  esm1.setApplyInterval(50);
+
+  // Enable the audio shield, select input, and enable output
+  setupTympanHardware();
+
+  //let the profiler see some blocks before reporting their fixed cost
+  delay(500);
+  #if defined(WDRC_FFT_FILTERBANK)
+    printLatencyReport(filterbank.getLatency_samples());
+  #else
+    printLatencyReport(0); //IIR group delay not counted
+  #endif
+
+  //End of setup
+  myTympan.println("Setup complete.");
+};
+
+
+//After setup(), the loop function loops forever.
+//Note that the audio modules are called in the background.
+//They do not need to be serviced by the loop() function.
+void loop(void) {
+
+  //myTympan prints to both serial ports, so while either of them speaks binary nothing else may
+  //print: the other port's commands, the potentiometer and the status wait until it is done
+  bool quiet = esm.isBinary() || esm1.isBinary();
+
+  //service the potentiometer...if enough time has passed
+  if (!quiet) servicePotentiometer(millis(),100); //update every 100msec
+  if (!esm1.isBinary()) while (Serial.available()) esm.processByte(Serial.read());
+  if (!esm.isBinary()) while (Serial1.available()) esm1.processByte(Serial1.read());
+  esm.service(millis());
+  esm1.service(millis());
+
+  //update the memory and CPU usage...if enough time has passed
+  if (!quiet) myTympan.printCPUandMemory(millis(),3000); //print every 3000 msec
+};
+
+
+//servicePotentiometer: listens to the blue potentiometer and sends the new pot value
+//  to the audio processing algorithm as a control parameter
+void servicePotentiometer(unsigned long curTime_millis,unsigned long updatePeriod_millis) {
+  static unsigned long lastUpdate_millis = 0;
+  static float prev_val = -1.0;
+  static char potentiometerCmdBuffer[32];
+
+  //has enough time passed to update everything?
+  if (curTime_millis < lastUpdate_millis) lastUpdate_millis = 0; //handle wrap-around of the clock
+  if ((curTime_millis - lastUpdate_millis) > updatePeriod_millis) { //is it time to update the user interface?
+
+    //read potentiometer
+    float val = float(myTympan.readPotentiometer()) / 1023.0; //0.0 to 1.0
+    val = 0.1 * (float)((int)(10.0 * val + 0.5)); //quantize so that it doesn't chatter...0 to 1.0
+
+    //send the potentiometer value to your algorithm as a control parameter
+    if (abs(val - prev_val) > 0.05) { //is it different than befor?
+      prev_val = val;  //save the value for comparison for the next time around
+
+      snprintf(potentiometerCmdBuffer, 32, "*%i%c%i;", selectedChannel, 'A' + selectedOption, int(100 * val));
+      myTympan.println(potentiometerCmdBuffer);
+      esm.processExtendedCommand(potentiometerCmdBuffer);
+    }
+    lastUpdate_millis = curTime_millis;
+  } // end if
+} //end servicePotentiometer();
@@ -0,0 +1,184 @@
+/*
+  The Linkwitz-Riley crossover filterbank (shared/AudioCrossover_F32.h): the bands must add back
+  up to a flat response, and the cost is measured for 2 to 16 bands.
+
+  An impulse is run through the split and the sum (with nothing in between, i.e. every band at
+  the same gain) and the magnitude of the result is evaluated from 20 Hz to 20 kHz; the bottom
+  band on its own must be the LR4 lowpass (-6 dB at its crossover). For
+  comparison the same is done for the filterbank the sketch used before (a lowpass, bandpasses
+  and a highpass from the RBJ cookbook, just added up), which is far from flat.
+
+  Reports the worst deviation from flat in dB for each, and the cost of split plus sum per sample
+  (wall time and TSC ticks) for 2, 4, 8 and 16 bands.
+
+  Run with: pio test -e native -f test_crossover
+*/
+
+#include <unity.h>
+#include <Tympan_Library.h>
+#include "../../../shared/AudioCrossover_F32.h"
+#include "../../../shared/host/Benchmark.h"
+#include "../../../shared/host/HostAudio.h"
+
+#define SAMPLE_RATE 44117.0f
+#define BLOCK_SIZE 128
+#define IMPULSE_SAMPLES (64 * BLOCK_SIZE)
+#define BENCH_SAMPLES (344 * BLOCK_SIZE)   // about a second of audio
+#define FLATNESS_DB 0.01
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+AudioSettings_F32 audio_settings(SAMPLE_RATE, BLOCK_SIZE);
+float in[BENCH_SAMPLES], out[BENCH_SAMPLES], sum[IMPULSE_SAMPLES];
+
+void setUp(void) {
+  AudioMemory_F32(48, audio_settings);
+}
+
+HostGraph *graph = NULL;
+
+void tearDown(void) {
+  delete graph;
+  graph = NULL;
+}
+
+// the sketch's crossovers: spread logarithmically from 250 Hz to 8 kHz
+static void computeCrossovers(int bands, float *crossover_Hz) {
+  for (int ii = 0; ii < bands - 1; ii++) crossover_Hz[ii] = 250.0f * powf(8000.0f / 250.0f, (ii + 0.5f) / (bands - 1));
+}
+
+template <int N>
+struct CrossoverGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  AudioCrossoverSplit_F32<N> split;
+  AudioCrossoverSum_F32<N> sum;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioConnection_F32 patchCordIn { i2s_in, 0, split, 0 };
+  AudioConnection_F32 *patchCordBand[N];
+  AudioConnection_F32 patchCordOut { sum, 0, i2s_out, 0 };
+
+  // every band, or only the one given
+  CrossoverGraph(int onlyBand = -1) {
+    for (int ii = 0; ii < N; ii++) {
+      bool connect = (onlyBand < 0 || onlyBand == ii);
+      patchCordBand[ii] = connect ? new AudioConnection_F32(split, ii, sum, ii) : NULL;
+    }
+  }
+  ~CrossoverGraph(void) {
+    for (int ii = 0; ii < N; ii++) delete patchCordBand[ii];
+  }
+};
+
+struct BiquadGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  AudioFilterBiquad_F32 filter;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioConnection_F32 patchCordIn { i2s_in, 0, filter, 0 };
+  AudioConnection_F32 patchCordOut { filter, 0, i2s_out, 0 };
+};
+
+// the magnitude of the response h at f_Hz
+static double magnitude_dB(const float *h, int n, double f_Hz) {
+  double w = 2.0 * M_PI * f_Hz / SAMPLE_RATE, re = 0.0, im = 0.0;
+  for (int ii = 0; ii < n; ii++) {
+    re += h[ii] * cos(w * ii);
+    im -= h[ii] * sin(w * ii);
+  }
+  return 10.0 * log10(re * re + im * im);
+}
+
+// the largest deviation from 0 dB of the response h, from 20 Hz to 20 kHz
+static double maxDeviation_dB(const float *h, int n) {
+  double worst = 0.0;
+  for (int ff = 0; ff <= 200; ff++) worst = fmax(worst, fabs(magnitude_dB(h, n, 20.0 * pow(1000.0, ff / 200.0))));
+  return worst;
+}
+
+static void makeImpulse(void) {
+  memset(in, 0, sizeof(in));
+  in[0] = 1.0f;
+}
+
+template <int N>
+static void measure(void) {
+  char name[64];
+  CrossoverGraph<N> *g = new CrossoverGraph<N>;
+  graph = g;
+  float crossover_Hz[N - 1];
+  computeCrossovers(N, crossover_Hz);
+  TEST_ASSERT_TRUE(g->split.setup(crossover_Hz, SAMPLE_RATE));
+  TEST_ASSERT_TRUE(g->sum.setup(crossover_Hz, SAMPLE_RATE));
+
+  makeImpulse();
+  HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, IMPULSE_SAMPLES);
+  double deviation = maxDeviation_dB(out, IMPULSE_SAMPLES);
+  snprintf(name, sizeof(name), "crossover.%i_bands.lr4.max_deviation_dB", N);
+  Benchmark::report(name, deviation, "dB");
+  TEST_ASSERT_TRUE(deviation < FLATNESS_DB);
+
+  // and it is split up on the way: the bottom band alone is 6 dB down at its crossover and
+  // falls off at 24 dB per octave above it
+  CrossoverGraph<N> *bottom = new CrossoverGraph<N>(0);
+  delete g;
+  graph = g = bottom;
+  TEST_ASSERT_TRUE(g->split.setup(crossover_Hz, SAMPLE_RATE));
+  TEST_ASSERT_TRUE(g->sum.setup(crossover_Hz, SAMPLE_RATE));
+  HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, IMPULSE_SAMPLES);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, -6.02, magnitude_dB(out, IMPULSE_SAMPLES, crossover_Hz[0]));
+  TEST_ASSERT_TRUE(magnitude_dB(out, IMPULSE_SAMPLES, 4.0 * crossover_Hz[0]) < -45.0);
+
+  HostNoise noise(12345);
+  for (int ii = 0; ii < BENCH_SAMPLES; ii++) in[ii] = 0.1f * noise.gaussian();
+  BENCH_TIMING timing = Benchmark::time([&]() {
+    HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, BENCH_SAMPLES);
+  });
+  snprintf(name, sizeof(name), "crossover.%i_bands.ns_per_sample", N);
+  Benchmark::report(name, timing.ns / BENCH_SAMPLES, "ns/sample");
+  snprintf(name, sizeof(name), "crossover.%i_bands.cycles_per_sample", N);
+  Benchmark::report(name, timing.cycles / BENCH_SAMPLES, "cycles/sample");
+}
+
+void test_2_bands(void) { measure<2>(); }
+void test_4_bands(void) { measure<4>(); }
+void test_8_bands(void) { measure<8>(); }
+void test_16_bands(void) { measure<16>(); }
+
+// what the sketch had before: one RBJ filter per band, added up as is
+void test_rbj_bands_are_not_flat(void) {
+  const int bands = 8;
+  float crossover_Hz[bands - 1];
+  computeCrossovers(bands, crossover_Hz);
+  memset(sum, 0, sizeof(sum));
+  for (int ii = 0; ii < bands; ii++) {
+    BiquadGraph *g = new BiquadGraph;
+    graph = g;
+    g->filter.setSampleRate_Hz(SAMPLE_RATE);
+    if (ii == 0) {
+      g->filter.setLowpass(0, crossover_Hz[0]);
+    } else if (ii == bands - 1) {
+      g->filter.setHighpass(0, crossover_Hz[bands - 2]);
+    } else {
+      float center_Hz = sqrtf(crossover_Hz[ii - 1] * crossover_Hz[ii]);
+      g->filter.setBandpass(0, center_Hz, center_Hz / (crossover_Hz[ii] - crossover_Hz[ii - 1]));
+    }
+    makeImpulse();
+    HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, IMPULSE_SAMPLES);
+    for (int jj = 0; jj < IMPULSE_SAMPLES; jj++) sum[jj] += out[jj];
+    delete g;
+    graph = NULL;
+  }
+  double deviation = maxDeviation_dB(sum, IMPULSE_SAMPLES);
+  Benchmark::report("crossover.8_bands.rbj.max_deviation_dB", deviation, "dB");
+  TEST_ASSERT_TRUE(deviation > 1.0);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_2_bands);
+  RUN_TEST(test_4_bands);
+  RUN_TEST(test_8_bands);
+  RUN_TEST(test_16_bands);
+  RUN_TEST(test_rbj_bands_are_not_flat);
+  return UNITY_END();
+}
@@ -0,0 +1,227 @@
+/*
+  The shared-analysis FFT filterbank (shared/AudioEffectWDRCFilterbank_F32.h): level calibration,
+  pass-through when it cannot be set up, and its cost per band against the IIR filterbank.
+
+  Level: compressing 2:1 from 0 dB SPL (tk = 0, tkgain = 0) the gain is minus half the level,
+  so the level the filterbank read can be worked back out of its output. With a single band and
+  a release long enough for the envelope to sit on the level, a sine of amplitude A must read A
+  (20 log10(A) + maxdB SPL), as documented in the header. The per-band
+  time-domain compressor of the IIR sketch is run on the same sine for comparison (its peak
+  detector reads a little below A). This pins down the conversion from band power to level,
+  which read 6 dB high until it was fixed in 2abcc98 (committed with the noise reduction).
+
+  Cost: the FFT filterbank against the Linkwitz-Riley crossovers plus one compressor per band,
+  for 2, 4, 8 and 16 bands; reports ns/sample, cycles/sample (TSC ticks) and cycles/sample per
+  band for both.
+
+  Run with: pio test -e native -f test_filterbank
+*/
+
+#include <unity.h>
+#include <Tympan_Library.h>
+#include "../../../shared/AudioEffectWDRCFilterbank_F32.h"
+#include "../../../shared/AudioEffectCompWDRCBuffered_F32.h"
+#include "../../../shared/AudioCrossover_F32.h"
+#include "../../../shared/host/Benchmark.h"
+#include "../../../shared/host/HostAudio.h"
+
+#define SAMPLE_RATE 44117.0f
+#define BLOCK_SIZE 128
+#define FFT_SIZE 512
+#define SAMPLES (344 * BLOCK_SIZE)   // about a second of audio
+#define MEASURE_SAMPLES (64 * BLOCK_SIZE)   // the steady part at the end
+#define MAX_BANDS 16
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+AudioSettings_F32 audio_settings(SAMPLE_RATE, BLOCK_SIZE);
+float in[SAMPLES], out[SAMPLES];
+
+// 2:1 from 0 dB SPL up, no expansion, no limiting
+const BTNRH_WDRC::CHA_WDRC compressing = { 1.0f, 50.0f, SAMPLE_RATE, 119.0f, 1.0f, 0.0f, 0.0f, 0.0f, 2.0f, 200.0f };
+
+// the same with a release long enough that the envelope sits on the level
+const BTNRH_WDRC::CHA_WDRC calibrating = { 1.0f, 1000.0f, SAMPLE_RATE, 119.0f, 1.0f, 0.0f, 0.0f, 0.0f, 2.0f, 200.0f };
+
+void setUp(void) {
+  AudioMemory_F32(64, audio_settings);
+}
+
+HostGraph *graph = NULL;
+
+void tearDown(void) {
+  delete graph;
+  graph = NULL;
+}
+
+// the sketch's crossovers: spread logarithmically from 250 Hz to 8 kHz
+static void computeCrossovers(int bands, float *crossover_Hz) {
+  for (int ii = 0; ii < bands - 1; ii++) crossover_Hz[ii] = 250.0f * powf(8000.0f / 250.0f, (ii + 0.5f) / (bands - 1));
+}
+
+struct FilterbankGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  AudioEffectWDRCFilterbank_F32 filterbank;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioConnection_F32 patchCordIn { i2s_in, 0, filterbank, 0 };
+  AudioConnection_F32 patchCordOut { filterbank, 0, i2s_out, 0 };
+
+  bool setup(int bands, int fftSize, const BTNRH_WDRC::CHA_WDRC *gha = &compressing) {
+    float crossover_Hz[MAX_BANDS - 1];
+    computeCrossovers(bands, crossover_Hz);
+    if (!filterbank.setup(bands, crossover_Hz, fftSize, BLOCK_SIZE, SAMPLE_RATE)) return false;
+    for (int ii = 0; ii < bands; ii++) filterbank.publishParams(ii, gha);
+    return true;
+  }
+};
+
+struct CompressorGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  AudioEffectCompWDRCBuffered_F32 compWDRC;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioConnection_F32 patchCordIn { i2s_in, 0, compWDRC, 0 };
+  AudioConnection_F32 patchCordOut { compWDRC, 0, i2s_out, 0 };
+};
+
+// the multi-band sketch's IIR filterbank
+template <int N>
+struct CrossoverGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  AudioCrossoverSplit_F32<N> split;
+  AudioEffectCompWDRCBuffered_F32 compWDRC[N];
+  AudioCrossoverSum_F32<N> sum;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioConnection_F32 patchCordIn { i2s_in, 0, split, 0 };
+  AudioConnection_F32 *patchCordBand[N];
+  AudioConnection_F32 *patchCordSum[N];
+  AudioConnection_F32 patchCordOut { sum, 0, i2s_out, 0 };
+
+  CrossoverGraph(void) {
+    float crossover_Hz[N - 1];
+    computeCrossovers(N, crossover_Hz);
+    split.setup(crossover_Hz, SAMPLE_RATE);
+    sum.setup(crossover_Hz, SAMPLE_RATE);
+    for (int ii = 0; ii < N; ii++) {
+      patchCordBand[ii] = new AudioConnection_F32(split, ii, compWDRC[ii], 0);
+      patchCordSum[ii] = new AudioConnection_F32(compWDRC[ii], 0, sum, ii);
+      compWDRC[ii].publishParams(&compressing);
+    }
+  }
+  ~CrossoverGraph(void) {
+    for (int ii = 0; ii < N; ii++) {
+      delete patchCordBand[ii];
+      delete patchCordSum[ii];
+    }
+  }
+};
+
+static void makeSine(float amplitude, float f_Hz) {
+  for (int ii = 0; ii < SAMPLES; ii++) in[ii] = amplitude * sinf(2.0f * (float)M_PI * f_Hz * ii / SAMPLE_RATE);
+}
+
+// the level (in dB re full scale) that the 2:1 compressor must have read, on average, to give
+// this output
+static float levelRead_dB(float amplitude) {
+  double power = 0.0;
+  for (int ii = SAMPLES - MEASURE_SAMPLES; ii < SAMPLES; ii++) power += out[ii] * out[ii];
+  float gain_dB = 10.0f * log10f(power / MEASURE_SAMPLES / (0.5f * amplitude * amplitude));
+  return -2.0f * gain_dB - compressing.maxdB;
+}
+
+void test_level_calibration(void) {
+  const float amplitudes[] = { 0.3f, 0.01f };
+  const float frequencies_Hz[] = { 1000.0f, 3000.0f };
+  for (float f_Hz : frequencies_Hz) {
+    for (float amplitude : amplitudes) {
+      char name[80];
+      makeSine(amplitude, f_Hz);
+      FilterbankGraph *fft = new FilterbankGraph;
+      graph = fft;
+      TEST_ASSERT_TRUE(fft->setup(1, FFT_SIZE, &calibrating));
+      HostAudio::process(fft->i2s_in, fft->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, SAMPLES);
+      float fftLevel = levelRead_dB(amplitude);
+      delete fft;
+
+      CompressorGraph *td = new CompressorGraph;
+      graph = td;
+      td->compWDRC.publishParams(&calibrating);
+      HostAudio::process(td->i2s_in, td->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, SAMPLES);
+      float tdLevel = levelRead_dB(amplitude);
+      delete td;
+      graph = NULL;
+
+      float expected = 20.0f * log10f(amplitude);
+      snprintf(name, sizeof(name), "filterbank.level.%.0fHz.%gFS.fft_error_dB", f_Hz, amplitude);
+      Benchmark::report(name, fftLevel - expected, "dB");
+      snprintf(name, sizeof(name), "filterbank.level.%.0fHz.%gFS.time_domain_error_dB", f_Hz, amplitude);
+      Benchmark::report(name, tdLevel - expected, "dB");
+      TEST_ASSERT_FLOAT_WITHIN(0.25f, expected, fftLevel);
+      TEST_ASSERT_FLOAT_WITHIN(0.5f, tdLevel, fftLevel);
+    }
+  }
+}
+
+void test_passes_through_when_not_set_up(void) {
+  HostNoise noise(12345);
+  for (int ii = 0; ii < SAMPLES; ii++) in[ii] = 0.1f * noise.gaussian();
+  FilterbankGraph *g = new FilterbankGraph;
+  graph = g;
+  HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, SAMPLES);
+  TEST_ASSERT_EQUAL_MEMORY(in, out, sizeof(in));
+
+  // an FFT no bigger than a block can't be set up
+  TEST_ASSERT_FALSE(g->setup(8, BLOCK_SIZE));
+  TEST_ASSERT_EQUAL_INT(0, g->filterbank.getLatency_samples());
+  memset(out, 0, sizeof(out));
+  HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, SAMPLES);
+  TEST_ASSERT_EQUAL_MEMORY(in, out, sizeof(in));
+}
+
+template <int N>
+static void measureCost(void) {
+  char name[80];
+  HostNoise noise(12345);
+  for (int ii = 0; ii < SAMPLES; ii++) in[ii] = 0.1f * noise.gaussian();
+
+  FilterbankGraph *fft = new FilterbankGraph;
+  graph = fft;
+  TEST_ASSERT_TRUE(fft->setup(N, FFT_SIZE));
+  BENCH_TIMING fftTiming = Benchmark::time([&]() {
+    HostAudio::process(fft->i2s_in, fft->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, SAMPLES);
+  });
+  delete fft;
+
+  CrossoverGraph<N> *iir = new CrossoverGraph<N>;
+  graph = iir;
+  BENCH_TIMING iirTiming = Benchmark::time([&]() {
+    HostAudio::process(iir->i2s_in, iir->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, SAMPLES);
+  });
+
+  const char *kinds[] = { "fft", "iir" };
+  BENCH_TIMING timings[] = { fftTiming, iirTiming };
+  for (int kk = 0; kk < 2; kk++) {
+    snprintf(name, sizeof(name), "filterbank.%i_bands.%s.ns_per_sample", N, kinds[kk]);
+    Benchmark::report(name, timings[kk].ns / SAMPLES, "ns/sample");
+    snprintf(name, sizeof(name), "filterbank.%i_bands.%s.cycles_per_sample", N, kinds[kk]);
+    Benchmark::report(name, timings[kk].cycles / SAMPLES, "cycles/sample");
+    snprintf(name, sizeof(name), "filterbank.%i_bands.%s.cycles_per_sample_per_band", N, kinds[kk]);
+    Benchmark::report(name, timings[kk].cycles / SAMPLES / N, "cycles/sample/band");
+  }
+}
+
+void test_cost_2_bands(void) { measureCost<2>(); }
+void test_cost_4_bands(void) { measureCost<4>(); }
+void test_cost_8_bands(void) { measureCost<8>(); }
+void test_cost_16_bands(void) { measureCost<16>(); }
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_level_calibration);
+  RUN_TEST(test_passes_through_when_not_set_up);
+  RUN_TEST(test_cost_2_bands);
+  RUN_TEST(test_cost_4_bands);
+  RUN_TEST(test_cost_8_bands);
+  RUN_TEST(test_cost_16_bands);
+  return UNITY_END();
+}
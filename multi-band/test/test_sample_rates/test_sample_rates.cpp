@@ -0,0 +1,240 @@
+/*
+  The multi-band chain at each sample rate the sketch supports: what it costs, and that its time
+  constants and crossovers follow the rate.
+
+  Time constants: a compressor's gain after a 40 dB drop in level must recover along the same
+  curve in milliseconds at every rate (the release is given in ms and converted with the rate the
+  compressor is set up for). Crossovers: the bottom band of the LR4 split must be -6 dB at its
+  crossover at every rate.
+
+  Cost: one second of audio through the sketch's 8-band chain (Linkwitz-Riley split, a compressor
+  per band, sum) and through the FFT filterbank, at 16, 22.05, 24, 32, 44.1, 48 and 96 kHz.
+  Reports the CPU time per second of audio (ms, and as a share of one core) and cycles per
+  sample (TSC ticks). Lower rates are how the sketch buys headroom for more bands.
+
+  Run with: pio test -e native -f test_sample_rates
+*/
+
+#include <unity.h>
+#include <Tympan_Library.h>
+#include "../../../shared/AudioEffectCompWDRCBuffered_F32.h"
+#include "../../../shared/AudioCrossover_F32.h"
+#include "../../../shared/AudioEffectWDRCFilterbank_F32.h"
+#include "../../../shared/host/Benchmark.h"
+#include "../../../shared/host/HostAudio.h"
+
+#define BLOCK_SIZE 128
+#define N_BANDS 8
+#define FFT_SIZE 512
+#define MAX_SAMPLES 96000
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+const float sampleRates_Hz[] = { 16000.0f, 22050.0f, 24000.0f, 32000.0f, 44117.0f, 48000.0f, 96000.0f };
+
+AudioSettings_F32 audio_settings(44117.0f, BLOCK_SIZE);   // the pool's; every graph brings its own rate
+float in[MAX_SAMPLES], out[MAX_SAMPLES];
+
+void setUp(void) {
+  AudioMemory_F32(48, audio_settings);
+}
+
+HostGraph *graph = NULL;
+
+void tearDown(void) {
+  delete graph;
+  graph = NULL;
+}
+
+// the sketch's starting point for every band, 2:1 from 45 dB SPL, at the given rate
+static BTNRH_WDRC::CHA_WDRC fitting(float fs_Hz) {
+  BTNRH_WDRC::CHA_WDRC gha = { 1.0f, 50.0f, fs_Hz, 119.0f, 1.0f, 0.0f, 0.0f, 45.0f, 2.0f, 150.0f };
+  return gha;
+}
+
+// the sketch's crossovers: spread logarithmically from 250 Hz to 8 kHz, or to 0.4 fs
+static void computeCrossovers(float fs_Hz, float *crossover_Hz) {
+  float high_Hz = (8000.0f < 0.4f * fs_Hz) ? 8000.0f : 0.4f * fs_Hz;
+  for (int ii = 0; ii < N_BANDS - 1; ii++) crossover_Hz[ii] = 250.0f * powf(high_Hz / 250.0f, (ii + 0.5f) / (N_BANDS - 1));
+}
+
+struct CompressorGraph : HostGraph {
+  AudioSettings_F32 settings;
+  AudioInputI2S_F32 i2s_in { settings };
+  AudioEffectCompWDRCBuffered_F32 compWDRC;
+  AudioOutputI2S_F32 i2s_out { settings };
+  AudioConnection_F32 patchCordIn { i2s_in, 0, compWDRC, 0 };
+  AudioConnection_F32 patchCordOut { compWDRC, 0, i2s_out, 0 };
+
+  CompressorGraph(float fs_Hz) : settings(fs_Hz, BLOCK_SIZE) {
+    BTNRH_WDRC::CHA_WDRC gha = fitting(fs_Hz);
+    compWDRC.publishParams(&gha);
+  }
+};
+
+// the sketch's IIR filterbank
+struct CrossoverGraph : HostGraph {
+  AudioSettings_F32 settings;
+  AudioInputI2S_F32 i2s_in { settings };
+  AudioCrossoverSplit_F32<N_BANDS> split;
+  AudioEffectCompWDRCBuffered_F32 compWDRC[N_BANDS];
+  AudioCrossoverSum_F32<N_BANDS> sum;
+  AudioOutputI2S_F32 i2s_out { settings };
+  AudioConnection_F32 patchCordIn { i2s_in, 0, split, 0 };
+  AudioConnection_F32 *patchCordBand[N_BANDS];
+  AudioConnection_F32 *patchCordSum[N_BANDS];
+  AudioConnection_F32 patchCordOut { sum, 0, i2s_out, 0 };
+
+  CrossoverGraph(float fs_Hz) : settings(fs_Hz, BLOCK_SIZE) {
+    float crossover_Hz[N_BANDS - 1];
+    computeCrossovers(fs_Hz, crossover_Hz);
+    TEST_ASSERT_TRUE(split.setup(crossover_Hz, fs_Hz));
+    TEST_ASSERT_TRUE(sum.setup(crossover_Hz, fs_Hz));
+    BTNRH_WDRC::CHA_WDRC gha = fitting(fs_Hz);
+    for (int ii = 0; ii < N_BANDS; ii++) {
+      patchCordBand[ii] = new AudioConnection_F32(split, ii, compWDRC[ii], 0);
+      patchCordSum[ii] = new AudioConnection_F32(compWDRC[ii], 0, sum, ii);
+      compWDRC[ii].publishParams(&gha);
+    }
+  }
+  ~CrossoverGraph(void) {
+    for (int ii = 0; ii < N_BANDS; ii++) {
+      delete patchCordBand[ii];
+      delete patchCordSum[ii];
+    }
+  }
+};
+
+// the bottom band of the split on its own
+struct BottomBandGraph : HostGraph {
+  AudioSettings_F32 settings;
+  AudioInputI2S_F32 i2s_in { settings };
+  AudioCrossoverSplit_F32<N_BANDS> split;
+  AudioOutputI2S_F32 i2s_out { settings };
+  AudioConnection_F32 patchCordIn { i2s_in, 0, split, 0 };
+  AudioConnection_F32 patchCordOut { split, 0, i2s_out, 0 };
+
+  BottomBandGraph(float fs_Hz) : settings(fs_Hz, BLOCK_SIZE) {}
+};
+
+struct FilterbankGraph : HostGraph {
+  AudioSettings_F32 settings;
+  AudioInputI2S_F32 i2s_in { settings };
+  AudioEffectWDRCFilterbank_F32 filterbank;
+  AudioOutputI2S_F32 i2s_out { settings };
+  AudioConnection_F32 patchCordIn { i2s_in, 0, filterbank, 0 };
+  AudioConnection_F32 patchCordOut { filterbank, 0, i2s_out, 0 };
+
+  FilterbankGraph(float fs_Hz) : settings(fs_Hz, BLOCK_SIZE) {
+    float crossover_Hz[N_BANDS - 1];
+    computeCrossovers(fs_Hz, crossover_Hz);
+    TEST_ASSERT_TRUE(filterbank.setup(N_BANDS, crossover_Hz, FFT_SIZE, BLOCK_SIZE, fs_Hz));
+    BTNRH_WDRC::CHA_WDRC gha = fitting(fs_Hz);
+    for (int ii = 0; ii < N_BANDS; ii++) filterbank.publishParams(ii, &gha);
+  }
+};
+
+// ms after the drop until the gain has recovered halfway (in dB) to where it settles
+static float halfRecovery_msec(float fs_Hz) {
+  int samples = (int)fs_Hz / BLOCK_SIZE * BLOCK_SIZE;   // a second
+  int drop = samples / 4;
+  for (int ii = 0; ii < samples; ii++) in[ii] = (ii < drop) ? 0.1f : 0.001f;
+  CompressorGraph *g = new CompressorGraph(fs_Hz);
+  graph = g;
+  HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, samples);
+  delete g;
+  graph = NULL;
+
+  float before_dB = 20.0f * log10f(out[drop - 1] / in[drop - 1]);
+  float after_dB = 20.0f * log10f(out[samples - 1] / in[samples - 1]);
+  float half_dB = 0.5f * (before_dB + after_dB);
+  for (int ii = drop; ii < samples; ii++) {
+    if (20.0f * log10f(out[ii] / in[ii]) >= half_dB) return 1000.0f * (ii - drop) / fs_Hz;
+  }
+  return -1.0f;
+}
+
+void test_time_constants_follow_rate(void) {
+  char name[80];
+  float reference_msec = halfRecovery_msec(44117.0f);
+  TEST_ASSERT_TRUE(reference_msec > 0.0f);
+  for (float fs_Hz : sampleRates_Hz) {
+    float recovery_msec = halfRecovery_msec(fs_Hz);
+    snprintf(name, sizeof(name), "sample_rates.%.0fHz.half_recovery_msec", fs_Hz);
+    Benchmark::report(name, recovery_msec, "ms");
+    TEST_ASSERT_FLOAT_WITHIN(0.02f * reference_msec, reference_msec, recovery_msec);
+  }
+}
+
+// the magnitude of the response h at f_Hz
+static double magnitude_dB(const float *h, int n, double f_Hz, double fs_Hz) {
+  double w = 2.0 * M_PI * f_Hz / fs_Hz, re = 0.0, im = 0.0;
+  for (int ii = 0; ii < n; ii++) {
+    re += h[ii] * cos(w * ii);
+    im -= h[ii] * sin(w * ii);
+  }
+  return 10.0 * log10(re * re + im * im);
+}
+
+void test_crossovers_follow_rate(void) {
+  const int samples = 64 * BLOCK_SIZE;
+  for (float fs_Hz : sampleRates_Hz) {
+    float crossover_Hz[N_BANDS - 1];
+    computeCrossovers(fs_Hz, crossover_Hz);
+    BottomBandGraph *g = new BottomBandGraph(fs_Hz);
+    graph = g;
+    TEST_ASSERT_TRUE(g->split.setup(crossover_Hz, fs_Hz));
+    memset(in, 0, sizeof(in));
+    in[0] = 1.0f;
+    HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, samples);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, -6.02, magnitude_dB(out, samples, crossover_Hz[0], fs_Hz));
+    delete g;
+    graph = NULL;
+  }
+}
+
+static void report(const char *kind, float fs_Hz, BENCH_TIMING timing, int samples) {
+  char name[80];
+  double audio_s = samples / fs_Hz;
+  snprintf(name, sizeof(name), "sample_rates.%.0fHz.%s.ms_per_audio_second", fs_Hz, kind);
+  Benchmark::report(name, timing.ns * 1e-6 / audio_s, "ms");
+  snprintf(name, sizeof(name), "sample_rates.%.0fHz.%s.cpu_percent", fs_Hz, kind);
+  Benchmark::report(name, timing.ns * 1e-7 / audio_s, "%");
+  snprintf(name, sizeof(name), "sample_rates.%.0fHz.%s.cycles_per_sample", fs_Hz, kind);
+  Benchmark::report(name, timing.cycles / samples, "cycles/sample");
+}
+
+void test_cost_per_rate(void) {
+  for (float fs_Hz : sampleRates_Hz) {
+    int samples = (int)fs_Hz / BLOCK_SIZE * BLOCK_SIZE;   // about a second
+    HostNoise noise(12345);
+    for (int ii = 0; ii < samples; ii++) in[ii] = 0.1f * noise.gaussian();
+
+    CrossoverGraph *iir = new CrossoverGraph(fs_Hz);
+    graph = iir;
+    BENCH_TIMING iirTiming = Benchmark::time([&]() {
+      HostAudio::process(iir->i2s_in, iir->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, samples);
+    });
+    delete iir;
+
+    FilterbankGraph *fft = new FilterbankGraph(fs_Hz);
+    graph = fft;
+    BENCH_TIMING fftTiming = Benchmark::time([&]() {
+      HostAudio::process(fft->i2s_in, fft->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, samples);
+    });
+    delete fft;
+    graph = NULL;
+
+    report("iir", fs_Hz, iirTiming, samples);
+    report("fft", fs_Hz, fftTiming, samples);
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_time_constants_follow_rate);
+  RUN_TEST(test_crossovers_follow_rate);
+  RUN_TEST(test_cost_per_rate);
+  return UNITY_END();
+}
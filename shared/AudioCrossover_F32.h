@@ -0,0 +1,188 @@
+#ifndef _AudioCrossover_F32_h
+#define _AudioCrossover_F32_h
+
+/*
+ *
+ * Linkwitz-Riley (LR4) crossover filterbank that sums back flat, as a pair of nodes: one
+ * splitting the input into N bands, one adding the bands back up (with whatever processing sits
+ * in between).
+ *
+ * Crossover k (counting from 0) lies between band k and band k + 1. AudioCrossoverSplit_F32
+ * works up the crossovers in order: at crossover k the rest of the signal is split into band k
+ * (lowpass) and the new rest (highpass), and the last rest is the top band. Each lowpass and
+ * highpass is a 2nd-order Butterworth section run twice, i.e. 4th-order Linkwitz-Riley, whose
+ * two halves are in phase and add up to a 2nd-order allpass:
+ *
+ *   LP4_k + HP4_k = AP_k
+ *
+ * (no polarity flip needed, unlike LR2). The bands below band k never went through crossover k,
+ * so they miss its phase shift; AudioCrossoverSum_F32 puts it back by running the sum of bands
+ * 0 .. k-1 through AP_k before adding band k on top. With every band at the same gain the output
+ * is the input through AP_0 ... AP_N-2, flat in magnitude. The allpasses sit behind the per-band
+ * processing, which is exact as long as that processing is a (slowly changing) gain, and this
+ * takes N - 2 allpass sections instead of one per band and crossover above it.
+ *
+ * Cost per block: 4 sections per crossover in the split and 1 per crossover but the first in the
+ * sum, so 5 N - 6 sections for N bands. Sections run in transposed direct form II, one block at
+ * a time, as in AudioFilterBiquadCascade_F32.
+ *
+ * Both take the crossovers from setup() (N - 1 of them, rising), which designs the filters and
+ * must be called before the audio starts. Missing input blocks are treated as silence.
+ *
+ */
+
+#include <Tympan_Library.h>
+#include "FilterDesign.h"
+
+class CrossoverSection {
+  public:
+    // b0, b1, b2, a1, a2 as FilterDesign writes them; clears the state
+    void setCoefficients(const float *c) {
+      b0 = c[0]; b1 = c[1]; b2 = c[2]; a1 = c[3]; a2 = c[4];
+      s1 = s2 = 0.0f;
+    }
+
+    // the allpass that a lowpass and highpass of these poles, each squared, add up to
+    void setAllpass(const float *c) {
+      float allpass[5] = { c[4], c[3], 1.0f, c[3], c[4] };
+      setCoefficients(allpass);
+    }
+
+    // in and out may be the same
+    void run(const float32_t *in, float32_t *out, int n) {
+      float32_t y, x, t1 = s1, t2 = s2;
+      for (int ii = 0; ii < n; ii++) {
+        x = in[ii];
+        y = b0 * x + t1;
+        t1 = b1 * x - a1 * y + t2;
+        t2 = b2 * x - a2 * y;
+        out[ii] = y;
+      }
+      s1 = t1;
+      s2 = t2;
+    }
+
+  private:
+    float32_t b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+    float32_t s1 = 0.0f, s2 = 0.0f;
+};
+
+// designs a crossover's 2nd-order Butterworth lowpass and highpass; false if it can't be done
+inline bool designCrossover(float crossover_Hz, float fs_Hz, float *lowpass, float *highpass) {
+  ButterworthDesign design;
+  return design.design(FilterLowpass, crossover_Hz, fs_Hz, 2, lowpass) == 1
+      && design.design(FilterHighpass, crossover_Hz, fs_Hz, 2, highpass) == 1;
+}
+
+template <int N>
+class AudioCrossoverSplit_F32 : public AudioStream_F32 {
+  public:
+    AudioCrossoverSplit_F32(void) : AudioStream_F32(1, inputQueueArray) {}
+
+    // N - 1 rising crossovers, all below fs_Hz / 2
+    bool setup(const float *crossover_Hz, float fs_Hz) {
+      for (int kk = 0; kk < N - 1; kk++) {
+        float lowpass[5], highpass[5];
+        if (kk > 0 && crossover_Hz[kk] <= crossover_Hz[kk - 1]) return false;
+        if (!designCrossover(crossover_Hz[kk], fs_Hz, lowpass, highpass)) return false;
+        for (int jj = 0; jj < 2; jj++) {
+          lowpassSection[kk][jj].setCoefficients(lowpass);
+          highpassSection[kk][jj].setCoefficients(highpass);
+        }
+      }
+      return true;
+    }
+
+    void update(void) {
+      audio_block_f32_t *block = AudioStream_F32::receiveReadOnly_f32();
+      if (!block) return;
+      audio_block_f32_t *bands[N];
+      for (int ii = 0; ii < N; ii++) {
+        bands[ii] = AudioStream_F32::allocate_f32();
+        if (!bands[ii]) {
+          while (ii-- > 0) AudioStream_F32::release(bands[ii]);
+          AudioStream_F32::release(block);
+          return;
+        }
+      }
+      int n = block->length;
+
+      // the rest of the signal is carried up in the next band's block, so the highpass has to
+      // read it before the lowpass overwrites it
+      const float32_t *rest = block->data;
+      for (int kk = 0; kk < N - 1; kk++) {
+        float32_t *low = bands[kk]->data, *high = bands[kk + 1]->data;
+        highpassSection[kk][0].run(rest, high, n);
+        highpassSection[kk][1].run(high, high, n);
+        lowpassSection[kk][0].run(rest, low, n);
+        lowpassSection[kk][1].run(low, low, n);
+        rest = high;
+      }
+
+      for (int ii = 0; ii < N; ii++) {
+        bands[ii]->length = n;
+        bands[ii]->fs_Hz = block->fs_Hz;
+        bands[ii]->id = block->id;
+        AudioStream_F32::transmit(bands[ii], ii);
+        AudioStream_F32::release(bands[ii]);
+      }
+      AudioStream_F32::release(block);
+    }
+
+  private:
+    audio_block_f32_t *inputQueueArray[1];
+    CrossoverSection lowpassSection[N - 1][2];
+    CrossoverSection highpassSection[N - 1][2];
+};
+
+template <int N>
+class AudioCrossoverSum_F32 : public AudioStream_F32 {
+  public:
+    AudioCrossoverSum_F32(void) : AudioStream_F32(N, inputQueueArray) {}
+
+    // the same crossovers as the split
+    bool setup(const float *crossover_Hz, float fs_Hz) {
+      for (int kk = 1; kk < N - 1; kk++) {
+        float lowpass[5], highpass[5];
+        if (!designCrossover(crossover_Hz[kk], fs_Hz, lowpass, highpass)) return false;
+        allpassSection[kk].setAllpass(lowpass);
+      }
+      return true;
+    }
+
+    void update(void) {
+      audio_block_f32_t *bands[N], *first = NULL;
+      for (int ii = 0; ii < N; ii++) {
+        bands[ii] = AudioStream_F32::receiveReadOnly_f32(ii);
+        if (!first) first = bands[ii];
+      }
+      if (!first) return;
+      audio_block_f32_t *out_block = AudioStream_F32::allocate_f32();
+      if (!out_block) {
+        for (int ii = 0; ii < N; ii++) AudioStream_F32::release(bands[ii]);
+        return;
+      }
+      int n = first->length;
+
+      float32_t *sum = out_block->data;
+      if (bands[0]) arm_copy_f32(bands[0]->data, sum, n);
+      else memset(sum, 0, n * sizeof(float32_t));
+      for (int kk = 1; kk < N; kk++) {
+        if (kk < N - 1) allpassSection[kk].run(sum, sum, n);   // crossover kk's phase, for bands 0 .. kk-1
+        if (bands[kk]) arm_add_f32(sum, bands[kk]->data, sum, n);
+      }
+
+      out_block->length = n;
+      out_block->fs_Hz = first->fs_Hz;
+      out_block->id = first->id;
+      AudioStream_F32::transmit(out_block);
+      AudioStream_F32::release(out_block);
+      for (int ii = 0; ii < N; ii++) AudioStream_F32::release(bands[ii]);
+    }
+
+  private:
+    audio_block_f32_t *inputQueueArray[N];
+    CrossoverSection allpassSection[N - 1];   // [0] is not used: band 0 has no bands below it
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef _AudioEffectCompWDRCBuffered_F32_h
+#define _AudioEffectCompWDRCBuffered_F32_h
+
+/*
+ *
+ * BTNRH WDRC compressor (as in AudioEffectCompWDRC_F32) whose parameters can safely be changed
+ * from loop().
+ *
+ * Calling setParams_from_CHA_WDRC() directly from loop() rewrites the compressor's state while the
+ * audio interrupt may be in the middle of a block, so a block can be processed with half of the
+ * old parameters and half of the new ones. Here loop() only publishes a copy of the CHA_WDRC
+ * struct, and the compressor swaps it in itself at the start of the next block.
+ *
+ * Swapping in new gain parameters (tkgain, cr, tk, ...) in one go makes the gain jump, which is
+ * audible as a click. So whenever those change, the output gain is blended, sample by sample over
+ * the ramp time, from the last gain that was actually applied to the new curve. Since the ramp
+ * starts from what was applied, a change that arrives in the middle of another ramp doesn't jump
+ * either. While a ramp is running this costs a multiply-add per sample; the rest of the time it
+ * costs nothing.
+ *
+ * The per-channel work (parameter hand-over, envelope, gain and ramp) lives in WDRCChannel_F32,
+ * which is shared with the stereo compressor.
+ *
+ */
+
+#include <Tympan_Library.h>
+#include "WDRCChannel_F32.h"
+
+class AudioEffectCompWDRCBuffered_F32 : public AudioStream_F32 {
+  public:
+    AudioEffectCompWDRCBuffered_F32(void) : AudioStream_F32(1, inputQueueArray) {}
+
+    // control side: safe to call at any time, takes effect at the next block boundary
+    void publishParams(const BTNRH_WDRC::CHA_WDRC *gha) { channel.publishParams(gha); }
+    void publishDetector(DETECTOR_MODE mode, float window_msec) { channel.publishDetector(mode, window_msec); }
+
+    // how long a change of the gain parameters takes to fully take effect (0 to switch instantly)
+    void setRampTime_msec(float ramp_msec) { channel.setRampTime_msec(ramp_msec); }
+
+    void update(void);
+
+  private:
+    audio_block_f32_t *inputQueueArray[1];
+    WDRCChannel_F32 channel;
+};
+
+void AudioEffectCompWDRCBuffered_F32::update(void) {
+  channel.acquireParams();
+
+  audio_block_f32_t *block = AudioStream_F32::receiveReadOnly_f32();
+  if (!block) return;
+  audio_block_f32_t *out_block = AudioStream_F32::allocate_f32();
+  if (!out_block) {
+    AudioStream_F32::release(block);
+    return;
+  }
+
+  channel.process(block->data, out_block->data, block->length);
+
+  out_block->length = block->length;
+  out_block->fs_Hz = block->fs_Hz;
+  out_block->id = block->id;
+  AudioStream_F32::transmit(out_block);
+  AudioStream_F32::release(out_block);
+  AudioStream_F32::release(block);
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef _AudioEffectCompWDRCStereo_F32_h
+#define _AudioEffectCompWDRCStereo_F32_h
+
+/*
+ *
+ * Two-ear BTNRH WDRC compressor: input/output 0 is the left ear, input/output 1 the right ear.
+ *
+ * In independent mode each ear is compressed on its own, with its own parameters, exactly as two
+ * AudioEffectCompWDRCBuffered_F32 would do it.
+ *
+ * In linked mode the two ears share one envelope detector, driven by the louder of the two ears
+ * sample by sample, and one gain computation, and the same gain is applied to both ears. This
+ * keeps the level difference between the ears (and so the sense of direction) intact, and costs
+ * little over mono. The left ear's (channel 0's) parameters are used for both ears while linked.
+ *
+ * While linked, the right ear's envelope keeps following the shared detector signal, and its last
+ * gain the shared gain (as the stereo limiter does), so that it is ready to carry on whenever the
+ * pair splits. On a switch either way both ears blend over the ramp time from the gain they
+ * last had to the new one, so the switch doesn't click.
+ *
+ * Parameters and the mode are handed over from loop() and take effect at the next block boundary.
+ *
+ */
+
+#include <Tympan_Library.h>
+#include "WDRCChannel_F32.h"
+
+class AudioEffectCompWDRCStereo_F32 : public AudioStream_F32 {
+  public:
+    AudioEffectCompWDRCStereo_F32(void) : AudioStream_F32(2, inputQueueArray) {}
+
+    // control side: safe to call at any time, takes effect at the next block boundary
+    void publishParams(int ear, const BTNRH_WDRC::CHA_WDRC *gha) { ears[ear].publishParams(gha); }
+    void publishDetector(int ear, DETECTOR_MODE mode, float window_msec) { ears[ear].publishDetector(mode, window_msec); }
+    void setLinked(bool linked) { this->linked = linked; }
+    bool getLinked(void) { return linked; }
+
+    // how long a change of the gain parameters takes to fully take effect (0 to switch instantly)
+    void setRampTime_msec(float ramp_msec) {
+      ears[0].setRampTime_msec(ramp_msec);
+      ears[1].setRampTime_msec(ramp_msec);
+    }
+
+    void update(void);
+
+  private:
+    audio_block_f32_t *inputQueueArray[2];
+    WDRCChannel_F32 ears[2];
+    volatile bool linked = true;
+    bool wasLinked = true;   // the mode of the last block, on the audio side
+
+    // scratch
+    float32_t detect[MAX_AUDIO_BLOCK_SAMPLES_F32];
+    float32_t gain[MAX_AUDIO_BLOCK_SAMPLES_F32];
+};
+
+void AudioEffectCompWDRCStereo_F32::update(void) {
+  ears[0].acquireParams();
+  ears[1].acquireParams();
+
+  audio_block_f32_t *left = AudioStream_F32::receiveReadOnly_f32(0);
+  audio_block_f32_t *right = AudioStream_F32::receiveReadOnly_f32(1);
+  audio_block_f32_t *out_left = AudioStream_F32::allocate_f32();
+  audio_block_f32_t *out_right = AudioStream_F32::allocate_f32();
+  if (!left || !right || !out_left || !out_right) {
+    if (left) AudioStream_F32::release(left);
+    if (right) AudioStream_F32::release(right);
+    if (out_left) AudioStream_F32::release(out_left);
+    if (out_right) AudioStream_F32::release(out_right);
+    return;
+  }
+  int n = left->length < right->length ? left->length : right->length;
+
+  bool link = linked;
+  if (link != wasLinked) {
+    ears[0].startRamp();
+    ears[1].startRamp();
+    wasLinked = link;
+  }
+
+  if (link) {
+    // one envelope on the louder ear, one gain for both
+    arm_abs_f32(left->data, detect, n);
+    arm_abs_f32(right->data, gain, n);
+    for (int ii = 0; ii < n; ii++) {
+      if (gain[ii] > detect[ii]) detect[ii] = gain[ii];
+    }
+    ears[1].calcEnvelope_block(detect, gain, n);   // kept in step, the result isn't used
+    ears[0].calcEnvelope_block(detect, detect, n);
+    ears[0].calcGain_block(detect, gain, n);
+    arm_mult_f32(left->data, gain, out_left->data, n);
+    // the right ear blends onto the shared gain if it has only just joined
+    memcpy(detect, gain, n * sizeof(float32_t));
+    ears[1].rampGain_block(detect, n);
+    arm_mult_f32(right->data, detect, out_right->data, n);
+  } else {
+    ears[0].process(left->data, out_left->data, n);
+    ears[1].process(right->data, out_right->data, n);
+  }
+
+  out_left->length = n;
+  out_left->fs_Hz = left->fs_Hz;
+  out_left->id = left->id;
+  out_right->length = n;
+  out_right->fs_Hz = right->fs_Hz;
+  out_right->id = right->id;
+  AudioStream_F32::transmit(out_left, 0);
+  AudioStream_F32::transmit(out_right, 1);
+  AudioStream_F32::release(out_left);
+  AudioStream_F32::release(out_right);
+  AudioStream_F32::release(left);
+  AudioStream_F32::release(right);
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef _AudioEffectFeedbackCancel_F32_h
+#define _AudioEffectFeedbackCancel_F32_h
+
+/*
+ *
+ * Adaptive feedback canceller (block NLMS).
+ *
+ * Input 0 is the microphone signal, input 1 a loopback of what is being sent to the receiver.
+ * An adaptive FIR filter models the path from the receiver back into the microphone; its
+ * estimate of the feedback is subtracted from the microphone signal, and the result (the error)
+ * is the output and also what drives the adaptation.
+ *
+ * The loopback comes from a node that runs later in the audio update, so it arrives one block
+ * after it was computed. What is being cancelled arrives later than that: the block takes a block
+ * to play out, and what the microphone picks up meanwhile takes another block to come in, so the
+ * feedback of a block shows up in the microphone signal two blocks (the I/O round trip, see the
+ * sketch's printLatencyReport()) plus the converters' and the acoustic delay after it was
+ * computed. Left as it is, the loopback would be a block ahead of its feedback and the first
+ * block's worth of taps would be spent modelling silence. The reference is therefore run through
+ * a fixed bulk delay, the round trip less the block that the loopback already lags by, i.e. one
+ * block; the taps only have to cover the converters and the acoustic path.
+ *
+ * The filter is adapted once per block rather than once per sample: the whole block is filtered
+ * with the current taps, and then every tap moves by the correlation of the block's error with
+ * the reference, normalised by the reference power (the NLMS step). Both passes are plain dot
+ * products (arm_dot_prod_f32), which is what the CMSIS kernels are fast at. Because the block's
+ * corrections are summed, step size x block size has to stay well below 2 or the taps diverge;
+ * publishParams() holds it to FEEDBACK_CANCEL_MAX_BLOCK_STEP, for the block size the node was
+ * constructed with (the largest the library is built for if none was given).
+ *
+ * Neither limit depends on the block size the sketch runs at: the bulk delay is limited to four
+ * of the largest blocks, twice the longest round trip, and the taps only ever model the
+ * converters and the acoustic path, which are fixed in samples (256 taps is 5.8 ms at 44.1 kHz).
+ *
+ * Step size, filter length and bulk delay are handed over from loop() through a DoubleBuffer;
+ * changing the length or the delay restarts the adaptation.
+ *
+ */
+
+#include <Tympan_Library.h>
+#include "DoubleBuffer.h"
+
+#define FEEDBACK_CANCEL_MAX_TAPS 256
+#define FEEDBACK_CANCEL_MAX_DELAY (4 * MAX_AUDIO_BLOCK_SAMPLES_F32)   // longest bulk delay, in samples
+#define FEEDBACK_CANCEL_MAX_BLOCK_STEP 1.0f   // largest step size x block size
+
+class AudioEffectFeedbackCancel_F32 : public AudioStream_F32 {
+  public:
+    AudioEffectFeedbackCancel_F32(void) : AudioStream_F32(2, inputQueueArray) {}
+    AudioEffectFeedbackCancel_F32(const AudioSettings_F32 &settings) : AudioStream_F32(2, inputQueueArray) {
+      blockSize = settings.audio_block_samples;
+    }
+
+    // control side: safe to call at any time, takes effect at the next block boundary
+    // bulkDelay_samples is the delay of the reference ahead of the taps (see above)
+    void publishParams(float stepSize, int taps, int bulkDelay_samples) {
+      float maxStep = FEEDBACK_CANCEL_MAX_BLOCK_STEP / blockSize;
+      stepSize = stepSize < 0.0f ? 0.0f : stepSize > maxStep ? maxStep : stepSize;
+      AdaptParams next = { stepSize, taps < 1 ? 1 : taps > FEEDBACK_CANCEL_MAX_TAPS ? FEEDBACK_CANCEL_MAX_TAPS : taps,
+          bulkDelay_samples < 0 ? 0 : bulkDelay_samples > FEEDBACK_CANCEL_MAX_DELAY ? FEEDBACK_CANCEL_MAX_DELAY : bulkDelay_samples };
+      params.publish(next);
+    }
+
+    void update(void);
+
+  private:
+    struct AdaptParams {
+      float stepSize;
+      int taps;
+      int bulkDelay;
+    };
+
+    audio_block_f32_t *inputQueueArray[2];
+    int blockSize = MAX_AUDIO_BLOCK_SAMPLES_F32;
+    DoubleBuffer<AdaptParams> params;
+    AdaptParams current = { 0.0f, 1, 0 };  // a single zero tap, i.e. a pass-through, until published
+
+    // taps stored reversed (weights[0] multiplies the oldest reference sample), so that the
+    // filter output for sample n is a dot product with history[n...]
+    float32_t weights[FEEDBACK_CANCEL_MAX_TAPS];
+
+    // the last taps - 1 reference samples, followed by the current block
+    float32_t history[FEEDBACK_CANCEL_MAX_TAPS - 1 + MAX_AUDIO_BLOCK_SAMPLES_F32];
+    float32_t error[MAX_AUDIO_BLOCK_SAMPLES_F32];
+
+    // bulk delay of the loopback, a ring buffer
+    float32_t delayLine[FEEDBACK_CANCEL_MAX_DELAY];
+    int delayPos = 0;
+
+    void swapParams(const AdaptParams *next);
+};
+
+void AudioEffectFeedbackCancel_F32::update(void) {
+  const AdaptParams *next = params.acquire();
+  if (next) swapParams(next);
+
+  audio_block_f32_t *block = AudioStream_F32::receiveReadOnly_f32(0);
+  audio_block_f32_t *loopback = AudioStream_F32::receiveReadOnly_f32(1);
+  if (!block) {
+    if (loopback) AudioStream_F32::release(loopback);
+    return;
+  }
+  audio_block_f32_t *out_block = AudioStream_F32::allocate_f32();
+  if (!out_block) {
+    AudioStream_F32::release(block);
+    if (loopback) AudioStream_F32::release(loopback);
+    return;
+  }
+  int n = block->length;
+  int taps = current.taps;
+
+  // append the reference (silence until the loopback starts flowing), through the bulk delay
+  float32_t *reference = &history[taps - 1];
+  if (loopback && loopback->length == n) {
+    arm_copy_f32(loopback->data, reference, n);
+  } else {
+    arm_fill_f32(0.0f, reference, n);
+  }
+  if (loopback) AudioStream_F32::release(loopback);
+  if (current.bulkDelay > 0) {
+    const int delay = current.bulkDelay;
+    int pos = delayPos;
+    for (int ii = 0; ii < n; ii++) {
+      float32_t x = reference[ii];
+      reference[ii] = delayLine[pos];
+      delayLine[pos] = x;
+      if (++pos >= delay) pos = 0;
+    }
+    delayPos = pos;
+  }
+
+  // filter with the current taps and subtract the feedback estimate
+  for (int ii = 0; ii < n; ii++) {
+    float32_t estimate;
+    arm_dot_prod_f32(&history[ii], weights, taps, &estimate);
+    error[ii] = block->data[ii] - estimate;
+  }
+  arm_copy_f32(error, out_block->data, n);
+
+  // one NLMS step for the whole block
+  if (current.stepSize > 0.0f) {
+    float32_t energy;
+    arm_dot_prod_f32(history, history, taps - 1 + n, &energy);
+    float32_t norm = current.stepSize / (taps * energy / (taps - 1 + n) + 1e-10f);
+    for (int jj = 0; jj < taps; jj++) {
+      float32_t correlation;
+      arm_dot_prod_f32(error, &history[jj], n, &correlation);
+      weights[jj] += norm * correlation;
+    }
+  }
+
+  // keep the last taps - 1 reference samples for the next block
+  memmove(history, &history[n], (taps - 1) * sizeof(float32_t));
+
+  out_block->length = n;
+  out_block->fs_Hz = block->fs_Hz;
+  out_block->id = block->id;
+  AudioStream_F32::transmit(out_block);
+  AudioStream_F32::release(out_block);
+  AudioStream_F32::release(block);
+}
+
+void AudioEffectFeedbackCancel_F32::swapParams(const AdaptParams *next) {
+  if (next->taps != current.taps || next->bulkDelay != current.bulkDelay) {
+    memset(weights, 0, sizeof(weights));
+    memset(history, 0, sizeof(history));
+    memset(delayLine, 0, sizeof(delayLine));
+    delayPos = 0;
+  }
+  current = *next;
+}
+
+#endif
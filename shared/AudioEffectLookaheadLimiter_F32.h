@@ -0,0 +1,251 @@
+#ifndef _AudioEffectLookaheadLimiter_F32_h
+#define _AudioEffectLookaheadLimiter_F32_h
+
+/*
+ *
+ * Lookahead brickwall limiter, meant to sit behind the WDRC compressor and enforce its bolt.
+ *
+ * The threshold is the CHA_WDRC's bolt (broadband output limiting threshold), taken relative to
+ * maxdB, which is what a full-scale (1.0) sample corresponds to. The signal is delayed by the
+ * lookahead, and the gain is computed from the peak of everything that is still in the delay
+ * line, so the gain is already down by the time a peak comes out. The gain falls with a time
+ * constant of a fifth of the lookahead (i.e. almost completely settled when the peak arrives)
+ * and recovers with the release time; whatever still gets through is clamped to the threshold.
+ *
+ * The delay line is a ring buffer, and the peak over the window is kept with a monotonic deque
+ * (a sliding-window maximum), so the cost per sample is constant however long the lookahead is.
+ *
+ * Parameters are handed over from loop() through a DoubleBuffer and take effect at the next block
+ * boundary. Changing the lookahead restarts the delay line.
+ *
+ * The per-ear work lives in LookaheadLimiterChannel. AudioEffectLookaheadLimiter_F32 limits one
+ * signal; AudioEffectLookaheadLimiterStereo_F32 limits both ears (input/output 0 the left ear,
+ * 1 the right ear), either independently or, like the stereo compressor, linked: one gain,
+ * driven by the larger of the two ears' peaks and the left ear's bolt, applied to both, so that
+ * limiting one ear doesn't shift the image towards the other. Both ears must be given the same
+ * lookahead for the linked gain to line up with both delay lines.
+ *
+ */
+
+#include <Tympan_Library.h>
+#include "DoubleBuffer.h"
+
+#define LOOKAHEAD_LIMITER_MAX_SAMPLES 256                        // longest lookahead, a power of two
+#define LOOKAHEAD_LIMITER_DEQUE_SIZE (2 * LOOKAHEAD_LIMITER_MAX_SAMPLES)
+
+class LookaheadLimiterChannel {
+  public:
+    // control side: safe to call at any time, takes effect at the next acquireParams()
+    void publishParams(const BTNRH_WDRC::CHA_WDRC *gha, float lookahead_msec, float release_msec) {
+      LimiterParams next;
+      next.threshold = powf(10.0f, (gha->bolt - gha->maxdB) / 20.0f);
+      next.lookahead = (int)(lookahead_msec * 0.001f * gha->fs + 0.5f);
+      if (next.lookahead < 0) next.lookahead = 0;
+      if (next.lookahead > LOOKAHEAD_LIMITER_MAX_SAMPLES) next.lookahead = LOOKAHEAD_LIMITER_MAX_SAMPLES;
+      next.attackCoeff = next.lookahead > 0 ? expf(-5.0f / next.lookahead) : 0.0f;
+      float release_samples = release_msec * 0.001f * gha->fs;
+      next.releaseCoeff = release_samples > 1.0f ? expf(-1.0f / release_samples) : 0.0f;
+      publishedLookahead = next.lookahead;
+      params.publish(next);
+    }
+
+    // delay added by the limiter, as of the last publishParams()
+    int getLatency_samples(void) { return publishedLookahead; }
+
+    // audio side: at the start of every block
+    void acquireParams(void) {
+      const LimiterParams *next = params.acquire();
+      if (!next) return;
+      if (next->lookahead != current.lookahead) {
+        memset(delay, 0, sizeof(delay));
+        delayPos = 0;
+        dequeHead = dequeTail = 0;
+      }
+      current = *next;
+    }
+
+    float getThreshold(void) { return current.threshold; }
+
+    // one sample in: returns the peak of the samples still in the delay line (including this
+    // one), and the sample coming out of the delay line in *delayed
+    inline float push(float x, float *delayed) {
+      const uint32_t mask = LOOKAHEAD_LIMITER_DEQUE_SIZE - 1;
+      const uint32_t window = current.lookahead;
+      float level = fabsf(x);
+      while (dequeTail != dequeHead && dequeValue[(dequeTail - 1) & mask] <= level) dequeTail--;
+      dequeValue[dequeTail & mask] = level;
+      dequeIndex[dequeTail & mask] = sampleIndex;
+      dequeTail++;
+      if (sampleIndex - dequeIndex[dequeHead & mask] > window) dequeHead++;
+      sampleIndex++;
+
+      *delayed = x;
+      if (window > 0) {
+        *delayed = delay[delayPos];
+        delay[delayPos] = x;
+        if (++delayPos >= (int)window) delayPos = 0;
+      }
+      return dequeValue[dequeHead & mask];
+    }
+
+    // moves the gain towards what the peak needs: down over the lookahead, up over the release
+    inline float follow(float peak, float threshold) {
+      float target = peak > threshold ? threshold / peak : 1.0f;
+      gain = target + ((target < gain) ? current.attackCoeff : current.releaseCoeff) * (gain - target);
+      return gain;
+    }
+
+    void setGain(float g) { gain = g; }
+
+    static inline float clamp(float y, float threshold) {
+      if (y > threshold) return threshold;
+      if (y < -threshold) return -threshold;
+      return y;
+    }
+
+    void process(const float32_t *in, float32_t *out, int n) {
+      const float threshold = current.threshold;
+      for (int ii = 0; ii < n; ii++) {
+        float delayed;
+        float peak = push(in[ii], &delayed);
+        out[ii] = clamp(delayed * follow(peak, threshold), threshold);
+      }
+    }
+
+  private:
+    struct LimiterParams {
+      float threshold;     // linear, 1.0 = full scale
+      int lookahead;       // samples
+      float attackCoeff;
+      float releaseCoeff;
+    };
+
+    DoubleBuffer<LimiterParams> params;
+    LimiterParams current = { 1.0f, 0, 0.0f, 0.0f };
+    int publishedLookahead = 0;
+    float gain = 1.0f;
+
+    // delay line
+    float32_t delay[LOOKAHEAD_LIMITER_MAX_SAMPLES];
+    int delayPos = 0;
+
+    // sliding-window maximum: values decrease from head to tail
+    float32_t dequeValue[LOOKAHEAD_LIMITER_DEQUE_SIZE];
+    uint32_t dequeIndex[LOOKAHEAD_LIMITER_DEQUE_SIZE];
+    uint32_t dequeHead = 0;
+    uint32_t dequeTail = 0;
+    uint32_t sampleIndex = 0;
+};
+
+class AudioEffectLookaheadLimiter_F32 : public AudioStream_F32 {
+  public:
+    AudioEffectLookaheadLimiter_F32(void) : AudioStream_F32(1, inputQueueArray) {}
+
+    // control side: safe to call at any time, takes effect at the next block boundary
+    void publishParams(const BTNRH_WDRC::CHA_WDRC *gha, float lookahead_msec, float release_msec) {
+      channel.publishParams(gha, lookahead_msec, release_msec);
+    }
+
+    // delay added by the limiter, as of the last publishParams()
+    int getLatency_samples(void) { return channel.getLatency_samples(); }
+
+    void update(void);
+
+  private:
+    audio_block_f32_t *inputQueueArray[1];
+    LookaheadLimiterChannel channel;
+};
+
+void AudioEffectLookaheadLimiter_F32::update(void) {
+  channel.acquireParams();
+
+  audio_block_f32_t *block = AudioStream_F32::receiveReadOnly_f32();
+  if (!block) return;
+  audio_block_f32_t *out_block = AudioStream_F32::allocate_f32();
+  if (!out_block) {
+    AudioStream_F32::release(block);
+    return;
+  }
+
+  channel.process(block->data, out_block->data, block->length);
+
+  out_block->length = block->length;
+  out_block->fs_Hz = block->fs_Hz;
+  out_block->id = block->id;
+  AudioStream_F32::transmit(out_block);
+  AudioStream_F32::release(out_block);
+  AudioStream_F32::release(block);
+}
+
+class AudioEffectLookaheadLimiterStereo_F32 : public AudioStream_F32 {
+  public:
+    AudioEffectLookaheadLimiterStereo_F32(void) : AudioStream_F32(2, inputQueueArray) {}
+
+    // control side: safe to call at any time, takes effect at the next block boundary
+    void publishParams(int ear, const BTNRH_WDRC::CHA_WDRC *gha, float lookahead_msec, float release_msec) {
+      ears[ear].publishParams(gha, lookahead_msec, release_msec);
+    }
+    void setLinked(bool linked) { this->linked = linked; }
+    bool getLinked(void) { return linked; }
+
+    // delay added by the limiter, as of the last publishParams() (the left ear's)
+    int getLatency_samples(void) { return ears[0].getLatency_samples(); }
+
+    void update(void);
+
+  private:
+    audio_block_f32_t *inputQueueArray[2];
+    LookaheadLimiterChannel ears[2];
+    volatile bool linked = true;
+};
+
+void AudioEffectLookaheadLimiterStereo_F32::update(void) {
+  ears[0].acquireParams();
+  ears[1].acquireParams();
+
+  audio_block_f32_t *left = AudioStream_F32::receiveReadOnly_f32(0);
+  audio_block_f32_t *right = AudioStream_F32::receiveReadOnly_f32(1);
+  audio_block_f32_t *out_left = AudioStream_F32::allocate_f32();
+  audio_block_f32_t *out_right = AudioStream_F32::allocate_f32();
+  if (!left || !right || !out_left || !out_right) {
+    if (left) AudioStream_F32::release(left);
+    if (right) AudioStream_F32::release(right);
+    if (out_left) AudioStream_F32::release(out_left);
+    if (out_right) AudioStream_F32::release(out_right);
+    return;
+  }
+  int n = left->length < right->length ? left->length : right->length;
+
+  if (linked) {
+    // one gain for both, from the larger peak and the left ear's bolt
+    const float threshold = ears[0].getThreshold();
+    float g = 1.0f;
+    for (int ii = 0; ii < n; ii++) {
+      float delayedLeft, delayedRight;
+      float peakLeft = ears[0].push(left->data[ii], &delayedLeft);
+      float peakRight = ears[1].push(right->data[ii], &delayedRight);
+      g = ears[0].follow(peakLeft > peakRight ? peakLeft : peakRight, threshold);
+      out_left->data[ii] = LookaheadLimiterChannel::clamp(delayedLeft * g, threshold);
+      out_right->data[ii] = LookaheadLimiterChannel::clamp(delayedRight * g, threshold);
+    }
+    ears[1].setGain(g);   // so that unlinking carries on from the gain that was applied
+  } else {
+    ears[0].process(left->data, out_left->data, n);
+    ears[1].process(right->data, out_right->data, n);
+  }
+
+  out_left->length = n;
+  out_left->fs_Hz = left->fs_Hz;
+  out_left->id = left->id;
+  out_right->length = n;
+  out_right->fs_Hz = right->fs_Hz;
+  out_right->id = right->id;
+  AudioStream_F32::transmit(out_left, 0);
+  AudioStream_F32::transmit(out_right, 1);
+  AudioStream_F32::release(out_left);
+  AudioStream_F32::release(out_right);
+  AudioStream_F32::release(left);
+  AudioStream_F32::release(right);
+}
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef _AudioEffectNoiseReduction_F32_h
+#define _AudioEffectNoiseReduction_F32_h
+
+/*
+ *
+ * Spectral noise reduction, controlled by the expansion parameters of a CHA_WDRC.
+ *
+ * Every block goes through an STFT (STFT_F32, one hop per block). For each bin the power is
+ * smoothed over time and the noise floor is estimated by minimum statistics: the minimum of the
+ * smoothed power over the last one to two seconds (tracked in two alternating sub-windows, so
+ * that the estimate can rise again), times a bias correction. Each bin then gets a Wiener-style
+ * gain
+ *
+ *   snr  = max(power / noise - 1, 0)
+ *   gain = max(snr / (snr + alpha), gain floor)
+ *
+ * where the over-subtraction alpha comes from the expansion ratio: alpha = 1 / exp_cr, clamped to
+ * 1..10, so the stronger the expansion, the harder the noise is pushed down. Bins whose level is
+ * above the expansion kneepoint (exp_end_knee, in dB SPL relative to maxdB at full scale) are
+ * left alone, just as the expander leaves levels above the kneepoint alone.
+ *
+ * With exp_cr at 1 or above the expander is off, and so is the noise reduction: the block goes
+ * through the STFT's delay only (STFT_F32::bypass(), no FFTs), so the latency, and the alignment
+ * of the two ears, stays the same. The noise estimate starts over when it is turned back on.
+ *
+ * All buffers (the STFT's and the per-bin state) are allocated once in setup(). Until setup() has
+ * succeeded the block is passed through untouched. The output is delayed by fftSize - blockSize
+ * samples (see getLatency_samples()).
+ *
+ */
+
+#include <Tympan_Library.h>
+#include "DoubleBuffer.h"
+#include "STFT_F32.h"
+
+#define NOISE_REDUCTION_SMOOTHING 0.85f   // per-frame smoothing of the bin power
+#define NOISE_REDUCTION_BIAS      1.5f    // minimum of the smoothed power -> mean noise power
+#define NOISE_REDUCTION_WINDOW_S  0.75f   // length of each of the two minimum-tracking sub-windows
+#define NOISE_REDUCTION_FLOOR     0.1f    // lowest gain (-20 dB), to keep musical noise down
+
+class AudioEffectNoiseReduction_F32 : public AudioStream_F32 {
+  public:
+    AudioEffectNoiseReduction_F32(void) : AudioStream_F32(1, inputQueueArray) {}
+    ~AudioEffectNoiseReduction_F32(void) { free(binBuffers); }
+
+    // Allocates, so call it from setup() rather than while audio is running.
+    bool setup(int fftSize, int blockSize, float fs_Hz);
+
+    // control side: safe to call at any time, takes effect at the next block boundary
+    void publishParams(const BTNRH_WDRC::CHA_WDRC *gha) { params.publish(*gha); }
+
+    int getLatency_samples(void) { return ready ? stft.getLatency_samples() : 0; }
+
+    void update(void);
+
+  private:
+    audio_block_f32_t *inputQueueArray[1];
+    STFT_F32 stft;
+    bool ready = false;
+    int nBins = 0;
+    float levelScale = 0.0f;  // bin power -> squared signal amplitude
+    int framesPerWindow = 1;
+    int frameCount = 0;
+    bool firstFrame = true;
+
+    DoubleBuffer<BTNRH_WDRC::CHA_WDRC> params;
+    bool bypassed = false;    // exp_cr >= 1: no expansion, no noise reduction
+    float alpha = 1.0f;
+    float kneePower = 0.0f;   // smoothed bin power at the expansion kneepoint
+
+    // per-bin state, one allocation
+    float32_t *binBuffers = NULL;
+    float32_t *power;         // smoothed power
+    float32_t *minimum;       // minimum over the previous sub-window and the current one
+    float32_t *runningMin;    // minimum over the current sub-window
+
+    void swapParams(const BTNRH_WDRC::CHA_WDRC *next);
+    void reduce(const float32_t *in);
+    float32_t binGain(int bin, float32_t binPower);
+};
+
+bool AudioEffectNoiseReduction_F32::setup(int fftSize, int blockSize, float fs_Hz) {
+  ready = false;
+  if (!stft.setup(fftSize, blockSize)) return false;
+  nBins = fftSize / 2 + 1;
+  free(binBuffers);
+  binBuffers = (float32_t *)calloc(3 * nBins, sizeof(float32_t));
+  if (!binBuffers) return false;
+  power = binBuffers;
+  minimum = power + nBins;
+  runningMin = minimum + nBins;
+  levelScale = 4.0f / (fftSize * stft.getWindowEnergy());
+  framesPerWindow = (int)(NOISE_REDUCTION_WINDOW_S * fs_Hz / blockSize + 0.5f);
+  if (framesPerWindow < 1) framesPerWindow = 1;
+  frameCount = 0;
+  firstFrame = true;
+  ready = true;
+  return true;
+}
+
+void AudioEffectNoiseReduction_F32::update(void) {
+  const BTNRH_WDRC::CHA_WDRC *next = params.acquire();
+  if (next) swapParams(next);
+
+  audio_block_f32_t *block = AudioStream_F32::receiveReadOnly_f32();
+  if (!block) return;
+  if (!ready || block->length != stft.getHopSize()) {
+    AudioStream_F32::transmit(block);
+    AudioStream_F32::release(block);
+    return;
+  }
+  audio_block_f32_t *out_block = AudioStream_F32::allocate_f32();
+  if (!out_block) {
+    AudioStream_F32::release(block);
+    return;
+  }
+
+  if (bypassed) {
+    stft.bypass(block->data, out_block->data);
+    firstFrame = true;
+    frameCount = 0;
+  } else {
+    reduce(block->data);
+    stft.synthesize(out_block->data);
+  }
+
+  out_block->length = block->length;
+  out_block->fs_Hz = block->fs_Hz;
+  out_block->id = block->id;
+  AudioStream_F32::transmit(out_block);
+  AudioStream_F32::release(out_block);
+  AudioStream_F32::release(block);
+}
+
+// analysis and the per-bin gains, leaving the spectrum for synthesize()
+void AudioEffectNoiseReduction_F32::reduce(const float32_t *in) {
+  // DC and Nyquist are the two packed real bins at the front, bin k is at 2k, 2k + 1 otherwise
+  float32_t *spectrum = stft.analyze(in);
+  int nyquist = nBins - 1;
+  for (int bin = 0; bin < nBins; bin++) {
+    float32_t re = (bin == nyquist) ? spectrum[1] : spectrum[2 * bin];
+    float32_t im = (bin == 0 || bin == nyquist) ? 0.0f : spectrum[2 * bin + 1];
+    float32_t binPower = re * re + im * im;
+    float32_t g = binGain(bin, binPower);
+    if (bin == nyquist) {
+      spectrum[1] *= g;
+    } else if (bin == 0) {
+      spectrum[0] *= g;
+    } else {
+      spectrum[2 * bin] *= g;
+      spectrum[2 * bin + 1] *= g;
+    }
+  }
+  firstFrame = false;
+
+  // start a new minimum-tracking sub-window
+  if (++frameCount >= framesPerWindow) {
+    frameCount = 0;
+    for (int bin = 0; bin < nBins; bin++) {
+      minimum[bin] = runningMin[bin];
+      runningMin[bin] = power[bin];
+    }
+  }
+}
+
+inline float32_t AudioEffectNoiseReduction_F32::binGain(int bin, float32_t binPower) {
+  float32_t p;
+  if (firstFrame) {
+    p = binPower;
+    minimum[bin] = runningMin[bin] = p;
+  } else {
+    p = NOISE_REDUCTION_SMOOTHING * power[bin] + (1.0f - NOISE_REDUCTION_SMOOTHING) * binPower;
+    if (p < minimum[bin]) minimum[bin] = p;
+    if (p < runningMin[bin]) runningMin[bin] = p;
+  }
+  power[bin] = p;
+
+  if (p >= kneePower) return 1.0f;
+  float32_t noise = NOISE_REDUCTION_BIAS * minimum[bin];
+  float32_t snr = (noise > 0.0f) ? p / noise - 1.0f : 0.0f;
+  if (snr < 0.0f) snr = 0.0f;
+  float32_t g = snr / (snr + alpha);
+  return g < NOISE_REDUCTION_FLOOR ? NOISE_REDUCTION_FLOOR : g;
+}
+
+void AudioEffectNoiseReduction_F32::swapParams(const BTNRH_WDRC::CHA_WDRC *next) {
+  bypassed = !(next->exp_cr < 1.0f);
+  alpha = (next->exp_cr > 0.0f) ? 1.0f / next->exp_cr : 10.0f;
+  if (alpha < 1.0f) alpha = 1.0f;
+  if (alpha > 10.0f) alpha = 10.0f;
+  // a sine of amplitude A puts a power of A^2 / levelScale into the few bins around it
+  float kneeAmplitude = powf(10.0f, (next->exp_end_knee - next->maxdB) / 20.0f);
+  kneePower = (levelScale > 0.0f) ? kneeAmplitude * kneeAmplitude / levelScale : 0.0f;
+}
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef _AudioEffectWDRCFilterbank_F32_h
+#define _AudioEffectWDRCFilterbank_F32_h
+
+/*
+ *
+ * Multi-band WDRC on a shared FFT analysis.
+ *
+ * Running one IIR filter and one compressor per band makes the cost grow with the number of
+ * bands. Here a single STFT (weighted overlap-add, one hop per audio block) does the analysis
+ * for all bands at once: every band is just a range of FFT bins. For each frame the band's power
+ * is summed over its bins, turned into a level, smoothed with the band's attack/release and run
+ * through the band's WDRC curve (built from its CHA_WDRC), and the resulting gain is applied to
+ * the band's bins before resynthesis. The FFTs and the per-bin work are the same whatever the
+ * number of bands, so adding a band only adds its level/gain math.
+ *
+ * Each band's parameters are handed over from loop() through a DoubleBuffer, as in
+ * AudioEffectCompWDRCBuffered_F32, and swapped in at the start of a block. The envelope runs
+ * at the frame rate (sample rate / hop size) rather than per sample.
+ *
+ * A band's level is calibrated so that a sine of amplitude A inside the band reads A, which is
+ * what the time-domain peak detector of the per-band compressors settles to, so a fitting means
+ * the same dB SPL either way (the power summed over the band's bins is scaled by
+ * 4 / (fftSize * window energy) before the square root).
+ *
+ * The output is delayed by fftSize - blockSize samples (see getLatency_samples()). If setup()
+ * fails, or a block arrives that is not one hop long, the audio is passed through unprocessed.
+ *
+ */
+
+#include <Tympan_Library.h>
+#include "DoubleBuffer.h"
+#include "FastWDRC.h"
+#include "STFT_F32.h"
+
+#define WDRC_FILTERBANK_MAX_BANDS 16
+
+class AudioEffectWDRCFilterbank_F32 : public AudioStream_F32 {
+  public:
+    AudioEffectWDRCFilterbank_F32(void) : AudioStream_F32(1, inputQueueArray) {}
+
+    // crossover_Hz holds the nBands - 1 band edges in ascending order. Allocates, so call it
+    // from setup() rather than while audio is running.
+    bool setup(int nBands, const float *crossover_Hz, int fftSize, int blockSize, float fs_Hz);
+
+    // control side: safe to call at any time, takes effect at the next block boundary
+    void publishParams(int band, const BTNRH_WDRC::CHA_WDRC *gha) { params[band].publish(*gha); }
+
+    int getLatency_samples(void) { return nBands ? stft.getLatency_samples() : 0; }
+
+    void update(void);
+
+  private:
+    audio_block_f32_t *inputQueueArray[1];
+    STFT_F32 stft;
+    float frameRate_Hz = 0.0f;
+    float levelScale = 0.0f;  // band power -> squared signal amplitude
+
+    int nBands = 0;
+    int bandStart[WDRC_FILTERBANK_MAX_BANDS + 1]; // first bin of every band, plus one past the last
+    DoubleBuffer<BTNRH_WDRC::CHA_WDRC> params[WDRC_FILTERBANK_MAX_BANDS];
+    FastGainWDRC_F32 gain[WDRC_FILTERBANK_MAX_BANDS];
+    float maxdB[WDRC_FILTERBANK_MAX_BANDS];
+    float alfa[WDRC_FILTERBANK_MAX_BANDS];
+    float beta[WDRC_FILTERBANK_MAX_BANDS];
+    float envelope[WDRC_FILTERBANK_MAX_BANDS];
+
+    void swapParams(int band, const BTNRH_WDRC::CHA_WDRC *next);
+};
+
+bool AudioEffectWDRCFilterbank_F32::setup(int nBands, const float *crossover_Hz, int fftSize, int blockSize, float fs_Hz) {
+  this->nBands = 0;   // passing the audio through until set up
+  if (nBands < 1 || nBands > WDRC_FILTERBANK_MAX_BANDS) return false;
+  if (!stft.setup(fftSize, blockSize)) return false;
+  this->nBands = nBands;
+  frameRate_Hz = fs_Hz / blockSize;
+  levelScale = 4.0f / (fftSize * stft.getWindowEnergy());
+
+  int lastBin = fftSize / 2;
+  bandStart[0] = 0;
+  for (int ii = 1; ii < nBands; ii++) {
+    int bin = (int)ceilf(crossover_Hz[ii - 1] * fftSize / fs_Hz);
+    bandStart[ii] = bin < bandStart[ii - 1] ? bandStart[ii - 1] : bin > lastBin ? lastBin : bin;
+  }
+  bandStart[nBands] = lastBin + 1;
+
+  for (int ii = 0; ii < nBands; ii++) {
+    maxdB[ii] = 119.0f;
+    alfa[ii] = 0.0f;
+    beta[ii] = 0.0f;
+    envelope[ii] = 0.0f;
+  }
+  return true;
+}
+
+void AudioEffectWDRCFilterbank_F32::update(void) {
+  for (int ii = 0; ii < nBands; ii++) {
+    const BTNRH_WDRC::CHA_WDRC *next = params[ii].acquire();
+    if (next) swapParams(ii, next);
+  }
+
+  audio_block_f32_t *block = AudioStream_F32::receiveReadOnly_f32();
+  if (!block) return;
+  if (nBands == 0 || block->length != stft.getHopSize()) {
+    AudioStream_F32::transmit(block);   // not set up for it: better unprocessed than silent
+    AudioStream_F32::release(block);
+    return;
+  }
+  audio_block_f32_t *out_block = AudioStream_F32::allocate_f32();
+  if (!out_block) {
+    AudioStream_F32::release(block);
+    return;
+  }
+
+  float32_t *spectrum = stft.analyze(block->data);
+  int nyquist = stft.getFFTSize() / 2;
+  for (int band = 0; band < nBands; band++) {
+    // band power; DC and Nyquist are the two packed real bins at the front
+    int first = bandStart[band];
+    int last = bandStart[band + 1];
+    int lo = first > 0 ? first : 1;
+    int hi = last <= nyquist ? last : nyquist;
+    float power = 0.0f;
+    for (int bin = lo; bin < hi; bin++) {
+      power += spectrum[2 * bin] * spectrum[2 * bin] + spectrum[2 * bin + 1] * spectrum[2 * bin + 1];
+    }
+    if (first == 0) power += spectrum[0] * spectrum[0];
+    if (last > nyquist) power += spectrum[1] * spectrum[1];
+
+    // level (a sine of amplitude A reads A) -> smoothed envelope -> WDRC gain
+    float level = sqrtf(power * levelScale);
+    envelope[band] = (level >= envelope[band])
+        ? alfa[band] * envelope[band] + (1.0f - alfa[band]) * level
+        : beta[band] * envelope[band];
+    float g = FastDB::undb2(gain[band].gain_dB(maxdB[band] + FastDB::db2(envelope[band])));
+
+    if (hi > lo) arm_scale_f32(&spectrum[2 * lo], g, &spectrum[2 * lo], 2 * (hi - lo));
+    if (first == 0) spectrum[0] *= g;
+    if (last > nyquist) spectrum[1] *= g;
+  }
+  stft.synthesize(out_block->data);
+
+  out_block->length = block->length;
+  out_block->fs_Hz = block->fs_Hz;
+  out_block->id = block->id;
+  AudioStream_F32::transmit(out_block);
+  AudioStream_F32::release(out_block);
+  AudioStream_F32::release(block);
+}
+
+void AudioEffectWDRCFilterbank_F32::swapParams(int band, const BTNRH_WDRC::CHA_WDRC *next) {
+  // same ANSI-style time constants as the BTNRH peak detector, but at the frame rate
+  float ansi_atk = 0.001f * next->attack * frameRate_Hz / 2.425f;
+  float ansi_rel = 0.001f * next->release * frameRate_Hz / 1.782f;
+  alfa[band] = ansi_atk / (1.0f + ansi_atk);
+  beta[band] = ansi_rel / (10.0f + ansi_rel);
+  maxdB[band] = next->maxdB;
+  gain[band].setParams_from_CHA_WDRC(next);
+}
+
+#endif
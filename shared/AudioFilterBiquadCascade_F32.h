@@ -0,0 +1,145 @@
+#ifndef _AudioFilterBiquadCascade_F32_h
+#define _AudioFilterBiquadCascade_F32_h
+
+/*
+ *
+ * Cascade of any number (up to BIQUAD_CASCADE_MAX_SECTIONS) of second-order sections, in
+ * transposed direct form II.
+ *
+ * Every section keeps its coefficients and its two state variables side by side, so running a
+ * section touches one small contiguous struct, and the block is run through one section at a
+ * time with the state held in registers.
+ *
+ * Coefficients are given per section as b0, b1, b2, a1, a2, for
+ *
+ *           b0 + b1 z^-1 + b2 z^-2
+ *   H(z) = ------------------------
+ *            1 + a1 z^-1 + a2 z^-2
+ *
+ * i.e. Matlab's sign convention with a0 already divided out. New coefficients are handed over
+ * from loop() through a DoubleBuffer and swapped in at the next block boundary. The filter state
+ * is kept across the swap as long as the number of sections stays the same, so retuning doesn't
+ * click; with no sections the block is passed through untouched.
+ *
+ * A set is refused, and the filter left as it was, if any coefficient is not a finite number or
+ * any section has a pole on or outside the unit circle, i.e. unless |a2| < 1 and |a1| < 1 + a2
+ * (the stability triangle): one bad set loaded over the serial port would otherwise leave the
+ * filter ringing or stuck at inf/NaN for good.
+ *
+ */
+
+#include <Tympan_Library.h>
+#include "DoubleBuffer.h"
+
+#define BIQUAD_CASCADE_MAX_SECTIONS 8
+
+class AudioFilterBiquadCascade_F32 : public AudioStream_F32 {
+  public:
+    AudioFilterBiquadCascade_F32(void) : AudioStream_F32(1, inputQueueArray) {}
+
+    // control side: safe to call at any time, takes effect at the next block boundary.
+    // coeffs holds 5 values (b0, b1, b2, a1, a2) per section. False, changing nothing, if they
+    // are not finite or not stable.
+    bool setCoefficients(int nSections, const float32_t *coeffs) {
+      if (nSections < 0 || nSections > BIQUAD_CASCADE_MAX_SECTIONS) return false;
+      for (int jj = 0; jj < nSections; jj++) {
+        if (!isUsableSection(&coeffs[5 * jj])) return false;
+      }
+      CoefficientSet next;
+      next.nSections = nSections;
+      memcpy(next.coeffs, coeffs, 5 * nSections * sizeof(float32_t));
+      params.publish(next);
+      return true;
+    }
+
+    // a single section from Matlab-style b[3] and a[3] (a[0] need not be 1)
+    bool setFilterCoeff_Matlab(const float32_t b[], const float32_t a[]) {
+      float32_t coeffs[5] = { b[0] / a[0], b[1] / a[0], b[2] / a[0], a[1] / a[0], a[2] / a[0] };
+      return setCoefficients(1, coeffs);
+    }
+
+    void update(void);
+
+  private:
+    struct CoefficientSet {
+      int nSections;
+      float32_t coeffs[5 * BIQUAD_CASCADE_MAX_SECTIONS];
+    };
+
+    struct Section {
+      float32_t b0, b1, b2, a1, a2;
+      float32_t s1, s2;
+    };
+
+    audio_block_f32_t *inputQueueArray[1];
+    DoubleBuffer<CoefficientSet> params;
+    Section sections[BIQUAD_CASCADE_MAX_SECTIONS];
+    int nSections = 0;
+
+    void swapCoefficients(const CoefficientSet *next);
+
+    // finite, with both poles strictly inside the unit circle
+    static bool isUsableSection(const float32_t *c) {
+      for (int ii = 0; ii < 5; ii++) {
+        if (!isfinite(c[ii])) return false;
+      }
+      return fabsf(c[4]) < 1.0f && fabsf(c[3]) < 1.0f + c[4];
+    }
+};
+
+void AudioFilterBiquadCascade_F32::update(void) {
+  const CoefficientSet *next = params.acquire();
+  if (next) swapCoefficients(next);
+
+  audio_block_f32_t *block = AudioStream_F32::receiveReadOnly_f32();
+  if (!block) return;
+  audio_block_f32_t *out_block = AudioStream_F32::allocate_f32();
+  if (!out_block) {
+    AudioStream_F32::release(block);
+    return;
+  }
+  int n = block->length;
+
+  const float32_t *in = block->data;
+  float32_t *out = out_block->data;
+  if (nSections == 0) arm_copy_f32(in, out, n);
+  for (int jj = 0; jj < nSections; jj++) {
+    Section *section = &sections[jj];
+    float32_t b0 = section->b0, b1 = section->b1, b2 = section->b2;
+    float32_t a1 = section->a1, a2 = section->a2;
+    float32_t s1 = section->s1, s2 = section->s2;
+    for (int ii = 0; ii < n; ii++) {
+      float32_t x = in[ii];
+      float32_t y = b0 * x + s1;
+      s1 = b1 * x - a1 * y + s2;
+      s2 = b2 * x - a2 * y;
+      out[ii] = y;
+    }
+    section->s1 = s1;
+    section->s2 = s2;
+    in = out;  // later sections run in place on the output block
+  }
+
+  out_block->length = n;
+  out_block->fs_Hz = block->fs_Hz;
+  out_block->id = block->id;
+  AudioStream_F32::transmit(out_block);
+  AudioStream_F32::release(out_block);
+  AudioStream_F32::release(block);
+}
+
+void AudioFilterBiquadCascade_F32::swapCoefficients(const CoefficientSet *next) {
+  bool keepState = (next->nSections == nSections);
+  nSections = next->nSections;
+  for (int jj = 0; jj < nSections; jj++) {
+    const float32_t *c = &next->coeffs[5 * jj];
+    sections[jj].b0 = c[0];
+    sections[jj].b1 = c[1];
+    sections[jj].b2 = c[2];
+    sections[jj].a1 = c[3];
+    sections[jj].a2 = c[4];
+    if (!keepState) sections[jj].s1 = sections[jj].s2 = 0.0f;
+  }
+}
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef _AudioHealthMonitor_F32_h
+#define _AudioHealthMonitor_F32_h
+
+/*
+ *
+ * Counts the audio faults that are heard as clicks, so that they can be told apart in the field:
+ *
+ *   overrun          - an audio cycle took longer than the block period (AudioStream::cpu_cycles_total
+ *                      against the block length and sample rate), so the next block started late
+ *   dropped block    - one of the monitored outputs (typically what feeds the I2S output) delivered
+ *                      no block in a cycle, so that channel played silence
+ *   pool exhausted   - the block pool was seen full, so an allocate_f32() may have come back empty
+ *                      (the library does not count those): either the pool was still full at the
+ *                      end of the cycle, or AudioMemoryUsageMax_F32() rose to the pool size during
+ *                      it. The library's maximum is only read, never reset, so what it reports
+ *                      stays intact; while it sits at the pool size, only cycles that end with the
+ *                      pool full are counted.
+ *
+ * Besides the counts, the last AUDIO_HEALTH_MAX_EVENTS events are kept with their millis()
+ * timestamps in a ring buffer, and the monitor keeps its own high-water mark of the pool usage,
+ * from the same two readings, which reset() clears without touching the library's.
+ *
+ * The monitor is a node itself: construct it after the nodes it watches so that it runs at the end
+ * of each audio cycle, and connect each monitored output to one of its inputs. overrun is checked
+ * on the previous cycle, as the current one is still running. Read it from loop() with
+ * getSnapshot(), which copies it with the audio interrupt held off.
+ *
+ */
+
+#include <Tympan_Library.h>
+
+#define AUDIO_HEALTH_MAX_INPUTS 2
+#define AUDIO_HEALTH_MAX_EVENTS 16
+#define AUDIO_HEALTH_CYCLES_PER_COUNT 64   // what one count of AudioStream::cpu_cycles_total stands for
+
+enum AUDIO_HEALTH_EVENT {
+  HealthOverrun,
+  HealthDroppedBlock,
+  HealthPoolExhausted
+};
+
+typedef struct {
+  unsigned long time_millis;
+  AUDIO_HEALTH_EVENT event;
+  int input;                 // which input dropped its block (dropped blocks only)
+} AUDIO_HEALTH_ENTRY;
+
+typedef struct {
+  unsigned long cycles;                // audio cycles monitored since the last reset
+  unsigned long overruns;
+  unsigned long droppedBlocks;
+  unsigned long poolExhausted;         // cycles in which the pool was seen full
+  int poolUsageMax;                    // most blocks in use at once
+  int eventCount;                      // entries in events[], oldest first
+  AUDIO_HEALTH_ENTRY events[AUDIO_HEALTH_MAX_EVENTS];
+} AUDIO_HEALTH;
+
+class AudioHealthMonitor_F32 : public AudioStream_F32 {
+  public:
+    AudioHealthMonitor_F32(void) : AudioStream_F32(AUDIO_HEALTH_MAX_INPUTS, inputQueueArray) {}
+
+    // number of inputs that are connected (and so expected to deliver a block every cycle)
+    void setInputs(int inputs) { this->inputs = inputs > AUDIO_HEALTH_MAX_INPUTS ? AUDIO_HEALTH_MAX_INPUTS : inputs; }
+
+    // the size of the block pool (0 to leave its exhaustion unmonitored)
+    void setPoolSize(int blocks) { poolSize = blocks; }
+
+    // control side
+    void reset(void);
+    void getSnapshot(AUDIO_HEALTH *health);
+
+    void update(void);
+
+  private:
+    audio_block_f32_t *inputQueueArray[AUDIO_HEALTH_MAX_INPUTS];
+    int inputs = 1;
+    int poolSize = 0;
+    float budget = 0.0f;
+    bool flowing = false;   // blocks only count as dropped once audio has started to arrive
+
+    unsigned long cycles = 0;
+    unsigned long overruns = 0;
+    unsigned long droppedBlocks = 0;
+    unsigned long poolExhausted = 0;
+    int poolUsageMax = 0;
+    int lastLibraryMax = 0;   // AudioMemoryUsageMax_F32() as of the last cycle
+    AUDIO_HEALTH_ENTRY events[AUDIO_HEALTH_MAX_EVENTS];
+    int eventHead = 0;   // where the next event goes
+    int eventCount = 0;
+
+    void logEvent(AUDIO_HEALTH_EVENT event, int input);
+};
+
+void AudioHealthMonitor_F32::update(void) {
+  cycles++;
+
+  // before the inputs are released, so that the end of the cycle is seen as it is. The library's
+  // maximum only rises during a cycle; if it did, that peak was in this one.
+  int used = AudioMemoryUsage_F32();
+  int libraryMax = AudioMemoryUsageMax_F32();
+  bool rose = libraryMax > lastLibraryMax;
+  lastLibraryMax = libraryMax;
+  int peak = (rose && libraryMax > used) ? libraryMax : used;
+  if (peak > poolUsageMax) poolUsageMax = peak;
+  if (poolSize > 0 && peak >= poolSize) {
+    poolExhausted++;
+    logEvent(HealthPoolExhausted, 0);
+  }
+
+  for (int ii = 0; ii < inputs; ii++) {
+    audio_block_f32_t *block = AudioStream_F32::receiveReadOnly_f32(ii);
+    if (block) {
+      flowing = true;
+      budget = (float)F_CPU * block->length / block->fs_Hz;
+      AudioStream_F32::release(block);
+    } else if (flowing) {
+      droppedBlocks++;
+      logEvent(HealthDroppedBlock, ii);
+    }
+  }
+
+  if (budget > 0.0f && (float)AudioStream::cpu_cycles_total * AUDIO_HEALTH_CYCLES_PER_COUNT > budget) {
+    overruns++;
+    logEvent(HealthOverrun, 0);
+  }
+}
+
+inline void AudioHealthMonitor_F32::logEvent(AUDIO_HEALTH_EVENT event, int input) {
+  events[eventHead].time_millis = millis();
+  events[eventHead].event = event;
+  events[eventHead].input = input;
+  eventHead = (eventHead + 1) % AUDIO_HEALTH_MAX_EVENTS;
+  if (eventCount < AUDIO_HEALTH_MAX_EVENTS) eventCount++;
+}
+
+void AudioHealthMonitor_F32::reset(void) {
+  AudioNoInterrupts();
+  cycles = 0;
+  overruns = 0;
+  droppedBlocks = 0;
+  poolExhausted = 0;
+  poolUsageMax = 0;
+  eventHead = 0;
+  eventCount = 0;
+  AudioInterrupts();
+}
+
+void AudioHealthMonitor_F32::getSnapshot(AUDIO_HEALTH *health) {
+  AudioNoInterrupts();
+  health->cycles = cycles;
+  health->overruns = overruns;
+  health->droppedBlocks = droppedBlocks;
+  health->poolExhausted = poolExhausted;
+  health->poolUsageMax = poolUsageMax;
+  health->eventCount = eventCount;
+  int oldest = (eventHead - eventCount + AUDIO_HEALTH_MAX_EVENTS) % AUDIO_HEALTH_MAX_EVENTS;
+  for (int ii = 0; ii < eventCount; ii++) {
+    health->events[ii] = events[(oldest + ii) % AUDIO_HEALTH_MAX_EVENTS];
+  }
+  AudioInterrupts();
+}
+
+#endif
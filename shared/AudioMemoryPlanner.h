@@ -0,0 +1,99 @@
+#ifndef _AudioMemoryPlanner_h
+#define _AudioMemoryPlanner_h
+
+/*
+ *
+ * Sizes the F32 audio block pool from the audio graph instead of a hand-picked AudioMemory_F32(n).
+ *
+ * Connections made with AudioConnectionPlanned_F32 (a drop-in for AudioConnection_F32) are
+ * registered with the planner. Within one audio cycle every connected output holds at most one
+ * live block at a time: a node allocates its output block, transmits it to all of the output's
+ * connections (which share it by reference count) and releases it, and each destination releases
+ * it once it has used it. So the peak number of live blocks is the number of distinct connected
+ * outputs, plus whatever nodes hold on to internally across cycles (e.g. the I2S DMA buffers),
+ * which the sketch declares with reserve(). allocate() then builds a pool of exactly that many
+ * blocks plus a margin (for receiveWritable_f32() copies and the like).
+ *
+ * Make all of the connections (including any created with new) before calling allocate().
+ *
+ */
+
+#include <Tympan_Library.h>
+
+#define AUDIO_MEMORY_PLANNER_MAX_OUTPUTS 128
+
+// blocks held inside the I2S objects: the input fills one block per channel while the previous
+// ones are being processed, and the output queues two blocks per channel
+#define AUDIO_MEMORY_I2S_INPUT_BLOCKS  2
+#define AUDIO_MEMORY_I2S_OUTPUT_BLOCKS 4
+
+class AudioMemoryPlanner {
+  public:
+    static AudioMemoryPlanner &instance(void) {
+      static AudioMemoryPlanner planner;
+      return planner;
+    }
+
+    void addConnection(AudioStream_F32 *source, int sourceOutput) {
+      connections++;
+      for (int ii = 0; ii < outputs && ii < AUDIO_MEMORY_PLANNER_MAX_OUTPUTS; ii++) {
+        if (outputList[ii].source == source && outputList[ii].index == sourceOutput) return;
+      }
+      // past the end of the list outputs can no longer be told apart, so count every connection
+      if (outputs < AUDIO_MEMORY_PLANNER_MAX_OUTPUTS) {
+        outputList[outputs].source = source;
+        outputList[outputs].index = sourceOutput;
+      }
+      outputs++;
+    }
+
+    // blocks that some node holds on to beyond the cycle in which they are transmitted
+    void reserve(int blocks) { reserved += blocks; }
+
+    int getConnections(void) { return connections; }
+    int getPlannedBlocks(void) { return outputs + reserved; }
+    int getMargin(void) { return margin; }
+    int getAllocatedBlocks(void) { return allocated; }
+
+    // Allocates the pool (planned blocks plus margin) and hands it to the audio library. Returns
+    // the number of blocks allocated, 0 if the allocation failed.
+    int allocate(int margin, const AudioSettings_F32 &settings) {
+      if (allocated) return allocated;
+      this->margin = margin;
+      int blocks = getPlannedBlocks() + margin;
+      audio_block_f32_t *pool = new audio_block_f32_t[blocks];
+      if (!pool) return 0;
+      AudioStream_F32::initialize_f32_memory(pool, blocks, settings);
+      allocated = blocks;
+      return allocated;
+    }
+
+  private:
+    struct Output {
+      AudioStream_F32 *source;
+      int index;
+    };
+
+    Output outputList[AUDIO_MEMORY_PLANNER_MAX_OUTPUTS];
+    int outputs = 0;
+    int connections = 0;
+    int reserved = 0;
+    int margin = 0;
+    int allocated = 0;
+};
+
+class AudioConnectionPlanned_F32 : public AudioConnection_F32 {
+  public:
+    AudioConnectionPlanned_F32(AudioStream_F32 &source, AudioStream_F32 &destination)
+        : AudioConnection_F32(source, destination) {
+      AudioMemoryPlanner::instance().addConnection(&source, 0);
+    }
+
+    AudioConnectionPlanned_F32(AudioStream_F32 &source, unsigned char sourceOutput,
+        AudioStream_F32 &destination, unsigned char destinationInput)
+        : AudioConnection_F32(source, sourceOutput, destination, destinationInput) {
+      AudioMemoryPlanner::instance().addConnection(&source, sourceOutput);
+    }
+};
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef _AudioProfiler_F32_h
+#define _AudioProfiler_F32_h
+
+/*
+ *
+ * Per-node CPU profile of the audio graph.
+ *
+ * The audio library already times every node's update() (AudioStream::cpu_cycles, in units of 64
+ * CPU cycles) and the whole audio cycle (AudioStream::cpu_cycles_total), but only keeps the last
+ * value and the all-time maximum. The profiler is itself a node: constructed after every node it
+ * watches, it runs last in each audio cycle and folds that cycle's numbers into min/mean/max per
+ * registered node, plus a histogram of the total time per cycle as a fraction of the block period
+ * (the deadline). The total is the previous cycle's, as the current one is still running.
+ *
+ * What the total spends outside the registered nodes' updates is the fixed cost of running a
+ * cycle at all: the library's scheduling and whatever unregistered bookkeeping nodes (the profiler
+ * itself, a health monitor) do. It is paid once per block whatever the block size, so as a share
+ * of the CPU it grows as the blocks get smaller; register every processing node, or their time
+ * counts towards it too.
+ *
+ * It only runs while connected, so give it an input from any node (the block is just released).
+ * The statistics cover everything since the last reset(); read them from loop() with
+ * getSnapshot(), which copies them with the audio interrupt held off so they are consistent.
+ *
+ */
+
+#include <Tympan_Library.h>
+
+#define AUDIO_PROFILER_MAX_NODES       24   // room for the multi-band sketch's 16 bands and the nodes around them
+#define AUDIO_PROFILER_HISTOGRAM_BINS  11   // 10% steps of the block period, the last one is >= 100%
+#define AUDIO_PROFILER_CYCLES_PER_COUNT 64  // what one count of AudioStream::cpu_cycles stands for
+
+typedef struct {
+  const char *name;
+  uint32_t min_cycles;
+  uint32_t max_cycles;
+  float mean_cycles;
+} AUDIO_PROFILE_NODE;
+
+typedef struct {
+  unsigned long blocks;           // audio cycles profiled since the last reset
+  float budget_cycles;            // CPU cycles in one block period
+  float mean_overhead_cycles;     // per cycle, outside the registered nodes (see above)
+  uint32_t max_overhead_cycles;
+  int nodeCount;
+  AUDIO_PROFILE_NODE nodes[AUDIO_PROFILER_MAX_NODES];
+  unsigned long histogram[AUDIO_PROFILER_HISTOGRAM_BINS];
+} AUDIO_PROFILE;
+
+class AudioProfiler_F32 : public AudioStream_F32 {
+  public:
+    AudioProfiler_F32(void) : AudioStream_F32(1, inputQueueArray) {}
+
+    // name must outlive the profiler (e.g. a string literal). Returns false when the list is full.
+    bool addNode(AudioStream_F32 *node, const char *name) {
+      if (nodeCount >= AUDIO_PROFILER_MAX_NODES) return false;
+      nodes[nodeCount].node = node;
+      nodes[nodeCount].name = name;
+      nodeCount++;
+      reset();
+      return true;
+    }
+
+    // control side
+    void reset(void);
+    void getSnapshot(AUDIO_PROFILE *profile);
+
+    void update(void);
+
+  private:
+    struct NodeStats {
+      AudioStream_F32 *node;
+      const char *name;
+      uint32_t min;
+      uint32_t max;
+      uint64_t sum;
+    };
+
+    audio_block_f32_t *inputQueueArray[1];
+    NodeStats nodes[AUDIO_PROFILER_MAX_NODES];
+    int nodeCount = 0;
+    unsigned long blocks = 0;
+    float budget = 0.0f;
+    uint32_t lastNodeCycles = 0;      // the previous cycle's registered nodes, to go with its total
+    bool haveLastNodes = false;
+    unsigned long overheadBlocks = 0;
+    uint64_t overheadSum = 0;
+    uint32_t overheadMax = 0;
+    unsigned long histogram[AUDIO_PROFILER_HISTOGRAM_BINS] = {};
+};
+
+void AudioProfiler_F32::update(void) {
+  audio_block_f32_t *block = AudioStream_F32::receiveReadOnly_f32();
+  if (block) {
+    budget = (float)F_CPU * block->length / block->fs_Hz;
+    AudioStream_F32::release(block);
+  }
+
+  uint32_t nodeCycles = 0;
+  for (int ii = 0; ii < nodeCount; ii++) {
+    uint32_t cycles = (uint32_t)nodes[ii].node->cpu_cycles * AUDIO_PROFILER_CYCLES_PER_COUNT;
+    if (cycles < nodes[ii].min) nodes[ii].min = cycles;
+    if (cycles > nodes[ii].max) nodes[ii].max = cycles;
+    nodes[ii].sum += cycles;
+    nodeCycles += cycles;
+  }
+  blocks++;
+
+  // the total is the previous cycle's, so it goes with the previous cycle's nodes
+  if (haveLastNodes) {
+    uint32_t total = (uint32_t)AudioStream::cpu_cycles_total * AUDIO_PROFILER_CYCLES_PER_COUNT;
+    uint32_t overhead = total > lastNodeCycles ? total - lastNodeCycles : 0;
+    if (overhead > overheadMax) overheadMax = overhead;
+    overheadSum += overhead;
+    overheadBlocks++;
+  }
+  lastNodeCycles = nodeCycles;
+  haveLastNodes = true;
+
+  if (budget > 0.0f) {
+    float load = (float)AudioStream::cpu_cycles_total * AUDIO_PROFILER_CYCLES_PER_COUNT / budget;
+    int bin = (int)(load * (AUDIO_PROFILER_HISTOGRAM_BINS - 1));
+    histogram[bin < AUDIO_PROFILER_HISTOGRAM_BINS - 1 ? bin : AUDIO_PROFILER_HISTOGRAM_BINS - 1]++;
+  }
+}
+
+void AudioProfiler_F32::reset(void) {
+  AudioNoInterrupts();
+  for (int ii = 0; ii < nodeCount; ii++) {
+    nodes[ii].min = UINT32_MAX;
+    nodes[ii].max = 0;
+    nodes[ii].sum = 0;
+  }
+  blocks = 0;
+  haveLastNodes = false;
+  overheadBlocks = 0;
+  overheadSum = 0;
+  overheadMax = 0;
+  memset(histogram, 0, sizeof(histogram));
+  AudioInterrupts();
+}
+
+void AudioProfiler_F32::getSnapshot(AUDIO_PROFILE *profile) {
+  AudioNoInterrupts();
+  profile->blocks = blocks;
+  profile->budget_cycles = budget;
+  profile->mean_overhead_cycles = overheadBlocks ? (float)overheadSum / overheadBlocks : 0.0f;
+  profile->max_overhead_cycles = overheadMax;
+  profile->nodeCount = nodeCount;
+  for (int ii = 0; ii < nodeCount; ii++) {
+    profile->nodes[ii].name = nodes[ii].name;
+    profile->nodes[ii].min_cycles = blocks ? nodes[ii].min : 0;
+    profile->nodes[ii].max_cycles = nodes[ii].max;
+    profile->nodes[ii].mean_cycles = blocks ? (float)nodes[ii].sum / blocks : 0.0f;
+  }
+  memcpy(profile->histogram, histogram, sizeof(histogram));
+  AudioInterrupts();
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef _DoubleBuffer_h
+#define _DoubleBuffer_h
+
+/*
+ *
+ * Hands a block of parameters from the control side (loop()) to the audio side (the audio update
+ * interrupt) without locks and without the audio side ever seeing a half-written copy.
+ *
+ * The control side always writes into the slot that is not currently published and only then
+ * publishes it; the audio side picks up the published slot at the start of its next block. The
+ * audio interrupt can preempt loop() but never the other way around, so the published slot is
+ * never being written while the audio side reads it.
+ *
+ */
+
+#include <stdint.h>
+
+template <typename T>
+class DoubleBuffer {
+  public:
+    // control side: copy value in and make it the next thing the audio side sees
+    void publish(const T &value) {
+      uint8_t next = published ^ 1;
+      slots[next] = value;
+      __asm__ volatile ("" ::: "memory"); // the copy must be complete before it is published
+      published = next;
+      pending = true;
+    }
+
+    // audio side: the most recently published value, or NULL if nothing new since the last call
+    const T *acquire(void) {
+      if (!pending) return NULL;
+      pending = false;
+      return &slots[published];
+    }
+
+  private:
+    T slots[2];
+    volatile uint8_t published = 0;
+    volatile bool pending = false;
+};
+
+#endif
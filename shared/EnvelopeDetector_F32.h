@@ -0,0 +1,104 @@
+#ifndef _EnvelopeDetector_F32_h
+#define _EnvelopeDetector_F32_h
+
+/*
+ *
+ * Level detector that sits in front of the WDRC attack/release follower and decides what it
+ * follows:
+ *
+ *   peak   - the rectified signal, |x| (what the BTNRH compressor does on its own)
+ *   RMS    - the RMS over a sliding window, scaled by sqrt(2) so that a steady sine reads the
+ *            same as in peak mode
+ *   hybrid - the average of the two
+ *
+ * Peak reacts to every transient; RMS tracks loudness and lets short peaks through (which is
+ * what the limiter is for); hybrid sits in between.
+ *
+ * detect() processes a whole block per call. The RMS is a running sum of squares over a ring
+ * buffer, so it costs the same whatever the window; the sum is recomputed from the ring every time
+ * the ring wraps so that float rounding can't accumulate.
+ *
+ * This header has no dependency on Tympan_Library so that it can also be built on a host.
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__arm__)
+  #include <arm_math.h>
+#endif
+
+#define ENVELOPE_DETECTOR_MAX_WINDOW 512   // longest RMS window, in samples (about 10 ms at 48 kHz)
+#define ENVELOPE_DETECTOR_CHUNK      128   // samples per pass through detectChunk()
+
+enum DETECTOR_MODE {
+  DetectorPeak,
+  DetectorRMS,
+  DetectorHybrid
+};
+
+class EnvelopeDetector_F32 {
+  public:
+    // window_msec only matters for the RMS and hybrid modes
+    void configure(DETECTOR_MODE mode, float window_msec, float fs_Hz) {
+      int window = (int)(window_msec * 0.001f * fs_Hz + 0.5f);
+      if (window < 1) window = 1;
+      if (window > ENVELOPE_DETECTOR_MAX_WINDOW) window = ENVELOPE_DETECTOR_MAX_WINDOW;
+      if (window != this->window) {
+        this->window = window;
+        memset(ring, 0, sizeof(ring));
+        ringPos = 0;
+        sum = 0.0f;
+      }
+      this->mode = mode;
+      scale = 2.0f / window;
+    }
+
+    DETECTOR_MODE getMode(void) { return mode; }
+
+    // x is the signal, y the level to follow (may be the same array). Not for peak mode, where the
+    // follower rectifies the signal by itself.
+    void detect(const float *x, float *y, int n) {
+      for (int start = 0; start < n; start += ENVELOPE_DETECTOR_CHUNK) {
+        int count = (n - start < ENVELOPE_DETECTOR_CHUNK) ? n - start : ENVELOPE_DETECTOR_CHUNK;
+        detectChunk(x + start, y + start, count);
+      }
+    }
+
+  private:
+    DETECTOR_MODE mode = DetectorPeak;
+    int window = 0;
+    float scale = 1.0f;
+    float ring[ENVELOPE_DETECTOR_MAX_WINDOW];
+    int ringPos = 0;
+    float sum = 0.0f;
+
+    void detectChunk(const float *x, float *y, int n) {
+      float sq[ENVELOPE_DETECTOR_CHUNK];
+      #if defined(__arm__)
+        arm_mult_f32((float *)x, (float *)x, sq, n);
+      #else
+        for (int ii = 0; ii < n; ii++) sq[ii] = x[ii] * x[ii];
+      #endif
+      float s = sum;
+      for (int ii = 0; ii < n; ii++) {
+        s += sq[ii] - ring[ringPos];
+        ring[ringPos] = sq[ii];
+        if (++ringPos >= window) {
+          ringPos = 0;
+          s = 0.0f;
+          for (int jj = 0; jj < window; jj++) s += ring[jj];
+        }
+        sq[ii] = (s > 0.0f) ? s * scale : 0.0f;
+      }
+      sum = s;
+      if (mode == DetectorHybrid) {
+        for (int ii = 0; ii < n; ii++) y[ii] = 0.5f * (fabsf(x[ii]) + sqrtf(sq[ii]));
+      } else {
+        for (int ii = 0; ii < n; ii++) y[ii] = sqrtf(sq[ii]);
+      }
+    }
+};
+
+#endif
@@ -27,6 +27,7 @@
  * basic_command        ::= ? any ASCII (7-bit) character except semicolon ?
  * basic_mode           ::= "\;"
  * extended_mode        ::= "/"
+ * binary_mode          ::= "~"
  * help_command         ::= "?" , end_of_message
  * get_layout_command   ::= "#" , end_of_message
  * run_command          ::= "!" , basic_command , end_of_message
@@ -40,12 +41,20 @@
  *                        , ? integer between 0 and 99 inclusive ? , end_of_message
  * apply_command        ::= "=" , (channel_identifier | knob_identifier) , "="
  *                        , ? float value ? , {"," , ? float value ?} , end_of_message
+ * begin_batch_command  ::= "[" , end_of_message
+ * commit_batch_command ::= "]" , end_of_message
+ * abort_batch_command  ::= "]" , "0" , end_of_message
+ * load_command         ::= "%" , channel_identifier , "="
+ *                        , ? float value ? , {"," , ? float value ?} , end_of_message
+ * report_command       ::= "@" , [report_identifier , ["0"]] , end_of_message
+ * report_identifier    ::= ? any ASCII (7-bit) character except semicolon and "0" ?
  * 
  * Several commands are reserved by the protocol:
  *  J - execute get_layout command
  *  h - execute help command
  *  \ - switch to basic mode
  *  / - switch to extended mode
+ *  ~ - switch to binary mode
  * 
  * Whitespace is probably not a good choice for commands, even if it is technically permissible.
  * 
@@ -56,9 +65,66 @@
  * ACK=0 response (for failure).
  * 
  * Responses are newline delimited rather than semicolon delimited.
+ *
+ * Every command that changes a knob normally applies the new configuration straight away. Between
+ * a begin_batch_command and a commit_batch_command the changes are still made (and reported) as
+ * usual, but the configuration is applied only once, on commit. A batch that is aborted instead
+ * (abort_batch_command), interrupted by a mode switch or left without a byte received for
+ * TYMPAN_ESM_BATCH_TIMEOUT_MILLIS (checked in service()) is rolled back: its knobs go back to
+ * their values at begin_batch_command and nothing is applied.
+ *
+ * The load command hands a channel a raw list of values that don't map onto knobs (e.g. filter
+ * coefficients). It is passed as-is to the load callback (see setLoad()); without one, or if the
+ * callback rejects the values, the response is ACK=0.
+ *
+ * The report command prints one of the sketch's diagnostic reports (see setReports()), or all of
+ * them if no report is named; a trailing "0" resets the named report instead of printing it.
  * 
  */
 
+/*
+ *
+ * BINARY MODE
+ *
+ * For clients that care more about latency than readability (e.g. over Bluetooth serial), the
+ * manager also speaks a framed binary protocol. It is entered with "~" (basic mode) or "~;"
+ * (extended mode), which is acknowledged with the usual ACK=1 line; everything after that is
+ * framed until the client sends an exit frame.
+ *
+ * Every frame, in either direction, looks like this:
+ *
+ *   0xA5 | length | payload (length bytes) | crc low | crc high
+ *
+ * where the CRC is CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF) over the length byte
+ * and the payload. The first payload byte is an opcode; channels and knobs are zero-based
+ * indices and values are raw little-endian float32.
+ *
+ *   get      0x01 channel knob           -> value
+ *   set      0x02 channel knob float32   -> value (after clamping)
+ *   get all  0x03 channel                -> values
+ *   exit     0x04                        -> ack, then back to basic mode
+ *   begin    0x05                        -> ack (start of a batch, as with "[;")
+ *   commit   0x06                        -> ack (end of a batch, as with "];")
+ *   abort    0x07                        -> ack (the batch is rolled back, as with "]0;")
+ *
+ *   value    0x81 channel knob float32
+ *   values   0x82 channel count float32 * count
+ *   ack      0x83 status (1 for success, 0 for failure, e.g. a bad CRC or index)
+ *
+ * A set with a value that is not a finite number is refused (ack 0). So is a frame whose payload
+ * is longer than TYMPAN_ESM_BINARY_MAX_PAYLOAD, whose CRC is wrong, or that stalls for more than
+ * TYMPAN_ESM_BINARY_TIMEOUT_MILLIS between two bytes (checked in service(), so loop() has to call
+ * it). The bytes after the refused frame's sync byte are then searched again for the next sync
+ * byte, so that a corrupted length byte costs only the frames it overlapped and not everything
+ * up to the next lucky resync.
+ *
+ * Binary mode needs a quiet link: whatever else is printed to the port in between frames reaches
+ * the client as line noise. myTympan prints to both serial ports, so while a manager is in binary
+ * mode (see isBinary()) the sketch holds off its own messages (CPU and memory, potentiometer) and
+ * the commands arriving on the other port, whose responses would go out on this one as well.
+ *
+ */
+
 /*
  *
  * API
@@ -70,7 +136,13 @@
 
 #define PRINT_MESSAGES_FOR_HUMANS    true
 
+#define TYMPAN_ESM_LAYOUT_CHUNK_SIZE  64
+#define TYMPAN_ESM_LAYOUT_VALUE_WIDTH 12
+#define TYMPAN_ESM_BATCH_TIMEOUT_MILLIS 5000
+#define TYMPAN_ESM_MAX_FLOATS         64
+
 #define TYMPAN_ESM_BASIC_MODE_COMMAND '\\'
+#define TYMPAN_ESM_BINARY_MODE_COMMAND '~'
 #define TYMPAN_ESM_HELP_COMMAND       '?'
 #define TYMPAN_ESM_GET_LAYOUT_COMMAND '#'
 #define TYMPAN_ESM_RUN_COMMAND        '!'
@@ -80,10 +152,38 @@
 #define TYMPAN_ESM_DECREMENT_COMMAND  '-'
 #define TYMPAN_ESM_SET_COMMAND        '*'
 #define TYMPAN_ESM_APPLY_COMMAND      '='
+#define TYMPAN_ESM_BEGIN_BATCH_COMMAND '['
+#define TYMPAN_ESM_COMMIT_BATCH_COMMAND ']'
+#define TYMPAN_ESM_LOAD_COMMAND       '%'
+#define TYMPAN_ESM_REPORT_COMMAND     '@'
 #define TYMPAN_ESM_END_OF_MESSAGE     ';'
 
+#define TYMPAN_ESM_BINARY_SYNC        0xA5
+#define TYMPAN_ESM_BINARY_GET         0x01
+#define TYMPAN_ESM_BINARY_SET         0x02
+#define TYMPAN_ESM_BINARY_GET_ALL     0x03
+#define TYMPAN_ESM_BINARY_EXIT        0x04
+#define TYMPAN_ESM_BINARY_BEGIN_BATCH 0x05
+#define TYMPAN_ESM_BINARY_COMMIT_BATCH 0x06
+#define TYMPAN_ESM_BINARY_ABORT_BATCH 0x07
+#define TYMPAN_ESM_BINARY_MAX_PAYLOAD 16    // longer than any frame a client sends
+#define TYMPAN_ESM_BINARY_TIMEOUT_MILLIS 100
+#define TYMPAN_ESM_BINARY_VALUE       0x81
+#define TYMPAN_ESM_BINARY_VALUES      0x82
+#define TYMPAN_ESM_BINARY_ACK         0x83
+
 #include <ctype.h>
-#include <Tympan_Library.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// On the Tympan we talk through the real library; anywhere else (e.g. a native
+// PlatformIO build) a minimal stand-in provides the few bits of myTympan we use.
+#if defined(ARDUINO)
+  #include <Tympan_Library.h>
+#else
+  #include "HostTympan.h"
+#endif
 
 extern Tympan myTympan;
 extern bool enable_printCPUandMemory;
@@ -91,7 +191,22 @@ extern bool enable_printCPUandMemory;
 
 enum MODE {
   Basic,
-  Extended
+  Extended,
+  Binary
+};
+
+enum BINARY_STATE {
+  BinarySync,
+  BinaryLength,
+  BinaryPayload,
+  BinaryCrcLow,
+  BinaryCrcHigh
+};
+
+enum LAYOUT_TARGET {
+  LayoutMeasure,  // only count the characters the layout needs
+  LayoutCache,    // write the layout into the cache
+  LayoutStream    // write the layout straight to the serial port (if the cache could not be allocated)
 };
 
 typedef struct {
@@ -110,6 +225,13 @@ typedef struct {
                             //   The callback will be passed the character which triggered the command
 } COMMAND;
 
+typedef struct {
+  const char character;     // 7-bit ASCII character which selects the report (e.g. 'p')
+  const char *name;         // name of the report for help purposes (e.g. "CPU profile")
+  void (*print)(void);      // function which prints the report
+  void (*reset)(void);      // function which starts the report over (NULL if it can't be reset)
+} REPORT;
+
 typedef struct {
   int channel;
   int knob;
@@ -134,6 +256,29 @@ class ExtendedSerialManager {
     void processByte(char c);
     void processExtendedCommand(char *cmd);
 
+    // By default every change is applied as soon as it is parsed. With a non-zero interval,
+    // changes only mark the configuration dirty and service() (called from loop()) applies it
+    // at most once per interval.
+    void setApplyInterval(unsigned long interval_millis);
+    void service(unsigned long curTime_millis);
+    unsigned long getAppliesExecuted(void) { return appliesExecuted; }
+    unsigned long getAppliesCoalesced(void) { return appliesCoalesced; }
+
+    // The protocol mode the client has put the port in (see setMode()). While it is binary the
+    // sketch must keep its own messages off the port.
+    MODE getMode(void) { return mode; }
+    bool isBinary(void) { return mode == Binary; }
+
+    // Optional: receives the values of a load command for a channel and returns true if it
+    // accepted them.
+    void setLoad(bool (*load)(int channel, const float *values, int count)) { this->load = load; }
+
+    // Optional: diagnostic reports for the report command.
+    void setReports(REPORT reports[], int reportCount) {
+      this->reports = reports;
+      this->reportCount = reportCount;
+    }
+
   protected:
     void handleHelpCommand(void);
     void handleGetLayoutCommand(void);
@@ -144,16 +289,29 @@ class ExtendedSerialManager {
     void handleDecrementCommand(const char *options);
     void handleSetCommand(const char *options);
     void handleApplyCommand(const char *options);
+    void handleLoadCommand(const char *options);
+    void handleReportCommand(const char *options);
+    void handleBinaryFrame(const uint8_t *payload, int length);
       
   private:
     MODE mode = Basic;
+    void setMode(MODE mode);
 
     // input buffer
     char buffer[256];
     char *bufferPtr = buffer;
+    bool byteReceived = false;  // since the last service()
+    unsigned long lastByte_millis = 0;
 
     // float buffer
-    float floatBuffer[64];
+    float floatBuffer[TYMPAN_ESM_MAX_FLOATS];
+
+    // binary frame parser, collecting everything after the sync byte (length, payload, CRC)
+    BINARY_STATE binaryState = BinarySync;
+    uint8_t binaryFrame[TYMPAN_ESM_BINARY_MAX_PAYLOAD + 3];
+    int binaryFrameLength = 0;
+    int binaryLength;
+    uint16_t binaryCrc;
 
     // knob configuration
     CONFIGURABLE *knobs;
@@ -169,11 +327,36 @@ class ExtendedSerialManager {
     void (*apply)(void);
     void (*activate)(int channel, int knob);
 
+    // optional helper methods
+    bool (*load)(int channel, const float *values, int count) = NULL;
+
+    // report configuration
+    REPORT *reports = NULL;
+    int reportCount = 0;
+
+    // batching
+    bool batchOpen = false;
+    bool batchApplyPending = false;
+    float *batchSnapshot = NULL;  // every knob's value when the batch was opened
+    bool beginBatch(void);
+    bool commitBatch(void);
+    bool abortBatch(void);
+
+    // deferred apply
+    unsigned long applyInterval = 0;
+    unsigned long lastApply_millis = 0;
+    bool applyDirty = false;
+    unsigned long appliesExecuted = 0;
+    unsigned long appliesCoalesced = 0;
+    void requestApply(void);
+    void executeApply(void);
+
     // active configuration
     int activeChannel;
     int activeKnob;
 
     CMD_OPTIONS parseOptions(const char *options);
+    int parseFloats(const char *ptr);
     CONFIGURABLE *getKnob(int channel, int knob);
     CONFIGURABLE *getKnob(CMD_OPTIONS opts);
     char getKnobIdentifier(int knob);
@@ -181,6 +364,32 @@ class ExtendedSerialManager {
     void printValue(CONFIGURABLE *knob);
     void ackIfExtended();
     void ackIfExtended(bool success);
+    void processBinaryBytes(const uint8_t *bytes, int count);
+    void abandonBinaryFrame(void);
+    void sendBinaryFrame(const uint8_t *payload, int length);
+    void sendBinaryValue(int channel, int knob);
+    void sendBinaryAck(bool success);
+    uint16_t crc16(uint16_t crc, uint8_t b);
+
+    // layout cache, built once with a fixed-width slot for every knob value
+    LAYOUT_TARGET layoutTarget = LayoutMeasure;
+    char *layoutCache = NULL;
+    int layoutLength = 0;
+    int *layoutValueOffsets = NULL;
+    float *layoutValues = NULL;
+    void buildLayoutCache(void);
+    void refreshLayoutValues(void);
+    void writeLayout(void);
+    void writeLayoutValue(int index, float value);
+
+    // layout output, written to the cache or to the serial sink in fixed-size chunks
+    char layoutChunk[TYMPAN_ESM_LAYOUT_CHUNK_SIZE];
+    int layoutChunkLength = 0;
+    void emitLayout(const char *str);
+    void emitLayout(char c);
+    void emitLayout(int n);
+    void emitLayout(float f);
+    void flushLayout(void);
 };
 
 ExtendedSerialManager::ExtendedSerialManager(
@@ -207,11 +416,16 @@ ExtendedSerialManager::ExtendedSerialManager(
   for (int ii = 0; ii < commandCount; ii++) {
     commandLut[commands[ii].character & 0x7f] = commands[ii].execute;
   }
+  buildLayoutCache();
+  batchSnapshot = (float *)malloc(channelCount * knobCount * sizeof(float));
 };
 
 void ExtendedSerialManager::processByte(char c) {
+  byteReceived = true;
   if (mode == Basic) {
     handleRunCommand(&c);
+  } else if (mode == Binary) {
+    processBinaryBytes((const uint8_t *)&c, 1);
   } else {
     if (c == TYMPAN_ESM_END_OF_MESSAGE) {
       *bufferPtr = '\0';
@@ -225,7 +439,8 @@ void ExtendedSerialManager::processByte(char c) {
 
 void ExtendedSerialManager::processExtendedCommand(char *cmd) {
   switch (cmd[0]) {
-    case TYMPAN_ESM_BASIC_MODE_COMMAND: mode = Basic; break;
+    case TYMPAN_ESM_BASIC_MODE_COMMAND: setMode(Basic); break;
+    case TYMPAN_ESM_BINARY_MODE_COMMAND: handleRunCommand(cmd); break;
     case TYMPAN_ESM_HELP_COMMAND: handleHelpCommand(); break;
     case TYMPAN_ESM_GET_LAYOUT_COMMAND: handleGetLayoutCommand(); break;
     case TYMPAN_ESM_RUN_COMMAND: handleRunCommand(&cmd[1]); break;
@@ -235,6 +450,10 @@ void ExtendedSerialManager::processExtendedCommand(char *cmd) {
     case TYMPAN_ESM_DECREMENT_COMMAND: handleDecrementCommand(&cmd[1]); break;
     case TYMPAN_ESM_SET_COMMAND: handleSetCommand(&cmd[1]); break;
     case TYMPAN_ESM_APPLY_COMMAND: handleApplyCommand(&cmd[1]); break;
+    case TYMPAN_ESM_BEGIN_BATCH_COMMAND: ackIfExtended(beginBatch()); break;
+    case TYMPAN_ESM_COMMIT_BATCH_COMMAND: ackIfExtended(cmd[1] == '0' ? abortBatch() : commitBatch()); break;
+    case TYMPAN_ESM_LOAD_COMMAND: handleLoadCommand(&cmd[1]); break;
+    case TYMPAN_ESM_REPORT_COMMAND: handleReportCommand(&cmd[1]); break;
     default:
       myTympan.println(cmd);
       #if (PRINT_MESSAGES_FOR_HUMANS)
@@ -248,9 +467,11 @@ void ExtendedSerialManager::processExtendedCommand(char *cmd) {
 void ExtendedSerialManager::handleHelpCommand(void) {
   myTympan.println("Msg: Extended Serial Manager Help.");
   myTympan.printf("Msg: Channels: %i\n", channelCount);
+  myTympan.printf("Msg: Applies: %lu executed, %lu coalesced\n", appliesExecuted, appliesCoalesced);
   myTympan.println("Msg: Commands:");
   myTympan.println("Msg:   \\; - switch to basic (legacy) mode");
   myTympan.println("Msg:   / - switch to extended mode (note the lack of a semicolon)");
+  myTympan.println("Msg:   ~ - switch to binary mode (framed; see ExtendedSerialManager.h)");
   myTympan.println("Msg:   ?; - print this help");
   myTympan.println("Msg:   #; - print layout JSON");
   myTympan.println("Msg:   !<command>; - run the specified 1-character command (equivalent to basic-mode commands)");
@@ -260,6 +481,11 @@ void ExtendedSerialManager::handleHelpCommand(void) {
   myTympan.println("Msg:   -[channel]<knob>; - decrement current value for specified knob of optionally specified channel");
   myTympan.println("Msg:   *[channel]<knob><value>; - set current value for specified knob of optionally specified channel as percentage of range");
   myTympan.println("Msg:   =<channel|knob>=<comma-separated values>; - set all values for a 'slice' (either all knobs for a channel or a particular knob for all channels)");
+  myTympan.println("Msg:   [; - begin a batch (changes are applied once, on commit)");
+  myTympan.println("Msg:   ]; - commit a batch");
+  myTympan.println("Msg:   ]0; - abort a batch (its knobs go back to where they were at [;)");
+  myTympan.println("Msg:   %<channel>=<comma-separated values>; - load a list of values (e.g. filter coefficients) into a channel");
+  myTympan.println("Msg:   @[report[0]]; - print the specified report (all reports if none is specified), or reset it with a trailing 0");
   myTympan.println("Msg: Knobs:");
   for (int ii = 0; ii < knobCount; ii++) {
     myTympan.printf("Msg:   %c - %s (%f%s-%f%s)\n", getKnobIdentifier(ii), knobs[ii].name, knobs[ii].min, knobs[ii].unit, knobs[ii].max, knobs[ii].unit);
@@ -268,57 +494,33 @@ void ExtendedSerialManager::handleHelpCommand(void) {
   for (int ii = 0; ii < commandCount; ii++) {
     myTympan.printf("Msg:   %c - %s\n", commands[ii].character, commands[ii].name);
   }
+  if (reportCount) {
+    myTympan.println("Msg: Reports:");
+    for (int ii = 0; ii < reportCount; ii++) {
+      myTympan.printf("Msg:   %c - %s%s\n", reports[ii].character, reports[ii].name, reports[ii].reset ? " (resettable)" : "");
+    }
+  }
 }
 
 void ExtendedSerialManager::handleGetLayoutCommand(void) {
-  String jsonConfig = "JSON={"
-    "'pages':["
-      "{'title':'Main','cards':["
-        "{'name':'Commands','buttons':[";
-  for (int ii = 0; ii < commandCount; ii++) {
-    ii && jsonConfig.append(",");
-    jsonConfig.append("{'id':'command-");
-    jsonConfig.append(commands[ii].character);
-    jsonConfig.append("','label':'");
-    jsonConfig.append(commands[ii].name);
-    jsonConfig.append("','cmd':'");
-    jsonConfig.append(commands[ii].character);
-    jsonConfig.append("','width':'12'}");
-  }
-  jsonConfig.append(
-        "]}"
-      "]}");
-  for (int ii = 0; ii < channelCount; ii++) {
-    jsonConfig.append(",");
-    jsonConfig.append("{'title':'Channel ");
-    jsonConfig.append(ii);
-    jsonConfig.append("','knobs':[");
-    for (int jj = 0; jj < knobCount; jj++) {
-      jj && jsonConfig.append(",");
-      jsonConfig.append("{'name':'");
-      jsonConfig.append(knobs[jj].name);
-      jsonConfig.append("','min':");
-      jsonConfig.append(knobs[jj].min);
-      jsonConfig.append(",'max':");
-      jsonConfig.append(knobs[jj].max);
-      jsonConfig.append(",'value':");
-      jsonConfig.append(*knobs[jj].value);
-      jsonConfig.append(",'unit':'");
-      jsonConfig.append(knobs[jj].unit);
-      jsonConfig.append("'}");
-    }
-    jsonConfig.append("]}");
+  if (layoutCache) {
+    refreshLayoutValues();
+    myTympan.println(layoutCache);
+  } else {
+    writeLayout();
+    flushLayout();
+    myTympan.println();
   }
-  jsonConfig.append(
-    "]"
-  "}");
-  myTympan.println(jsonConfig);
 }
 
 void ExtendedSerialManager::handleRunCommand(const char *options) {
   switch (options[0]) {
-    case '/': mode = Extended; myTympan.println("ACK=1"); break;
-    case '\\': mode = Basic; myTympan.println("ACK=1"); break;
+    case '/': setMode(Extended); myTympan.println("ACK=1"); break;
+    case '\\': setMode(Basic); myTympan.println("ACK=1"); break;
+    case '~':
+      myTympan.println("ACK=1");
+      setMode(Binary);
+      break;
     case 'h': handleHelpCommand(); ackIfExtended(); break;
     case 'J': handleGetLayoutCommand(); ackIfExtended(); break;
     default:
@@ -384,7 +586,7 @@ void ExtendedSerialManager::handleIncrementCommand(const char *options) {
   float newVal = oldVal + (knob->max - knob->min) * 0.05f;
   *knob->value = newVal > knob->max ? knob->max : newVal;
   printValue(knob, "Incrementing", oldVal);
-  apply();
+  requestApply();
 }
 
 void ExtendedSerialManager::handleDecrementCommand(const char *options) {
@@ -394,7 +596,7 @@ void ExtendedSerialManager::handleDecrementCommand(const char *options) {
   float newVal = oldVal - (knob->max - knob->min) * 0.05f;
   *knob->value = newVal < knob->min ? knob->min : newVal;
   printValue(knob, "Decrementing", oldVal);
-  apply();
+  requestApply();
 }
 
 void ExtendedSerialManager::handleSetCommand(const char *options) {
@@ -405,7 +607,7 @@ void ExtendedSerialManager::handleSetCommand(const char *options) {
   myTympan.println(opts.value);
   *knob->value = newVal < knob->min ? knob->min : newVal > knob->max ? knob->max : newVal;
   printValue(knob, "Setting", oldVal);
-  apply();
+  requestApply();
 }
 
 void ExtendedSerialManager::handleApplyCommand(const char *options) {
@@ -413,11 +615,10 @@ void ExtendedSerialManager::handleApplyCommand(const char *options) {
   int floatCount = 0;
   char knob = 0;
   char *ptr = (char *)options;
-  char *nextPtr = (char *)options;
   CONFIGURABLE *nextKnob;
   int knobIncrement;
   int count;
-  while (isDigit(*ptr)) {
+  while (isdigit(*ptr)) {
     // This is probably terrible form
     channel = channel * 10 + (*ptr - '0');
     ptr++;
@@ -434,13 +635,7 @@ void ExtendedSerialManager::handleApplyCommand(const char *options) {
     knobIncrement = 1;
     count = knobCount;
   }
-  nextPtr = ptr;
-  while (*nextPtr != '\0') {
-    while (*++nextPtr != ',' && *nextPtr != '\0') {}
-    *nextPtr = 0;
-    floatBuffer[floatCount++] = strtof(ptr, &nextPtr);
-    ptr = ++nextPtr;
-  }
+  floatCount = parseFloats(ptr);
   if (floatCount != count) {
     ackIfExtended(false);
     return;
@@ -453,25 +648,206 @@ void ExtendedSerialManager::handleApplyCommand(const char *options) {
     nextKnob += knobIncrement;
   }
   handleQueryCommand("&");
+  requestApply();
+}
+
+void ExtendedSerialManager::handleLoadCommand(const char *options) {
+  int channel = 0;
+  const char *ptr = options;
+  while (isdigit(*ptr)) {
+    channel = channel * 10 + (*ptr - '0');
+    ptr++;
+  }
+  if (*ptr++ != '=' || channel >= channelCount || !load) {
+    ackIfExtended(false);
+    return;
+  }
+  int floatCount = parseFloats(ptr);
+  ackIfExtended(floatCount > 0 && load(channel, floatBuffer, floatCount));
+}
+
+void ExtendedSerialManager::handleReportCommand(const char *options) {
+  if (options[0] == '\0') {
+    for (int ii = 0; ii < reportCount; ii++) reports[ii].print();
+    ackIfExtended(reportCount > 0);
+    return;
+  }
+  for (int ii = 0; ii < reportCount; ii++) {
+    if (reports[ii].character != options[0]) continue;
+    if (options[1] == '\0') {
+      reports[ii].print();
+      ackIfExtended(true);
+    } else if (options[1] == '0' && options[2] == '\0' && reports[ii].reset) {
+      reports[ii].reset();
+      ackIfExtended(true);
+    } else {
+      ackIfExtended(false);
+    }
+    return;
+  }
+  ackIfExtended(false);
+}
+
+void ExtendedSerialManager::handleBinaryFrame(const uint8_t *payload, int length) {
+  int channel = length > 1 ? payload[1] : -1;
+  int knob = length > 2 ? payload[2] : -1;
+  bool validChannel = channel >= 0 && channel < channelCount;
+  bool validKnob = validChannel && knob >= 0 && knob < knobCount;
+  CONFIGURABLE *target;
+  float value;
+  switch (payload[0]) {
+    case TYMPAN_ESM_BINARY_GET:
+      if (length != 3 || !validKnob) break;
+      sendBinaryValue(channel, knob);
+      return;
+    case TYMPAN_ESM_BINARY_SET:
+      if (length != 7 || !validKnob) break;
+      target = getKnob(channel, knob);
+      memcpy(&value, &payload[3], sizeof(float));
+      if (!isfinite(value)) break;
+      *target->value = value < target->min ? target->min : value > target->max ? target->max : value;
+      sendBinaryValue(channel, knob);
+      requestApply();
+      return;
+    case TYMPAN_ESM_BINARY_GET_ALL:
+      if (length != 2 || !validChannel) break;
+      {
+        uint8_t response[3 + 26 * sizeof(float)]; // knob identifiers stop at Z
+        response[0] = TYMPAN_ESM_BINARY_VALUES;
+        response[1] = channel;
+        response[2] = knobCount;
+        for (int ii = 0; ii < knobCount; ii++) {
+          memcpy(&response[3 + ii * sizeof(float)], getKnob(channel, ii)->value, sizeof(float));
+        }
+        sendBinaryFrame(response, 3 + knobCount * sizeof(float));
+      }
+      return;
+    case TYMPAN_ESM_BINARY_BEGIN_BATCH:
+      if (length != 1) break;
+      sendBinaryAck(beginBatch());
+      return;
+    case TYMPAN_ESM_BINARY_COMMIT_BATCH:
+      if (length != 1) break;
+      sendBinaryAck(commitBatch());
+      return;
+    case TYMPAN_ESM_BINARY_ABORT_BATCH:
+      if (length != 1) break;
+      sendBinaryAck(abortBatch());
+      return;
+    case TYMPAN_ESM_BINARY_EXIT:
+      if (length != 1) break;
+      sendBinaryAck(true);
+      setMode(Basic);
+      return;
+  }
+  sendBinaryAck(false);
+}
+
+bool ExtendedSerialManager::beginBatch(void) {
+  if (batchOpen || !batchSnapshot) return false;
+  for (int ii = 0; ii < channelCount * knobCount; ii++) batchSnapshot[ii] = *knobs[ii].value;
+  batchOpen = true;
+  batchApplyPending = false;
+  return true;
+}
+
+bool ExtendedSerialManager::commitBatch(void) {
+  if (!batchOpen) return false;
+  batchOpen = false;
+  if (batchApplyPending) {
+    batchApplyPending = false;
+    requestApply();
+  }
+  return true;
+}
+
+bool ExtendedSerialManager::abortBatch(void) {
+  if (!batchOpen) return false;
+  for (int ii = 0; ii < channelCount * knobCount; ii++) *knobs[ii].value = batchSnapshot[ii];
+  batchOpen = false;
+  batchApplyPending = false;
+  return true;
+}
+
+void ExtendedSerialManager::setMode(MODE mode) {
+  // A client that switches modes is starting over, so a batch it left open goes: roll it back
+  abortBatch();
+  this->mode = mode;
+  binaryState = BinarySync;
+}
+
+void ExtendedSerialManager::setApplyInterval(unsigned long interval_millis) {
+  applyInterval = interval_millis;
+}
+
+void ExtendedSerialManager::service(unsigned long curTime_millis) {
+  if (byteReceived) {
+    byteReceived = false;
+    lastByte_millis = curTime_millis;
+  } else {
+    unsigned long idle_millis = curTime_millis - lastByte_millis;
+    if (mode == Binary && binaryState != BinarySync && idle_millis >= TYMPAN_ESM_BINARY_TIMEOUT_MILLIS) {
+      abandonBinaryFrame();
+    }
+    if (batchOpen && idle_millis >= TYMPAN_ESM_BATCH_TIMEOUT_MILLIS) abortBatch();
+  }
+  if (!applyDirty) return;
+  if (curTime_millis < lastApply_millis) lastApply_millis = 0; //handle wrap-around of the clock
+  if ((curTime_millis - lastApply_millis) >= applyInterval) {
+    lastApply_millis = curTime_millis;
+    executeApply();
+  }
+}
+
+void ExtendedSerialManager::requestApply(void) {
+  if (batchOpen) {
+    if (batchApplyPending) appliesCoalesced++;
+    batchApplyPending = true;
+  } else if (applyInterval == 0) {
+    executeApply();
+  } else {
+    if (applyDirty) appliesCoalesced++;
+    applyDirty = true;
+  }
+}
+
+void ExtendedSerialManager::executeApply(void) {
+  applyDirty = false;
+  appliesExecuted++;
   apply();
 }
 
 CMD_OPTIONS ExtendedSerialManager::parseOptions(const char *options) {
   CMD_OPTIONS parsed = { 0, 0, 0 };
   char *ptr = (char *)options;
-  while (isDigit(*ptr)) {
+  while (isdigit(*ptr)) {
     // This is probably terrible form
     parsed.channel = parsed.channel * 10 + (*ptr - '0');
     ptr++;
   }
   // Just in case, let's support a lower-case knob identifier
   parsed.knob = (*ptr & 0x20) ? *ptr - 'a' : *ptr - 'A';
-  while (isDigit(*++ptr)) {
+  while (isdigit(*++ptr)) {
     parsed.value = parsed.value * 10 + (*ptr - '0');
   }
   return parsed;
 }
 
+// comma-separated floats into floatBuffer; returns how many, or -1 if there are too many or one
+// doesn't parse (or is not a finite number: strtof takes "nan" and "inf")
+int ExtendedSerialManager::parseFloats(const char *ptr) {
+  int floatCount = 0;
+  char *end;
+  while (*ptr != '\0') {
+    if (floatCount >= TYMPAN_ESM_MAX_FLOATS) return -1;
+    floatBuffer[floatCount] = strtof(ptr, &end);
+    if (end == ptr || (*end != ',' && *end != '\0') || !isfinite(floatBuffer[floatCount])) return -1;
+    floatCount++;
+    ptr = (*end == ',') ? end + 1 : end;
+  }
+  return floatCount;
+}
+
 inline CONFIGURABLE *ExtendedSerialManager::getKnob(int channel, int knob) {
   return &knobs[channel * knobCount + knob];
 }
@@ -485,8 +861,8 @@ inline char ExtendedSerialManager::getKnobIdentifier(int knob) {
 }
 
 inline void ExtendedSerialManager::printValue(CONFIGURABLE *knob) {
-  int channel = (knob - knobs) / sizeof(CONFIGURABLE);
-  char knobIdentifier = getKnobIdentifier((knob - knobs) % sizeof(CONFIGURABLE));
+  int channel = (knob - knobs) / knobCount;
+  char knobIdentifier = getKnobIdentifier((knob - knobs) % knobCount);
   myTympan.print(knobIdentifier);
   myTympan.print(channel);
   myTympan.print("=");
@@ -495,8 +871,8 @@ inline void ExtendedSerialManager::printValue(CONFIGURABLE *knob) {
 }
 
 inline void ExtendedSerialManager::printValue(CONFIGURABLE *knob, const char *verb, const float oldVal) {
-  int channel = (knob - knobs) / sizeof(CONFIGURABLE);
-  char knobIdentifier = getKnobIdentifier((knob - knobs) % sizeof(CONFIGURABLE));
+  int channel = (knob - knobs) / knobCount;
+  char knobIdentifier = getKnobIdentifier((knob - knobs) % knobCount);
   #if (PRINT_MESSAGES_FOR_HUMANS)
     myTympan.printf(
         "Msg: %s %s (%c) on channel %i from %f%s to %f%s (clamped)\n",
@@ -517,6 +893,247 @@ inline void ExtendedSerialManager::printValue(CONFIGURABLE *knob, const char *ve
   myTympan.print("\n");
 }
 
+void ExtendedSerialManager::buildLayoutCache(void) {
+  // Everything but the values is fixed for the lifetime of the manager, so the layout is
+  // rendered once up front (one pass to size it, one to fill it) and afterwards only the
+  // value slots are rewritten.
+  int valueCount = channelCount * knobCount;
+  layoutTarget = LayoutMeasure;
+  layoutLength = 0;
+  writeLayout();
+  layoutCache = (char *)malloc(layoutLength + 1);
+  layoutValueOffsets = (int *)malloc(valueCount * sizeof(int));
+  layoutValues = (float *)malloc(valueCount * sizeof(float));
+  if (!layoutCache || !layoutValueOffsets || !layoutValues) {
+    free(layoutCache);
+    free(layoutValueOffsets);
+    free(layoutValues);
+    layoutCache = NULL;
+    layoutTarget = LayoutStream;
+    return;
+  }
+  layoutTarget = LayoutCache;
+  layoutLength = 0;
+  writeLayout();
+  layoutCache[layoutLength] = '\0';
+}
+
+void ExtendedSerialManager::refreshLayoutValues(void) {
+  char tmp[TYMPAN_ESM_LAYOUT_VALUE_WIDTH + 1];
+  int valueCount = channelCount * knobCount;
+  for (int ii = 0; ii < valueCount; ii++) {
+    float value = *knobs[ii].value;
+    if (value == layoutValues[ii]) continue;
+    snprintf(tmp, sizeof(tmp), "%*.2f", TYMPAN_ESM_LAYOUT_VALUE_WIDTH, value);
+    memcpy(&layoutCache[layoutValueOffsets[ii]], tmp, TYMPAN_ESM_LAYOUT_VALUE_WIDTH);
+    layoutValues[ii] = value;
+  }
+}
+
+void ExtendedSerialManager::writeLayout(void) {
+  emitLayout("JSON={"
+    "'pages':["
+      "{'title':'Main','cards':["
+        "{'name':'Commands','buttons':[");
+  for (int ii = 0; ii < commandCount; ii++) {
+    if (ii) emitLayout(',');
+    emitLayout("{'id':'command-");
+    emitLayout(commands[ii].character);
+    emitLayout("','label':'");
+    emitLayout(commands[ii].name);
+    emitLayout("','cmd':'");
+    emitLayout(commands[ii].character);
+    emitLayout("','width':'12'}");
+  }
+  emitLayout(
+        "]}"
+      "]}");
+  for (int ii = 0; ii < channelCount; ii++) {
+    emitLayout(",{'title':'Channel ");
+    emitLayout(ii);
+    emitLayout("','knobs':[");
+    for (int jj = 0; jj < knobCount; jj++) {
+      CONFIGURABLE *knob = getKnob(ii, jj);
+      if (jj) emitLayout(',');
+      emitLayout("{'name':'");
+      emitLayout(knob->name);
+      emitLayout("','min':");
+      emitLayout(knob->min);
+      emitLayout(",'max':");
+      emitLayout(knob->max);
+      emitLayout(",'value':");
+      writeLayoutValue(ii * knobCount + jj, *knob->value);
+      emitLayout(",'unit':'");
+      emitLayout(knob->unit);
+      emitLayout("'}");
+    }
+    emitLayout("]}");
+  }
+  emitLayout(
+    "]"
+  "}");
+}
+
+void ExtendedSerialManager::writeLayoutValue(int index, float value) {
+  char tmp[TYMPAN_ESM_LAYOUT_VALUE_WIDTH + 1];
+  switch (layoutTarget) {
+    case LayoutMeasure:
+      layoutLength += TYMPAN_ESM_LAYOUT_VALUE_WIDTH;
+      break;
+    case LayoutCache:
+      // Right-aligned in a fixed-width slot so it can be patched in place later on
+      snprintf(tmp, sizeof(tmp), "%*.2f", TYMPAN_ESM_LAYOUT_VALUE_WIDTH, value);
+      layoutValueOffsets[index] = layoutLength;
+      layoutValues[index] = value;
+      memcpy(&layoutCache[layoutLength], tmp, TYMPAN_ESM_LAYOUT_VALUE_WIDTH);
+      layoutLength += TYMPAN_ESM_LAYOUT_VALUE_WIDTH;
+      break;
+    case LayoutStream:
+      emitLayout(value);
+      break;
+  }
+}
+
+void ExtendedSerialManager::emitLayout(const char *str) {
+  while (*str) emitLayout(*str++);
+}
+
+void ExtendedSerialManager::emitLayout(char c) {
+  switch (layoutTarget) {
+    case LayoutMeasure:
+      layoutLength++;
+      break;
+    case LayoutCache:
+      layoutCache[layoutLength++] = c;
+      break;
+    case LayoutStream:
+      if (layoutChunkLength == TYMPAN_ESM_LAYOUT_CHUNK_SIZE - 1) flushLayout();
+      layoutChunk[layoutChunkLength++] = c;
+      break;
+  }
+}
+
+void ExtendedSerialManager::emitLayout(int n) {
+  char tmp[12];
+  snprintf(tmp, sizeof(tmp), "%i", n);
+  emitLayout(tmp);
+}
+
+void ExtendedSerialManager::emitLayout(float f) {
+  // Two decimals, matching what String used to produce
+  char tmp[24];
+  snprintf(tmp, sizeof(tmp), "%.2f", f);
+  emitLayout(tmp);
+}
+
+void ExtendedSerialManager::flushLayout(void) {
+  layoutChunk[layoutChunkLength] = '\0';
+  myTympan.print(layoutChunk);
+  layoutChunkLength = 0;
+}
+
+void ExtendedSerialManager::processBinaryBytes(const uint8_t *bytes, int count) {
+  // A refused frame puts the bytes after its sync byte back in front of the ones still to be
+  // parsed. They are either part of the frame (at most all of it) or were already in this list,
+  // so the list never outgrows one frame.
+  uint8_t pending[sizeof(binaryFrame)];
+  memcpy(pending, bytes, count);
+  int next = 0;
+  while (next < count) {
+    uint8_t b = pending[next++];
+    if (binaryState == BinarySync) {
+      // Anything between frames is line noise; just wait for the next sync byte
+      if (b == TYMPAN_ESM_BINARY_SYNC) {
+        binaryFrameLength = 0;
+        binaryState = BinaryLength;
+      }
+      continue;
+    }
+    bool refused = false;
+    binaryFrame[binaryFrameLength++] = b;
+    switch (binaryState) {
+      case BinaryLength:
+        if (b == 0 || b > TYMPAN_ESM_BINARY_MAX_PAYLOAD) {
+          refused = true;
+          break;
+        }
+        binaryLength = b;
+        binaryCrc = crc16(0xFFFF, b);
+        binaryState = BinaryPayload;
+        break;
+      case BinaryPayload:
+        binaryCrc = crc16(binaryCrc, b);
+        if (binaryFrameLength == 1 + binaryLength) binaryState = BinaryCrcLow;
+        break;
+      case BinaryCrcLow:
+        binaryCrc ^= b;
+        binaryState = BinaryCrcHigh;
+        break;
+      case BinaryCrcHigh:
+        binaryState = BinarySync;
+        if ((binaryCrc ^ ((uint16_t)b << 8)) == 0) {
+          handleBinaryFrame(&binaryFrame[1], binaryLength);
+        } else {
+          refused = true;
+        }
+        break;
+      default:
+        break;
+    }
+    if (refused) {
+      sendBinaryAck(false);
+      binaryState = BinarySync;
+      int rest = count - next;
+      memmove(&pending[binaryFrameLength], &pending[next], rest);
+      memcpy(pending, binaryFrame, binaryFrameLength);
+      count = binaryFrameLength + rest;
+      next = 0;
+    }
+  }
+}
+
+void ExtendedSerialManager::abandonBinaryFrame(void) {
+  // The client stalled mid-frame (or the length byte promised more than was sent): refuse the
+  // frame and look for a sync byte in what did arrive
+  uint8_t received[sizeof(binaryFrame)];
+  int count = binaryFrameLength;
+  memcpy(received, binaryFrame, count);
+  sendBinaryAck(false);
+  binaryState = BinarySync;
+  processBinaryBytes(received, count);
+}
+
+void ExtendedSerialManager::sendBinaryFrame(const uint8_t *payload, int length) {
+  uint8_t header[2] = { TYMPAN_ESM_BINARY_SYNC, (uint8_t)length };
+  uint16_t crc = crc16(0xFFFF, header[1]);
+  for (int ii = 0; ii < length; ii++) {
+    crc = crc16(crc, payload[ii]);
+  }
+  uint8_t trailer[2] = { (uint8_t)(crc & 0xff), (uint8_t)(crc >> 8) };
+  myTympan.write(header, 2);
+  myTympan.write(payload, length);
+  myTympan.write(trailer, 2);
+}
+
+void ExtendedSerialManager::sendBinaryValue(int channel, int knob) {
+  uint8_t response[3 + sizeof(float)] = { TYMPAN_ESM_BINARY_VALUE, (uint8_t)channel, (uint8_t)knob };
+  memcpy(&response[3], getKnob(channel, knob)->value, sizeof(float));
+  sendBinaryFrame(response, sizeof(response));
+}
+
+void ExtendedSerialManager::sendBinaryAck(bool success) {
+  uint8_t response[2] = { TYMPAN_ESM_BINARY_ACK, (uint8_t)(success ? 1 : 0) };
+  sendBinaryFrame(response, sizeof(response));
+}
+
+inline uint16_t ExtendedSerialManager::crc16(uint16_t crc, uint8_t b) {
+  crc ^= (uint16_t)b << 8;
+  for (int ii = 0; ii < 8; ii++) {
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
 void ExtendedSerialManager::ackIfExtended() {
   if (mode == Extended) myTympan.println("ACK=1");
 }
@@ -0,0 +1,264 @@
+#ifndef _FastWDRC_h
+#define _FastWDRC_h
+
+/*
+ *
+ * Table-based, block-oriented drop-in replacements for the two halves of the BTNRH WDRC
+ * compressor (AudioCalcEnvelope_F32 and AudioCalcGainWDRC_F32).
+ *
+ * The stock implementation converts every sample's envelope to dB and every sample's gain back
+ * from dB with the math library. Here both conversions go through small interpolated tables
+ * (log2 of the mantissa and exp2 of the fraction, with the exponent handled by bit twiddling),
+ * each within 1e-4 dB of the exact value (8e-5 dB worst case, measured by test_fast_wdrc in
+ * single-band). Each stage works on a whole block at a time, so that the loops stay simple on the
+ * Teensy (whose FPU has no SIMD for floats; CMSIS-DSP takes the rectification).
+ *
+ * With SSE2 (any x86-64 host) the gain is worked out four samples at a time instead: log2 and
+ * exp2 become polynomials on the mantissa and the fraction (a table lookup would be a gather),
+ * the curve's branches become selects, and the three passes are one. The polynomials are as
+ * accurate as the tables (test_fast_wdrc checks both). The rest of a block that is not a
+ * multiple of four goes through the tables.
+ *
+ * The static curve is the BTNRH WDRC circuit (linear gain below tk, compression at cr above it,
+ * limiting above bolt) with downward expansion at exp_cr below exp_end_knee.
+ *
+ * This header has no dependency on Tympan_Library so that it can also be built on a host.
+ *
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+#if defined(__arm__)
+  #include <arm_math.h>
+#endif
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+#define FAST_WDRC_TABLE_BITS 7
+#define FAST_WDRC_TABLE_SIZE (1 << FAST_WDRC_TABLE_BITS)
+
+class FastDB {
+  public:
+    // 20*log10(x) for x > 0 (anything smaller than 1e-10 is treated as 1e-10, i.e. -200 dB)
+    static inline float db2(float x) {
+      return 6.02059991f * log2(x < 1e-10f ? 1e-10f : x);
+    }
+
+    // 10^(x/20)
+    static inline float undb2(float x) {
+      return exp2(x * 0.16609640f);
+    }
+
+    // builds the tables up front so that it doesn't happen in the first audio interrupt
+    static void prepare(void) { tables(); }
+
+    static inline float log2(float x) {
+      union { float f; uint32_t i; } bits = { x };
+      int exponent = (int)((bits.i >> 23) & 0xff) - 127;
+      uint32_t mantissa = bits.i & 0x7fffff;
+      uint32_t index = mantissa >> (23 - FAST_WDRC_TABLE_BITS);
+      float frac = (float)(mantissa & ((1 << (23 - FAST_WDRC_TABLE_BITS)) - 1))
+          * (1.0f / (1 << (23 - FAST_WDRC_TABLE_BITS)));
+      const float *table = tables().log2Table;
+      return exponent + table[index] + frac * (table[index + 1] - table[index]);
+    }
+
+    static inline float exp2(float x) {
+      if (x < -126.0f) return 0.0f;
+      if (x > 127.0f) x = 127.0f;
+      float whole = floorf(x);
+      float pos = (x - whole) * FAST_WDRC_TABLE_SIZE;
+      int index = (int)pos;
+      float frac = pos - index;
+      if (index >= FAST_WDRC_TABLE_SIZE) { index = FAST_WDRC_TABLE_SIZE - 1; frac = 1.0f; } // rounding
+      const float *table = tables().exp2Table;
+      union { float f; uint32_t i; } bits = { table[index] + frac * (table[index + 1] - table[index]) };
+      bits.i += (uint32_t)(int32_t)whole << 23;   // shifted unsigned: a negative exponent wraps around
+      return bits.f;
+    }
+
+#if defined(__SSE2__)
+    // the same, four at a time
+    static inline __m128 db2(__m128 x) {
+      return _mm_mul_ps(_mm_set1_ps(6.02059991f), log2(_mm_max_ps(x, _mm_set1_ps(1e-10f))));
+    }
+
+    static inline __m128 undb2(__m128 x) {
+      return exp2(_mm_mul_ps(x, _mm_set1_ps(0.16609640f)));
+    }
+
+    // x > 0 and normal; log2(1 + t) to 2.5e-6 by a degree-6 polynomial
+    static inline __m128 log2(__m128 x) {
+      __m128i bits = _mm_castps_si128(x);
+      __m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+      __m128i mantissa = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x7fffff)), _mm_set1_epi32(0x3f800000));
+      __m128 t = _mm_sub_ps(_mm_castsi128_ps(mantissa), _mm_set1_ps(1.0f));
+      __m128 p = _mm_set1_ps(-2.456853539e-02f);
+      p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(1.176130846e-01f));
+      p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(-2.726975679e-01f));
+      p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(4.545084834e-01f));
+      p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(-7.173127532e-01f));
+      p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(1.442453504e+00f));
+      p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(2.443438689e-06f));
+      return _mm_add_ps(exponent, p);
+    }
+
+    // 2^x, 0 below -126 and 2^127 above 127 as the scalar one; 2^f to 2e-7 by a degree-6 polynomial
+    static inline __m128 exp2(__m128 x) {
+      __m128 inRange = _mm_cmpge_ps(x, _mm_set1_ps(-126.0f));
+      x = _mm_max_ps(_mm_min_ps(x, _mm_set1_ps(127.0f)), _mm_set1_ps(-126.0f));
+      __m128 whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+      whole = _mm_sub_ps(whole, _mm_and_ps(_mm_cmpgt_ps(whole, x), _mm_set1_ps(1.0f)));   // floor
+      __m128 f = _mm_sub_ps(x, whole);
+      __m128 p = _mm_set1_ps(2.186578495e-04f);
+      p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.239133184e-03f));
+      p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(9.684186429e-03f));
+      p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(5.548062921e-02f));
+      p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(2.402304560e-01f));
+      p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(6.931469440e-01f));
+      p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+      __m128i scaled = _mm_add_epi32(_mm_castps_si128(p), _mm_slli_epi32(_mm_cvttps_epi32(whole), 23));
+      return _mm_and_ps(_mm_castsi128_ps(scaled), inRange);
+    }
+#endif
+
+  private:
+    struct Tables {
+      float log2Table[FAST_WDRC_TABLE_SIZE + 1];  // log2(1 + i/N)
+      float exp2Table[FAST_WDRC_TABLE_SIZE + 1];  // 2^(i/N)
+      Tables(void) {
+        for (int ii = 0; ii <= FAST_WDRC_TABLE_SIZE; ii++) {
+          log2Table[ii] = log2f(1.0f + (float)ii / FAST_WDRC_TABLE_SIZE);
+          exp2Table[ii] = exp2f((float)ii / FAST_WDRC_TABLE_SIZE);
+        }
+      }
+    };
+
+    static const Tables &tables(void) {
+      static Tables instance;
+      return instance;
+    }
+};
+
+class FastEnvelope_F32 {
+  public:
+    FastEnvelope_F32(void) { setAttackRelease_msec(5.0f, 50.0f); }
+
+    void setSampleRate_Hz(float fs_Hz) {
+      sampleRate_Hz = fs_Hz;
+      setAttackRelease_msec(attack_msec, release_msec);
+    }
+
+    // same ANSI-style time constants as the BTNRH peak detector
+    void setAttackRelease_msec(float attack, float release) {
+      attack_msec = attack;
+      release_msec = release;
+      float ansi_atk = 0.001f * attack_msec * sampleRate_Hz / 2.425f;
+      float ansi_rel = 0.001f * release_msec * sampleRate_Hz / 1.782f;
+      alfa = ansi_atk / (1.0f + ansi_atk);
+      beta = ansi_rel / (10.0f + ansi_rel);
+    }
+
+    void smooth_env(float x[], float y[], int n) {
+      float xpk = state;
+      #if defined(__arm__)
+        arm_abs_f32(x, y, n);
+      #else
+        for (int ii = 0; ii < n; ii++) y[ii] = fabsf(x[ii]);
+      #endif
+      for (int ii = 0; ii < n; ii++) {
+        xpk = (y[ii] >= xpk) ? alfa * xpk + (1.0f - alfa) * y[ii] : beta * xpk;
+        y[ii] = xpk;
+      }
+      state = xpk;
+    }
+
+  private:
+    float sampleRate_Hz = 44100.0f;
+    float attack_msec;
+    float release_msec;
+    float alfa;
+    float beta;
+    float state = 0.0f;
+};
+
+class FastGainWDRC_F32 {
+  public:
+    FastGainWDRC_F32(void) {
+      FastDB::prepare();
+      setParams(119.0f, 1.0f, 0.0f, 0.0f, 105.0f, 1.0f, 105.0f);
+    }
+
+    // Accepts anything shaped like BTNRH_WDRC::CHA_WDRC, so this header does not need the library
+    template <typename PARAMS>
+    void setParams_from_CHA_WDRC(const PARAMS *gha) {
+      setParams(gha->maxdB, gha->exp_cr, gha->exp_end_knee, gha->tkgain, gha->tk, gha->cr, gha->bolt);
+    }
+
+    void setParams(float maxdB, float exp_cr, float exp_end_knee, float tkgain, float tk, float cr, float bolt) {
+      this->maxdB = maxdB;
+      this->exp_end_knee = exp_end_knee;
+      this->tkgain = tkgain;
+      this->cr = cr;
+      this->bolt = bolt;
+      this->tk = (tk + tkgain > bolt) ? bolt - tkgain : tk;
+      tkgo = tkgain + this->tk * (1.0f - 1.0f / cr);
+      pblt = cr * (bolt - tkgo);
+      cr_const = 1.0f / cr - 1.0f;
+      exp_slope = 1.0f / (exp_cr > 0.01f ? exp_cr : 0.01f) - 1.0f;
+      // as the stock circuit: the expansion hangs off tkgain unless the compression starts below
+      // its kneepoint (with cr < 1, curve() would give the compression line there instead)
+      gdb_knee = (this->tk < exp_end_knee) ? cr_const * exp_end_knee + tkgo : tkgain;
+    }
+
+    // gain in dB for an input level in dB SPL
+    inline float gain_dB(float pdB) {
+      if (pdB < exp_end_knee) return gdb_knee + exp_slope * (pdB - exp_end_knee);
+      return curve(pdB);
+    }
+
+    void calcGainFromEnvelope(float *env, float *gain_out, const int n) {
+      int start = 0;
+      #if defined(__SSE2__)
+        for (; start + 4 <= n; start += 4) _mm_storeu_ps(&gain_out[start], gain(_mm_loadu_ps(&env[start])));
+      #endif
+      // three passes over the block: level in dB, gain in dB, gain in linear units
+      for (int ii = start; ii < n; ii++) gain_out[ii] = maxdB + FastDB::db2(env[ii]);
+      for (int ii = start; ii < n; ii++) gain_out[ii] = gain_dB(gain_out[ii]);
+      for (int ii = start; ii < n; ii++) gain_out[ii] = FastDB::undb2(gain_out[ii]);
+    }
+
+  private:
+#if defined(__SSE2__)
+    static inline __m128 select(__m128 mask, __m128 a, __m128 b) {
+      return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    // gain_dB() with its branches as selects, in the same order of precedence
+    inline __m128 gain(__m128 env) {
+      __m128 pdB = _mm_add_ps(_mm_set1_ps(maxdB), FastDB::db2(env));
+      __m128 g = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(cr_const), pdB), _mm_set1_ps(tkgo));
+      __m128 limited = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(bolt),
+          _mm_mul_ps(_mm_sub_ps(pdB, _mm_set1_ps(pblt)), _mm_set1_ps(0.1f))), pdB);
+      g = select(_mm_cmpgt_ps(pdB, _mm_set1_ps(pblt)), limited, g);
+      if (cr >= 1.0f) g = select(_mm_cmplt_ps(pdB, _mm_set1_ps(tk)), _mm_set1_ps(tkgain), g);
+      __m128 expanded = _mm_add_ps(_mm_set1_ps(gdb_knee),
+          _mm_mul_ps(_mm_set1_ps(exp_slope), _mm_sub_ps(pdB, _mm_set1_ps(exp_end_knee))));
+      g = select(_mm_cmplt_ps(pdB, _mm_set1_ps(exp_end_knee)), expanded, g);
+      return FastDB::undb2(g);
+    }
+#endif
+
+    float maxdB, exp_end_knee, tkgain, tk, cr, bolt;
+    float tkgo, pblt, cr_const, exp_slope, gdb_knee;
+
+    inline float curve(float pdB) {
+      if ((pdB < tk) && (cr >= 1.0f)) return tkgain;
+      if (pdB > pblt) return bolt + (pdB - pblt) / 10.0f - pdB;
+      return cr_const * pdB + tkgo;
+    }
+};
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef _FilterDesign_h
+#define _FilterDesign_h
+
+/*
+ *
+ * Butterworth lowpass/highpass design at runtime, as second-order sections for
+ * AudioFilterBiquadCascade_F32 (5 values per section: b0, b1, b2, a1, a2, Matlab's sign
+ * convention, a0 = 1).
+ *
+ * The analog prototype is split into pole pairs, pair k having
+ *
+ *   Q_k = 1 / (2 cos(pi (2k + 1 + (order & 1)) / (2 order)))
+ *
+ * (plus a single real pole for odd orders, which becomes a first-order section), and every pair
+ * is mapped through the bilinear transform with K = tan(pi fc / fs), which pre-warps the corner
+ * so it lands exactly on fc.
+ *
+ * Designs are kept in a small cache keyed by (type, fc, fs, order), so sweeping a knob back and
+ * forth doesn't redo the trig. The cache is replaced round-robin. Designing takes a few trig
+ * calls per section, so do it from loop() and hand the result to the audio path, never the other
+ * way around.
+ *
+ * This header has no dependency on Tympan_Library so that it can also be built on a host.
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+
+#define FILTER_DESIGN_MAX_ORDER   16  // i.e. 8 sections, as many as AudioFilterBiquadCascade_F32 takes
+#define FILTER_DESIGN_MAX_SECTIONS ((FILTER_DESIGN_MAX_ORDER + 1) / 2)
+#define FILTER_DESIGN_CACHE_SIZE  8
+
+enum FILTER_TYPE {
+  FilterLowpass,
+  FilterHighpass
+};
+
+class ButterworthDesign {
+  public:
+    // Writes the sections into coeffs (room for 5 * FILTER_DESIGN_MAX_SECTIONS values) and returns
+    // how many there are, or 0 if the design is not possible.
+    int design(FILTER_TYPE type, float fc_Hz, float fs_Hz, int order, float *coeffs) {
+      if (order < 1 || order > FILTER_DESIGN_MAX_ORDER) return 0;
+      if (fc_Hz <= 0.0f || fc_Hz >= 0.5f * fs_Hz) return 0;
+
+      for (int ii = 0; ii < FILTER_DESIGN_CACHE_SIZE; ii++) {
+        CacheEntry *entry = &cache[ii];
+        if (entry->nSections && entry->type == type && entry->fc_Hz == fc_Hz
+            && entry->fs_Hz == fs_Hz && entry->order == order) {
+          hits++;
+          memcpy(coeffs, entry->coeffs, 5 * entry->nSections * sizeof(float));
+          return entry->nSections;
+        }
+      }
+
+      CacheEntry *entry = &cache[nextEntry];
+      nextEntry = (nextEntry + 1) % FILTER_DESIGN_CACHE_SIZE;
+      entry->type = type;
+      entry->fc_Hz = fc_Hz;
+      entry->fs_Hz = fs_Hz;
+      entry->order = order;
+      entry->nSections = compute(type, fc_Hz, fs_Hz, order, entry->coeffs);
+      misses++;
+      memcpy(coeffs, entry->coeffs, 5 * entry->nSections * sizeof(float));
+      return entry->nSections;
+    }
+
+    unsigned long getCacheHits(void) { return hits; }
+    unsigned long getCacheMisses(void) { return misses; }
+
+  private:
+    struct CacheEntry {
+      FILTER_TYPE type;
+      float fc_Hz;
+      float fs_Hz;
+      int order;
+      int nSections = 0;  // 0 = empty
+      float coeffs[5 * FILTER_DESIGN_MAX_SECTIONS];
+    };
+
+    CacheEntry cache[FILTER_DESIGN_CACHE_SIZE];
+    int nextEntry = 0;
+    unsigned long hits = 0;
+    unsigned long misses = 0;
+
+    static int compute(FILTER_TYPE type, float fc_Hz, float fs_Hz, int order, float *coeffs) {
+      double K = tan(M_PI * fc_Hz / fs_Hz);
+      double K2 = K * K;
+      int nSections = 0;
+      for (int kk = 0; kk < order / 2; kk++) {
+        double Q = 1.0 / (2.0 * cos(M_PI * (2 * kk + 1 + (order & 1)) / (2.0 * order)));
+        double norm = 1.0 / (1.0 + K / Q + K2);
+        float *c = &coeffs[5 * nSections++];
+        if (type == FilterLowpass) {
+          c[0] = (float)(K2 * norm);
+          c[1] = 2.0f * c[0];
+          c[2] = c[0];
+        } else {
+          c[0] = (float)norm;
+          c[1] = -2.0f * c[0];
+          c[2] = c[0];
+        }
+        c[3] = (float)(2.0 * (K2 - 1.0) * norm);
+        c[4] = (float)((1.0 - K / Q + K2) * norm);
+      }
+      if (order & 1) {
+        double norm = 1.0 / (1.0 + K);
+        float *c = &coeffs[5 * nSections++];
+        if (type == FilterLowpass) {
+          c[0] = (float)(K * norm);
+          c[1] = c[0];
+        } else {
+          c[0] = (float)norm;
+          c[1] = -c[0];
+        }
+        c[2] = 0.0f;
+        c[3] = (float)((K - 1.0) * norm);
+        c[4] = 0.0f;
+      }
+      return nSections;
+    }
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef _HostTympan_h
+#define _HostTympan_h
+
+/*
+ *
+ * A thin stand-in for the parts of Tympan_Library that ExtendedSerialManager relies on, so the
+ * serial protocol can be compiled and exercised on a development machine (e.g. a PlatformIO
+ * "native" environment). Only what the manager actually calls is provided: print/println/printf
+ * and write on a Tympan object.
+ *
+ * Output goes to stdout unless a different FILE is supplied, which makes it easy to send it to
+ * /dev/null when timing the parser.
+ *
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+
+class Tympan {
+  public:
+    Tympan(FILE *out = stdout) : out(out) {}
+
+    void setOutput(FILE *out) { this->out = out; }
+
+    void print(const char *s) { fputs(s, out); }
+    void print(char c) { fputc(c, out); }
+    void print(int n) { fprintf(out, "%i", n); }
+    void print(float f) { fprintf(out, "%.2f", f); }
+    size_t write(const uint8_t *buffer, size_t size) { return fwrite(buffer, 1, size, out); }
+
+    template <typename T>
+    void println(T value) { print(value); fputc('\n', out); }
+    void println(void) { fputc('\n', out); }
+
+    int printf(const char *format, ...) {
+      va_list args;
+      va_start(args, format);
+      int written = vfprintf(out, format, args);
+      va_end(args);
+      return written;
+    }
+
+  private:
+    FILE *out;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef _STFT_F32_h
+#define _STFT_F32_h
+
+/*
+ *
+ * Weighted overlap-add short-time Fourier transform, one hop per audio block.
+ *
+ * analyze() takes one block of new samples and produces the spectrum of the last fftSize samples
+ * (sqrt-Hann windowed); the caller may modify the spectrum in place and then call synthesize() to
+ * get one block of output back (inverse FFT, sqrt-Hann window, overlap-add). With the spectrum
+ * left alone the output is the input delayed by fftSize - hopSize samples.
+ *
+ * The spectrum uses the arm_rfft_fast_f32 layout: spectrum[0] is the (real) DC bin,
+ * spectrum[1] the (real) Nyquist bin, followed by re/im pairs for bins 1 to fftSize/2 - 1.
+ *
+ * bypass() gives what analyze() and synthesize() would with the spectrum left alone, without the
+ * FFTs, and keeps the buffers current so that the two can be switched between at any block.
+ *
+ * All buffers are allocated once in setup(), never on the audio path.
+ *
+ */
+
+#include <Tympan_Library.h>
+
+class STFT_F32 {
+  public:
+    ~STFT_F32(void) { free(buffers); }
+
+    // fftSize must be a power of two from 32 to 4096 and a multiple of hopSize (at least 2x)
+    bool setup(int fftSize, int hopSize) {
+      if ((fftSize % hopSize) || (fftSize < 2 * hopSize)) return false;
+      if (arm_rfft_fast_init_f32(&fft, fftSize) != 0) return false;
+      free(buffers);
+      buffers = (float32_t *)calloc(5 * fftSize, sizeof(float32_t));
+      if (!buffers) return false;
+      this->fftSize = fftSize;
+      this->hopSize = hopSize;
+      window = buffers;
+      frame = window + fftSize;
+      overlap = frame + fftSize;
+      scratch = overlap + fftSize;
+      spectrum = scratch + fftSize;
+      // sqrt of a periodic Hann window; applied twice, consecutive frames sum to fftSize / (2 * hopSize)
+      float32_t norm = sqrtf(2.0f * hopSize / fftSize);
+      for (int ii = 0; ii < fftSize; ii++) {
+        window[ii] = sqrtf(0.5f - 0.5f * cosf(2.0f * (float)M_PI * ii / fftSize)) * norm;
+      }
+      return true;
+    }
+
+    int getFFTSize(void) { return fftSize; }
+    int getHopSize(void) { return hopSize; }
+    int getLatency_samples(void) { return fftSize - hopSize; }
+
+    // sum of the squared analysis window, for converting bin powers back to signal levels
+    float32_t getWindowEnergy(void) {
+      float32_t sum = 0.0f;
+      for (int ii = 0; ii < fftSize; ii++) sum += window[ii] * window[ii];
+      return sum;
+    }
+
+    // one hop of input (hopSize samples) in, spectrum (fftSize floats) out
+    float32_t *analyze(const float32_t *in) {
+      memmove(frame, frame + hopSize, (fftSize - hopSize) * sizeof(float32_t));
+      memcpy(frame + fftSize - hopSize, in, hopSize * sizeof(float32_t));
+      arm_mult_f32(frame, window, scratch, fftSize);
+      arm_rfft_fast_f32(&fft, scratch, spectrum, 0);
+      return spectrum;
+    }
+
+    // spectrum (as modified by the caller) in, one hop of output (hopSize samples) out
+    void synthesize(float32_t *out) {
+      arm_rfft_fast_f32(&fft, spectrum, scratch, 1);
+      arm_mult_f32(scratch, window, scratch, fftSize);
+      arm_add_f32(overlap, scratch, overlap, fftSize);
+      memcpy(out, overlap, hopSize * sizeof(float32_t));
+      memmove(overlap, overlap + hopSize, (fftSize - hopSize) * sizeof(float32_t));
+      memset(overlap + fftSize - hopSize, 0, hopSize * sizeof(float32_t));
+    }
+
+    // one hop in, the same delayed out: overlap-adds the twice-windowed frame the FFTs would give
+    void bypass(const float32_t *in, float32_t *out) {
+      memmove(frame, frame + hopSize, (fftSize - hopSize) * sizeof(float32_t));
+      memcpy(frame + fftSize - hopSize, in, hopSize * sizeof(float32_t));
+      arm_mult_f32(frame, window, scratch, fftSize);
+      arm_mult_f32(scratch, window, scratch, fftSize);
+      arm_add_f32(overlap, scratch, overlap, fftSize);
+      memcpy(out, overlap, hopSize * sizeof(float32_t));
+      memmove(overlap, overlap + hopSize, (fftSize - hopSize) * sizeof(float32_t));
+      memset(overlap + fftSize - hopSize, 0, hopSize * sizeof(float32_t));
+    }
+
+  private:
+    arm_rfft_fast_instance_f32 fft;
+    int fftSize = 0;
+    int hopSize = 0;
+    float32_t *buffers = NULL;
+    float32_t *window;
+    float32_t *frame;
+    float32_t *overlap;
+    float32_t *scratch;
+    float32_t *spectrum;
+};
+
+#endif
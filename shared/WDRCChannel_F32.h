@@ -0,0 +1,173 @@
+#ifndef _WDRCChannel_F32_h
+#define _WDRCChannel_F32_h
+
+/*
+ *
+ * The per-channel half of a BTNRH WDRC compressor, without the AudioStream_F32 plumbing, so that
+ * the mono and stereo compressors can share it.
+ *
+ * Parameters arrive from loop() through a DoubleBuffer and are swapped in by acquireParams() at
+ * the start of a block. Whenever the gain-affecting parameters change, the output gain is
+ * blended from the last gain applied to the new curve over the ramp time so that the change
+ * doesn't click.
+ *
+ * What the envelope follows is set by an EnvelopeDetector_F32 (peak, RMS or hybrid), handed over
+ * from loop() in the same way; peak, the default, is exactly the stock BTNRH behaviour.
+ *
+ * The envelope and the gain are separate steps so that a caller can run one envelope over a
+ * detector signal of its choosing (e.g. both ears of a linked pair) and share the resulting gain.
+ *
+ * By default the envelope and gain are computed by the library's AudioCalcEnvelope_F32 and
+ * AudioCalcGainWDRC_F32. Building with TYMPAN_WDRC_FAST defined (e.g. -DTYMPAN_WDRC_FAST in
+ * build_flags) swaps in the table-based kernels from FastWDRC.h instead.
+ *
+ */
+
+#include <Tympan_Library.h>
+#include "DoubleBuffer.h"
+#include "EnvelopeDetector_F32.h"
+
+#if defined(TYMPAN_WDRC_FAST)
+  #include "FastWDRC.h"
+  typedef FastEnvelope_F32 WDRCEnvelope;
+  typedef FastGainWDRC_F32 WDRCGain;
+#else
+  typedef AudioCalcEnvelope_F32 WDRCEnvelope;
+  typedef AudioCalcGainWDRC_F32 WDRCGain;
+#endif
+
+class WDRCChannel_F32 {
+  public:
+    // control side: safe to call at any time, takes effect at the next acquireParams()
+    void publishParams(const BTNRH_WDRC::CHA_WDRC *gha) { params.publish(*gha); }
+
+    void publishDetector(DETECTOR_MODE mode, float window_msec) {
+      DetectorParams next = { mode, window_msec };
+      detectorParams.publish(next);
+    }
+
+    // how long a change of the gain parameters takes to fully take effect (0 to switch instantly)
+    void setRampTime_msec(float ramp_msec) { rampTime_msec = ramp_msec; }
+
+    // audio side: call once at the start of every block
+    void acquireParams(void) {
+      const BTNRH_WDRC::CHA_WDRC *next = params.acquire();
+      if (next) swapParams(next);
+      const DetectorParams *nextDetector = detectorParams.acquire();
+      if (nextDetector) detectorSettings = *nextDetector;
+      if ((next || nextDetector) && haveCurrent) {
+        detector.configure(detectorSettings.mode, detectorSettings.window_msec, current.fs);
+      }
+    }
+
+    // detector signal in, smoothed envelope out
+    void calcEnvelope_block(float32_t *detect, float32_t *env, int n) {
+      if (detector.getMode() == DetectorPeak) {
+        calcEnvelope.smooth_env(detect, env, n);
+      } else {
+        detector.detect(detect, env, n);
+        calcEnvelope.smooth_env(env, env, n);
+      }
+    }
+
+    // envelope in, linear gain out (including any running ramp)
+    void calcGain_block(float32_t *env, float32_t *gain, int n);
+
+    // a gain worked out elsewhere (a linked pair's shared one) in, with any running ramp from this
+    // channel's last gain applied; keeps the last gain in step either way
+    void rampGain_block(float32_t *gain, int n);
+
+    // blend from the last gain handed out into whatever comes next over the ramp time, e.g. when
+    // a linked pair splits or joins
+    void startRamp(void);
+
+    // the whole chain for a single channel: in -> envelope -> gain -> out
+    void process(float32_t *in, float32_t *out, int n) {
+      calcEnvelope_block(in, scratch, n);
+      calcGain_block(scratch, scratch, n);
+      arm_mult_f32(in, scratch, out, n);
+    }
+
+    WDRCEnvelope calcEnvelope;
+    WDRCGain calcGain;
+
+  private:
+    struct DetectorParams {
+      DETECTOR_MODE mode;
+      float window_msec;
+    };
+
+    DoubleBuffer<BTNRH_WDRC::CHA_WDRC> params;
+    BTNRH_WDRC::CHA_WDRC current;
+    bool haveCurrent = false;
+
+    // detector
+    DoubleBuffer<DetectorParams> detectorParams;
+    DetectorParams detectorSettings = { DetectorPeak, 5.0f };
+    EnvelopeDetector_F32 detector;
+
+    // gain ramp
+    float rampTime_msec = 10.0f;
+    float lastGain = 1.0f;    // the last gain calcGain_block() handed out
+    float rampFrom = 1.0f;    // lastGain when the ramp started
+    float rampWeight = 1.0f;  // 0 = all rampFrom, 1 = all new curve
+    float rampStep = 0.0f;
+    int rampRemaining = 0;    // samples until the ramp is done
+
+    // scratch
+    float32_t scratch[MAX_AUDIO_BLOCK_SAMPLES_F32];
+
+    void swapParams(const BTNRH_WDRC::CHA_WDRC *next);
+    bool gainChanged(const BTNRH_WDRC::CHA_WDRC *next);
+};
+
+inline void WDRCChannel_F32::calcGain_block(float32_t *env, float32_t *gain, int n) {
+  calcGain.calcGainFromEnvelope(env, gain, n);
+  rampGain_block(gain, n);
+}
+
+inline void WDRCChannel_F32::rampGain_block(float32_t *gain, int n) {
+  int ramped = rampRemaining < n ? rampRemaining : n;
+  float from = rampFrom, weight = rampWeight, step = rampStep;
+  for (int ii = 0; ii < ramped; ii++) {
+    gain[ii] = from + weight * (gain[ii] - from);
+    weight += step;
+  }
+  rampWeight = weight;
+  rampRemaining -= ramped;
+  if (n > 0) lastGain = gain[n - 1];
+}
+
+inline void WDRCChannel_F32::startRamp(void) {
+  if (!haveCurrent) return;
+  float rampSamples = rampTime_msec * 0.001f * current.fs;
+  if (rampSamples < 1.0f) return;
+  // ramp from the gain that was actually applied, even if the last ramp has not finished yet
+  rampFrom = lastGain;
+  rampRemaining = (int)rampSamples;
+  rampStep = 1.0f / rampRemaining;
+  rampWeight = rampStep;
+}
+
+inline void WDRCChannel_F32::swapParams(const BTNRH_WDRC::CHA_WDRC *next) {
+  bool ramp = haveCurrent && gainChanged(next);
+  current = *next;
+  haveCurrent = true;
+  if (ramp) startRamp();
+  calcEnvelope.setSampleRate_Hz(current.fs);
+  calcEnvelope.setAttackRelease_msec(current.attack, current.release);
+  calcGain.setParams_from_CHA_WDRC(&current);
+}
+
+inline bool WDRCChannel_F32::gainChanged(const BTNRH_WDRC::CHA_WDRC *next) {
+  // attack/release only change how the envelope moves, which never makes the gain jump
+  return next->maxdB != current.maxdB
+      || next->exp_cr != current.exp_cr
+      || next->exp_end_knee != current.exp_end_knee
+      || next->tkgain != current.tkgain
+      || next->tk != current.tk
+      || next->cr != current.cr
+      || next->bolt != current.bolt;
+}
+
+#endif
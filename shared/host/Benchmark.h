@@ -0,0 +1,165 @@
+#ifndef _Benchmark_h
+#define _Benchmark_h
+
+/*
+ *
+ * Timing helpers for the host benchmarks (the PlatformIO "native" environment: pio test -e native).
+ * Not part of the Teensy build.
+ *
+ * Benchmark::time() runs a body BENCHMARK_RUNS times and keeps the fastest run, which is the one
+ * the rest of the machine disturbed least. Benchmark::report() prints a result as one JSON object
+ * per line, so the output can be collected with grep and fed to anything that reads JSON:
+ *
+ *   {"name":"esm.set","value":231.4,"unit":"ns/command"}
+ *
+ * Cycle counts come from the time stamp counter on x86 (TSC ticks, which track core cycles only
+ * roughly, as the TSC runs at a fixed rate) and are 0 on other hosts. They are meant for comparing
+ * one version of a kernel with another on the same machine, not for predicting Teensy cycles.
+ *
+ * Benchmark::check() reports a cost (lower is better) and also compares it with a stored baseline,
+ * returning false if it got worse by more than the threshold, so that a test can fail on it. The
+ * comparison is made relative to a fixed calibration loop timed right before it, which takes out
+ * most of what a busy or throttled machine does to the raw numbers (the baseline file holds these
+ * relative costs, the printed results are the raw ones):
+ *
+ *   BENCH_BASELINE   the baseline file, a flat JSON object of name: value
+ *                    (default test/benchmark_baseline.json, relative to the project directory)
+ *   BENCH_THRESHOLD  allowed slowdown as a fraction of the baseline (default 0.5, i.e. 50%:
+ *                    the same code can be 30-40% apart from one run to the next, depending
+ *                    on where it lands in memory)
+ *   BENCH_UPDATE     if set, store the measured values as the new baseline instead of comparing
+ *   BENCH_OUTPUT     if set, also append every result line to this file
+ *
+ * Names without a baseline entry are reported but never fail. Relative costs still shift somewhat
+ * from one machine (or compiler) to another, so after moving the suite, or after a deliberate
+ * change in cost, regenerate the baseline with BENCH_UPDATE=1.
+ *
+ */
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
+
+#ifndef BENCHMARK_RUNS
+  #define BENCHMARK_RUNS 9
+#endif
+
+typedef struct {
+  double ns;       // wall time of the fastest run
+  double cycles;   // TSC ticks of the fastest run (0 where there is no TSC)
+} BENCH_TIMING;
+
+class Benchmark {
+  public:
+    template <typename F>
+    static BENCH_TIMING time(F body, int runs = BENCHMARK_RUNS) {
+      BENCH_TIMING best = { 0.0, 0.0 };
+      for (int ii = 0; ii < runs; ii++) {
+        uint64_t startCycles = cycleCount();
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto stop = std::chrono::steady_clock::now();
+        uint64_t stopCycles = cycleCount();
+        double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+        if (ii == 0 || ns < best.ns) {
+          best.ns = ns;
+          best.cycles = (double)(stopCycles - startCycles);
+        }
+      }
+      return best;
+    }
+
+    static void report(const char *name, double value, const char *unit) {
+      printf("{\"name\":\"%s\",\"value\":%.6g,\"unit\":\"%s\"}\n", name, value, unit);
+      fflush(stdout);
+      const char *output = getenv("BENCH_OUTPUT");
+      FILE *file = output ? fopen(output, "a") : NULL;
+      if (file) {
+        fprintf(file, "{\"name\":\"%s\",\"value\":%.6g,\"unit\":\"%s\"}\n", name, value, unit);
+        fclose(file);
+      }
+    }
+
+    static bool check(const char *name, double value, const char *unit) {
+      report(name, value, unit);
+      double relative = value / calibrate();
+      std::map<std::string, double> baseline = loadBaseline();
+      if (getenv("BENCH_UPDATE")) {
+        baseline[name] = relative;
+        saveBaseline(baseline);
+        return true;
+      }
+      auto entry = baseline.find(name);
+      if (entry == baseline.end()) return true;
+      const char *threshold = getenv("BENCH_THRESHOLD");
+      double limit = entry->second * (1.0 + (threshold ? atof(threshold) : 0.5));
+      if (relative <= limit) return true;
+      printf("%s regressed: %.6g against a baseline of %.6g (limit %.6g, relative to the calibration loop)\n",
+          name, relative, entry->second, limit);
+      return false;
+    }
+
+  private:
+    // ns for a fixed chain of dependent multiply-adds (about 0.5 ms on a desktop machine)
+    static double calibrate(void) {
+      static volatile float result;
+      BENCH_TIMING timing = time([]() {
+        float x = 1.0f, y = 0.5f;
+        for (int ii = 0; ii < 200000; ii++) {
+          x = x * 0.999f + y;
+          y = y * 0.9999f + 0.0001f;
+        }
+        result = x + y;
+      });
+      (void)result;
+      return timing.ns;
+    }
+
+    static const char *baselinePath(void) {
+      const char *path = getenv("BENCH_BASELINE");
+      return path ? path : "test/benchmark_baseline.json";
+    }
+
+    static std::map<std::string, double> loadBaseline(void) {
+      std::map<std::string, double> baseline;
+      FILE *file = fopen(baselinePath(), "r");
+      if (!file) return baseline;
+      char name[128];
+      double value;
+      int c;
+      while ((c = fgetc(file)) != EOF) {
+        if (c != '"') continue;
+        if (fscanf(file, "%127[^\"]\" : %lf", name, &value) == 2) baseline[name] = value;
+      }
+      fclose(file);
+      return baseline;
+    }
+
+    static void saveBaseline(const std::map<std::string, double> &baseline) {
+      FILE *file = fopen(baselinePath(), "w");
+      if (!file) return;
+      fprintf(file, "{\n");
+      size_t count = 0;
+      for (auto &entry : baseline) {
+        fprintf(file, "  \"%s\": %.6g%s\n", entry.first.c_str(), entry.second, ++count < baseline.size() ? "," : "");
+      }
+      fprintf(file, "}\n");
+      fclose(file);
+    }
+
+    static uint64_t cycleCount(void) {
+      #if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+      #else
+        return 0;
+      #endif
+    }
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef _HostAudio_h
+#define _HostAudio_h
+
+/*
+ *
+ * Helpers for driving an audio graph on the host (see Tympan_Library.h in this directory).
+ *
+ * HostNoise is a fixed-seed generator, so that every run of a test or benchmark sees exactly the
+ * same signal. HostAudio::process() pushes a signal through whatever is connected between an
+ * AudioInputI2S_F32 and an AudioOutputI2S_F32, one block per audio cycle, the way the codec would
+ * (the output of a cycle the graph delivered nothing for is silence).
+ *
+ * A test's graph should derive from HostGraph, be created with new and be deleted in tearDown():
+ * a failed assertion leaves the test with a longjmp, which skips the destructors of anything on
+ * the test's stack, and nodes that are never destroyed stay in the update list.
+ *
+ */
+
+#include <Tympan_Library.h>
+
+class HostNoise {
+  public:
+    HostNoise(uint32_t seed = 1) : state(seed) {}
+
+    // uniform in [-1, 1)
+    float uniform(void) {
+      state = state * 1664525u + 1013904223u;
+      return (float)(int32_t)state * (1.0f / 2147483648.0f);
+    }
+
+    // roughly Gaussian (sum of four uniforms), unit variance
+    float gaussian(void) {
+      return (uniform() + uniform() + uniform() + uniform()) * 0.8660254f;
+    }
+
+  private:
+    uint32_t state;
+};
+
+class HostGraph {
+  public:
+    virtual ~HostGraph(void) {}
+};
+
+class HostAudio {
+  public:
+    // samples per channel; right / outRight may be NULL (the input is then the same on both sides)
+    static void process(AudioInputI2S_F32 &input, AudioOutputI2S_F32 &output, int blockSize,
+        const float *left, const float *right, float *outLeft, float *outRight, int samples) {
+      for (int start = 0; start + blockSize <= samples; start += blockSize) {
+        input.hostWrite(left + start, right ? right + start : NULL);
+        AudioStream::update_all();
+        copyOut(output.hostRead(0), outLeft ? outLeft + start : NULL, blockSize);
+        copyOut(output.hostRead(1), outRight ? outRight + start : NULL, blockSize);
+      }
+    }
+
+  private:
+    static void copyOut(const float32_t *block, float *out, int blockSize) {
+      if (!out) return;
+      if (block) memcpy(out, block, blockSize * sizeof(float));
+      else memset(out, 0, blockSize * sizeof(float));
+    }
+};
+
+#endif
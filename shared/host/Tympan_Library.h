@@ -0,0 +1,743 @@
+#ifndef _Tympan_Library_h
+#define _Tympan_Library_h
+
+/*
+ *
+ * Host stand-in for the parts of Tympan_Library (and of the Teensy core and CMSIS-DSP below it)
+ * that the shared nodes use, so that they can be built and run on a development machine: the
+ * PlatformIO "native" environment puts this directory on the include path, and <Tympan_Library.h>
+ * then resolves here. Not part of the Teensy build.
+ *
+ * What it provides:
+ *
+ *   - AudioStream / AudioStream_F32 with a working graph: a block pool (initialize_f32_memory(),
+ *     AudioMemory_F32()), AudioConnection_F32, reference-counted transmit/receive/release and the
+ *     usage counters. AudioStream::update_all() runs one audio cycle synchronously, updating the
+ *     connected nodes in construction order just like the Teensy's audio interrupt, and fills in
+ *     cpu_cycles / cpu_cycles_total (units of 64 cycles at F_CPU, from the host's wall clock, so
+ *     budgets against the block period mean real time on the host).
+ *   - AudioInputI2S_F32 / AudioOutputI2S_F32 that are fed and drained by the host (hostWrite() /
+ *     hostRead()) instead of the codec.
+ *   - The CMSIS-DSP routines the nodes call (plain C loops; arm_rfft_fast_f32 is a real FFT with
+ *     the CMSIS packing and scaling).
+ *   - Ports of the library's stock AudioCalcEnvelope_F32, AudioCalcGainWDRC_F32 (BTNRH
+ *     WDRC_circuit_gain, with the library's log2 polynomial) and AudioFilterBiquad_F32 (direct
+ *     form I), as plain classes rather than nodes, which is all that the shared code needs of them.
+ *   - millis()/micros(), F_CPU and AudioNoInterrupts()/AudioInterrupts() (nothing to hold off on a
+ *     host, as the audio cycle runs in the caller's thread).
+ *   - The Tympan class from HostTympan.h.
+ *
+ */
+
+#include <chrono>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../HostTympan.h"
+
+#ifndef F_CPU
+  #define F_CPU 180000000   // Teensy 3.6 at its default clock
+#endif
+
+#define AUDIO_BLOCK_SAMPLES 128
+#define AUDIO_SAMPLE_RATE_EXACT 44117.64706f
+#define AUDIO_SAMPLE_RATE AUDIO_SAMPLE_RATE_EXACT
+#define MAX_AUDIO_BLOCK_SAMPLES_F32 AUDIO_BLOCK_SAMPLES
+
+typedef float float32_t;
+
+
+// ---------------------------------------------------------------------------------------------
+// time
+
+inline unsigned long micros(void) {
+  static const auto start = std::chrono::steady_clock::now();
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+inline unsigned long millis(void) { return micros() / 1000; }
+
+inline void AudioNoInterrupts(void) {}
+inline void AudioInterrupts(void) {}
+
+
+// ---------------------------------------------------------------------------------------------
+// audio graph
+
+class AudioSettings_F32 {
+  public:
+    AudioSettings_F32(float fs_Hz, int block_size) : sample_rate_Hz(fs_Hz), audio_block_samples(block_size) {}
+    float sample_rate_Hz;
+    int audio_block_samples;
+};
+
+class audio_block_f32_t {
+  public:
+    unsigned char ref_count;
+    unsigned char memory_pool_index;
+    unsigned char reserved1;
+    unsigned char reserved2;
+    float32_t data[MAX_AUDIO_BLOCK_SAMPLES_F32];
+    int fullSize = MAX_AUDIO_BLOCK_SAMPLES_F32;
+    int length = MAX_AUDIO_BLOCK_SAMPLES_F32;
+    float fs_Hz = AUDIO_SAMPLE_RATE;
+    unsigned long id = 0;
+};
+
+class AudioStream {
+  public:
+    AudioStream(unsigned char ninput, void *iqueue) : num_inputs(ninput) {
+      AudioStream **last = &first_update;
+      while (*last) last = &(*last)->next_update;
+      *last = this;
+    }
+
+    virtual ~AudioStream(void) {
+      for (AudioStream **p = &first_update; *p; p = &(*p)->next_update) {
+        if (*p == this) {
+          *p = next_update;
+          break;
+        }
+      }
+    }
+
+    virtual void update(void) = 0;
+
+    // One audio cycle: every connected node, in construction order.
+    static void update_all(void) {
+      auto cycleStart = std::chrono::steady_clock::now();
+      for (AudioStream *p = first_update; p; p = p->next_update) {
+        if (!p->active) continue;
+        auto start = std::chrono::steady_clock::now();
+        p->update();
+        p->cpu_cycles = toCycleCount(std::chrono::steady_clock::now() - start);
+        if (p->cpu_cycles > p->cpu_cycles_max) p->cpu_cycles_max = p->cpu_cycles;
+      }
+      cpu_cycles_total = toCycleCount(std::chrono::steady_clock::now() - cycleStart);
+      if (cpu_cycles_total > cpu_cycles_total_max) cpu_cycles_total_max = cpu_cycles_total;
+    }
+
+    bool isActive(void) { return active; }
+
+    uint16_t cpu_cycles = 0;
+    uint16_t cpu_cycles_max = 0;
+    static inline uint16_t cpu_cycles_total = 0;
+    static inline uint16_t cpu_cycles_total_max = 0;
+
+  protected:
+    bool active = false;
+    unsigned char num_inputs;
+
+  private:
+    AudioStream *next_update = NULL;
+    static inline AudioStream *first_update = NULL;
+
+    // host time -> units of 64 cycles at F_CPU, saturating like the 16-bit counters would
+    template <typename DURATION>
+    static uint16_t toCycleCount(DURATION elapsed) {
+      double cycles = std::chrono::duration<double>(elapsed).count() * F_CPU / 64.0;
+      return cycles > 65535.0 ? 65535 : (uint16_t)cycles;
+    }
+
+    friend class AudioConnection_F32;
+};
+
+class AudioConnection_F32;
+
+class AudioStream_F32 : public AudioStream {
+  public:
+    AudioStream_F32(unsigned char ninput, audio_block_f32_t **iqueue)
+        : AudioStream(ninput, NULL), inputQueue_f32(iqueue) {
+      for (int ii = 0; ii < ninput; ii++) inputQueue_f32[ii] = NULL;
+    }
+
+    AudioStream_F32(unsigned char ninput, audio_block_f32_t **iqueue, const AudioSettings_F32 &settings)
+        : AudioStream_F32(ninput, iqueue) {}
+
+    ~AudioStream_F32(void) {
+      for (int ii = 0; ii < num_inputs; ii++) {
+        if (inputQueue_f32[ii]) release(inputQueue_f32[ii]);
+        inputQueue_f32[ii] = NULL;
+      }
+    }
+
+    static void initialize_f32_memory(audio_block_f32_t *data, unsigned int num) {
+      pool = data;
+      poolSize = num;
+      freeCount = 0;
+      for (unsigned int ii = 0; ii < num; ii++) {
+        data[ii].memory_pool_index = (unsigned char)(ii & 0xff);
+        freeList()[freeCount++] = &data[ii];
+      }
+      f32_memory_used = 0;
+      f32_memory_used_max = 0;
+    }
+
+    static void initialize_f32_memory(audio_block_f32_t *data, unsigned int num, const AudioSettings_F32 &settings) {
+      initialize_f32_memory(data, num);
+      for (unsigned int ii = 0; ii < num; ii++) {
+        data[ii].fs_Hz = settings.sample_rate_Hz;
+        data[ii].length = settings.audio_block_samples;
+      }
+    }
+
+    static audio_block_f32_t *allocate_f32(void) {
+      if (freeCount == 0) return NULL;
+      audio_block_f32_t *block = freeList()[--freeCount];
+      block->ref_count = 1;
+      if (++f32_memory_used > f32_memory_used_max) f32_memory_used_max = f32_memory_used;
+      return block;
+    }
+
+    static void release(audio_block_f32_t *block) {
+      if (!block || block->ref_count == 0) return;
+      if (--block->ref_count == 0) {
+        freeList()[freeCount++] = block;
+        f32_memory_used--;
+      }
+    }
+
+    static inline int f32_memory_used = 0;
+    static inline int f32_memory_used_max = 0;
+
+  protected:
+    void transmit(audio_block_f32_t *block, unsigned char index = 0);
+
+    audio_block_f32_t *receiveReadOnly_f32(unsigned int index = 0) {
+      if (index >= num_inputs) return NULL;
+      audio_block_f32_t *in = inputQueue_f32[index];
+      inputQueue_f32[index] = NULL;
+      return in;
+    }
+
+    audio_block_f32_t *receiveWritable_f32(unsigned int index = 0) {
+      audio_block_f32_t *in = receiveReadOnly_f32(index);
+      if (in && in->ref_count > 1) {
+        audio_block_f32_t *copy = allocate_f32();
+        if (copy) {
+          memcpy(copy->data, in->data, sizeof(copy->data));
+          copy->length = in->length;
+          copy->fs_Hz = in->fs_Hz;
+          copy->id = in->id;
+        }
+        release(in);
+        in = copy;
+      }
+      return in;
+    }
+
+  private:
+    audio_block_f32_t **inputQueue_f32;
+    AudioConnection_F32 *destination_list_f32 = NULL;
+
+    static inline audio_block_f32_t *pool = NULL;
+    static inline unsigned int poolSize = 0;
+    static inline unsigned int freeCount = 0;
+    static audio_block_f32_t **freeList(void) {
+      static audio_block_f32_t *list[256];   // the library indexes its pool with a byte as well
+      return list;
+    }
+
+    friend class AudioConnection_F32;
+};
+
+class AudioConnection_F32 {
+  public:
+    AudioConnection_F32(AudioStream_F32 &source, AudioStream_F32 &destination)
+        : AudioConnection_F32(source, 0, destination, 0) {}
+
+    AudioConnection_F32(AudioStream_F32 &source, unsigned char sourceOutput,
+        AudioStream_F32 &destination, unsigned char destinationInput)
+        : src(source), dst(destination), src_index(sourceOutput), dest_index(destinationInput) {
+      AudioConnection_F32 **last = &src.destination_list_f32;
+      while (*last) last = &(*last)->next_dest;
+      *last = this;
+      src.active = true;
+      dst.active = true;
+    }
+
+    ~AudioConnection_F32(void) {
+      for (AudioConnection_F32 **p = &src.destination_list_f32; *p; p = &(*p)->next_dest) {
+        if (*p == this) {
+          *p = next_dest;
+          break;
+        }
+      }
+    }
+
+  private:
+    AudioStream_F32 &src;
+    AudioStream_F32 &dst;
+    unsigned char src_index;
+    unsigned char dest_index;
+    AudioConnection_F32 *next_dest = NULL;
+
+    friend class AudioStream_F32;
+};
+
+inline void AudioStream_F32::transmit(audio_block_f32_t *block, unsigned char index) {
+  for (AudioConnection_F32 *c = destination_list_f32; c; c = c->next_dest) {
+    if (c->src_index != index) continue;
+    // as in the library, a block that arrives at an input that is still full is dropped
+    if (c->dst.inputQueue_f32[c->dest_index] == NULL) {
+      c->dst.inputQueue_f32[c->dest_index] = block;
+      block->ref_count++;
+    }
+  }
+}
+
+#define AudioMemory_F32(num, ...) ({ \
+  static audio_block_f32_t data_f32[num]; \
+  AudioStream_F32::initialize_f32_memory(data_f32, num, ##__VA_ARGS__); \
+})
+
+inline int AudioMemoryUsage_F32(void) { return AudioStream_F32::f32_memory_used; }
+inline int AudioMemoryUsageMax_F32(void) { return AudioStream_F32::f32_memory_used_max; }
+inline void AudioMemoryUsageMaxReset_F32(void) { AudioStream_F32::f32_memory_used_max = AudioStream_F32::f32_memory_used; }
+
+// Codec stand-ins: the host hands each cycle's input to hostWrite() before update_all() and
+// collects the output with hostRead() after it.
+class AudioInputI2S_F32 : public AudioStream_F32 {
+  public:
+    AudioInputI2S_F32(void) : AudioStream_F32(0, NULL) {}
+    AudioInputI2S_F32(const AudioSettings_F32 &settings)
+        : AudioStream_F32(0, NULL), fs_Hz(settings.sample_rate_Hz), blockSize(settings.audio_block_samples) {}
+
+    // one block per channel for the next cycle (right may be NULL for a copy of left)
+    void hostWrite(const float32_t *left, const float32_t *right) {
+      memcpy(pending[0], left, blockSize * sizeof(float32_t));
+      memcpy(pending[1], right ? right : left, blockSize * sizeof(float32_t));
+      havePending = true;
+    }
+
+    void update(void) {
+      if (!havePending) return;
+      havePending = false;
+      for (int ch = 0; ch < 2; ch++) {
+        audio_block_f32_t *block = allocate_f32();
+        if (!block) continue;
+        memcpy(block->data, pending[ch], blockSize * sizeof(float32_t));
+        block->length = blockSize;
+        block->fs_Hz = fs_Hz;
+        block->id = blockId;
+        transmit(block, ch);
+        release(block);
+      }
+      blockId++;
+    }
+
+  private:
+    float fs_Hz = AUDIO_SAMPLE_RATE;
+    int blockSize = AUDIO_BLOCK_SAMPLES;
+    float32_t pending[2][MAX_AUDIO_BLOCK_SAMPLES_F32];
+    bool havePending = false;
+    unsigned long blockId = 0;
+};
+
+class AudioOutputI2S_F32 : public AudioStream_F32 {
+  public:
+    AudioOutputI2S_F32(void) : AudioStream_F32(2, inputQueueArray) {}
+    AudioOutputI2S_F32(const AudioSettings_F32 &settings)
+        : AudioStream_F32(2, inputQueueArray), blockSize(settings.audio_block_samples) {}
+
+    // the block a channel received in the last cycle, NULL if there was none (i.e. silence)
+    const float32_t *hostRead(int channel) { return received[channel] ? played[channel] : NULL; }
+
+    void update(void) {
+      for (int ch = 0; ch < 2; ch++) {
+        audio_block_f32_t *block = receiveReadOnly_f32(ch);
+        received[ch] = block != NULL;
+        if (!block) continue;
+        memcpy(played[ch], block->data, blockSize * sizeof(float32_t));
+        release(block);
+      }
+    }
+
+  private:
+    audio_block_f32_t *inputQueueArray[2];
+    int blockSize = AUDIO_BLOCK_SAMPLES;
+    float32_t played[2][MAX_AUDIO_BLOCK_SAMPLES_F32];
+    bool received[2] = { false, false };
+};
+
+
+// ---------------------------------------------------------------------------------------------
+// CMSIS-DSP
+
+typedef enum {
+  ARM_MATH_SUCCESS = 0,
+  ARM_MATH_ARGUMENT_ERROR = -1
+} arm_status;
+
+inline void arm_mult_f32(const float32_t *a, const float32_t *b, float32_t *dst, uint32_t n) {
+  for (uint32_t ii = 0; ii < n; ii++) dst[ii] = a[ii] * b[ii];
+}
+
+inline void arm_add_f32(const float32_t *a, const float32_t *b, float32_t *dst, uint32_t n) {
+  for (uint32_t ii = 0; ii < n; ii++) dst[ii] = a[ii] + b[ii];
+}
+
+inline void arm_sub_f32(const float32_t *a, const float32_t *b, float32_t *dst, uint32_t n) {
+  for (uint32_t ii = 0; ii < n; ii++) dst[ii] = a[ii] - b[ii];
+}
+
+inline void arm_scale_f32(const float32_t *src, float32_t scale, float32_t *dst, uint32_t n) {
+  for (uint32_t ii = 0; ii < n; ii++) dst[ii] = src[ii] * scale;
+}
+
+inline void arm_offset_f32(const float32_t *src, float32_t offset, float32_t *dst, uint32_t n) {
+  for (uint32_t ii = 0; ii < n; ii++) dst[ii] = src[ii] + offset;
+}
+
+inline void arm_abs_f32(const float32_t *src, float32_t *dst, uint32_t n) {
+  for (uint32_t ii = 0; ii < n; ii++) dst[ii] = fabsf(src[ii]);
+}
+
+inline void arm_copy_f32(const float32_t *src, float32_t *dst, uint32_t n) {
+  memmove(dst, src, n * sizeof(float32_t));
+}
+
+inline void arm_fill_f32(float32_t value, float32_t *dst, uint32_t n) {
+  for (uint32_t ii = 0; ii < n; ii++) dst[ii] = value;
+}
+
+inline void arm_dot_prod_f32(const float32_t *a, const float32_t *b, uint32_t n, float32_t *result) {
+  float32_t sum = 0.0f;
+  for (uint32_t ii = 0; ii < n; ii++) sum += a[ii] * b[ii];
+  *result = sum;
+}
+
+inline void arm_cmplx_mag_squared_f32(const float32_t *src, float32_t *dst, uint32_t n) {
+  for (uint32_t ii = 0; ii < n; ii++) dst[ii] = src[2 * ii] * src[2 * ii] + src[2 * ii + 1] * src[2 * ii + 1];
+}
+
+// Real FFT, same packing and scaling as CMSIS: the forward transform is unscaled and packs the
+// (real) DC and Nyquist bins into out[0] and out[1], followed by re/im pairs for bins 1 to N/2 - 1;
+// the inverse takes that layout back and scales by 1/N. Both may overwrite their input.
+typedef struct {
+  uint16_t fftLenRFFT;
+  float32_t *twiddle;   // cos/sin pairs for the N-point complex transform
+  float32_t *work;      // 2N floats
+} arm_rfft_fast_instance_f32;
+
+inline arm_status arm_rfft_fast_init_f32(arm_rfft_fast_instance_f32 *S, uint16_t fftLen) {
+  if (fftLen < 32 || fftLen > 4096 || (fftLen & (fftLen - 1))) return ARM_MATH_ARGUMENT_ERROR;
+  S->fftLenRFFT = fftLen;
+  // kept for the life of the program, like the library's constant tables
+  S->twiddle = (float32_t *)malloc(fftLen * sizeof(float32_t));
+  S->work = (float32_t *)malloc(2 * fftLen * sizeof(float32_t));
+  if (!S->twiddle || !S->work) return ARM_MATH_ARGUMENT_ERROR;
+  for (int ii = 0; ii < fftLen / 2; ii++) {
+    S->twiddle[2 * ii] = (float32_t)cos(2.0 * M_PI * ii / fftLen);
+    S->twiddle[2 * ii + 1] = (float32_t)sin(2.0 * M_PI * ii / fftLen);
+  }
+  return ARM_MATH_SUCCESS;
+}
+
+// in-place radix-2 complex FFT of interleaved re/im data; sign -1 forward, +1 inverse (unscaled)
+inline void arm_host_cfft(const arm_rfft_fast_instance_f32 *S, float32_t *x, int sign) {
+  int n = S->fftLenRFFT;
+  for (int ii = 1, jj = 0; ii < n; ii++) {
+    int bit = n >> 1;
+    for (; jj & bit; bit >>= 1) jj ^= bit;
+    jj ^= bit;
+    if (ii < jj) {
+      float32_t t;
+      t = x[2 * ii]; x[2 * ii] = x[2 * jj]; x[2 * jj] = t;
+      t = x[2 * ii + 1]; x[2 * ii + 1] = x[2 * jj + 1]; x[2 * jj + 1] = t;
+    }
+  }
+  for (int len = 2; len <= n; len <<= 1) {
+    int step = n / len;
+    for (int start = 0; start < n; start += len) {
+      for (int kk = 0; kk < len / 2; kk++) {
+        float32_t wr = S->twiddle[2 * kk * step];
+        float32_t wi = sign * S->twiddle[2 * kk * step + 1];
+        float32_t *a = &x[2 * (start + kk)];
+        float32_t *b = &x[2 * (start + kk + len / 2)];
+        float32_t br = b[0] * wr - b[1] * wi;
+        float32_t bi = b[0] * wi + b[1] * wr;
+        b[0] = a[0] - br;
+        b[1] = a[1] - bi;
+        a[0] += br;
+        a[1] += bi;
+      }
+    }
+  }
+}
+
+inline void arm_rfft_fast_f32(arm_rfft_fast_instance_f32 *S, float32_t *p, float32_t *pOut, uint8_t ifftFlag) {
+  int n = S->fftLenRFFT;
+  float32_t *x = S->work;
+  if (!ifftFlag) {
+    for (int ii = 0; ii < n; ii++) {
+      x[2 * ii] = p[ii];
+      x[2 * ii + 1] = 0.0f;
+    }
+    arm_host_cfft(S, x, -1);
+    pOut[0] = x[0];
+    pOut[1] = x[n];
+    for (int kk = 1; kk < n / 2; kk++) {
+      pOut[2 * kk] = x[2 * kk];
+      pOut[2 * kk + 1] = x[2 * kk + 1];
+    }
+  } else {
+    x[0] = p[0];
+    x[1] = 0.0f;
+    x[n] = p[1];
+    x[n + 1] = 0.0f;
+    for (int kk = 1; kk < n / 2; kk++) {
+      x[2 * kk] = p[2 * kk];
+      x[2 * kk + 1] = p[2 * kk + 1];
+      x[2 * (n - kk)] = p[2 * kk];
+      x[2 * (n - kk) + 1] = -p[2 * kk + 1];
+    }
+    arm_host_cfft(S, x, 1);
+    for (int ii = 0; ii < n; ii++) pOut[ii] = x[2 * ii] / n;
+  }
+}
+
+// Direct form I biquad cascade; coefficients per stage are {b0, b1, b2, a1, a2} with the feedback
+// terms negated (y = b0 x0 + b1 x1 + b2 x2 + a1 y1 + a2 y2), state is 4 floats per stage.
+typedef struct {
+  uint32_t numStages;
+  float32_t *pState;
+  const float32_t *pCoeffs;
+} arm_biquad_casd_df1_inst_f32;
+
+inline void arm_biquad_cascade_df1_init_f32(arm_biquad_casd_df1_inst_f32 *S, uint8_t numStages,
+    const float32_t *pCoeffs, float32_t *pState) {
+  S->numStages = numStages;
+  S->pCoeffs = pCoeffs;
+  S->pState = pState;
+  memset(pState, 0, 4 * numStages * sizeof(float32_t));
+}
+
+inline void arm_biquad_cascade_df1_f32(const arm_biquad_casd_df1_inst_f32 *S, const float32_t *pSrc,
+    float32_t *pDst, uint32_t blockSize) {
+  const float32_t *in = pSrc;
+  for (uint32_t stage = 0; stage < S->numStages; stage++) {
+    const float32_t *c = &S->pCoeffs[5 * stage];
+    float32_t *s = &S->pState[4 * stage];
+    float32_t x1 = s[0], x2 = s[1], y1 = s[2], y2 = s[3];
+    for (uint32_t ii = 0; ii < blockSize; ii++) {
+      float32_t x0 = in[ii];
+      float32_t y0 = c[0] * x0 + c[1] * x1 + c[2] * x2 + c[3] * y1 + c[4] * y2;
+      x2 = x1; x1 = x0;
+      y2 = y1; y1 = y0;
+      pDst[ii] = y0;
+    }
+    s[0] = x1; s[1] = x2; s[2] = y1; s[3] = y2;
+    in = pDst;
+  }
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// library algorithms
+
+namespace BTNRH_WDRC {
+  typedef struct {
+    float attack;        // attack time (ms)
+    float release;       // release time (ms)
+    float fs;            // sampling rate (Hz)
+    float maxdB;         // maximum signal (dB SPL)
+    float exp_cr;        // compression ratio for low-SPL region (ie, the expander)
+    float exp_end_knee;  // expansion-end kneepoint
+    float tkgain;        // compression-start gain
+    float tk;            // compression-start kneepoint
+    float cr;            // compression ratio
+    float bolt;          // broadband output limiting threshold
+  } CHA_WDRC;
+}
+
+class AudioCalcEnvelope_F32 {
+  public:
+    AudioCalcEnvelope_F32(void) { setAttackRelease_msec(5.0f, 300.0f); }
+
+    void setSampleRate_Hz(const float fs_Hz) {
+      sample_rate_Hz = fs_Hz;
+      setAttackRelease_msec(given_attack_msec, given_release_msec);
+    }
+
+    void setAttackRelease_msec(const float atk_msec, const float rel_msec) {
+      given_attack_msec = atk_msec;
+      given_release_msec = rel_msec;
+      float ansi_atk = 0.001f * atk_msec * sample_rate_Hz / 2.425f;
+      float ansi_rel = 0.001f * rel_msec * sample_rate_Hz / 1.782f;
+      alfa = ansi_atk / (1.0f + ansi_atk);
+      beta = ansi_rel / (10.0f + ansi_rel);
+    }
+
+    void smooth_env(float x[], float y[], int n) {
+      float xab, xpk = state_ppk;
+      for (int k = 0; k < n; k++) {
+        xab = (x[k] >= 0.0f) ? x[k] : -x[k];
+        if (xab >= xpk) {
+          xpk = alfa * xpk + (1.0f - alfa) * xab;
+        } else {
+          xpk = beta * xpk;
+        }
+        y[k] = xpk;
+      }
+      state_ppk = xpk;
+    }
+
+  private:
+    float sample_rate_Hz = AUDIO_SAMPLE_RATE;
+    float given_attack_msec, given_release_msec;
+    float alfa, beta;
+    float state_ppk = 0.0f;
+};
+
+class AudioCalcGainWDRC_F32 {
+  public:
+    AudioCalcGainWDRC_F32(void) { setParams(119.0f, 1.0f, 0.0f, 0.0f, 105.0f, 1.0f, 105.0f); }
+
+    void setParams_from_CHA_WDRC(BTNRH_WDRC::CHA_WDRC *gha) {
+      setParams(gha->maxdB, gha->exp_cr, gha->exp_end_knee, gha->tkgain, gha->tk, gha->cr, gha->bolt);
+    }
+
+    void setParams(float maxdB, float exp_cr, float exp_end_knee, float tkgain, float tk, float cr, float bolt) {
+      this->maxdB = maxdB;
+      this->exp_cr = exp_cr;
+      this->exp_end_knee = exp_end_knee;
+      this->tkgain = tkgain;
+      this->tk = tk;
+      this->cr = cr;
+      this->bolt = bolt;
+    }
+
+    void calcGainFromEnvelope(float *env, float *gain_out, const int n) {
+      for (int k = 0; k < n; k++) {
+        gain_out[k] = WDRC_circuit_gain(env[k], exp_cr, exp_end_knee, tk, tkgain, cr, bolt);
+      }
+    }
+
+    float WDRC_circuit_gain(float env, float exp_cr, float exp_end_knee, float tk, float tkgain, float cr, float bolt) {
+      float gdb, tkgo, pblt;
+      if ((tk + tkgain) > bolt) tk = bolt - tkgain;
+      tkgo = tkgain + tk * (1.0f - 1.0f / cr);
+      pblt = cr * (bolt - tkgo);
+      const float cr_const = (1.0f / cr) - 1.0f;
+      float gain_at_exp_end_knee = tkgain;
+      if (tk < exp_end_knee) gain_at_exp_end_knee = cr_const * exp_end_knee + tkgo;
+      const float exp_cr_const = 1.0f / (exp_cr > 0.01f ? exp_cr : 0.01f) - 1.0f;
+
+      float pdb = db2(env) + maxdB;
+      if (pdb < exp_end_knee) {
+        gdb = gain_at_exp_end_knee - ((exp_end_knee - pdb) * exp_cr_const);
+      } else if ((pdb < tk) && (cr >= 1.0f)) {
+        gdb = tkgain;
+      } else if (pdb > pblt) {
+        gdb = bolt + ((pdb - pblt) / 10.0f) - pdb;
+      } else {
+        gdb = cr_const * pdb + tkgo;
+      }
+      return undb2(gdb);
+    }
+
+    static float undb2(const float x) { return expf(0.11512925464970228420089957273422f * x); }
+    static float db2(const float x) { return 6.020599913279624f * log2f_approx(x); }
+
+    static float log2f_approx(float X) {
+      float Y, F;
+      int E;
+      F = frexpf(fabsf(X), &E);
+      Y = 1.23149591368684f;
+      Y *= F;
+      Y += -4.11852516267426f;
+      Y *= F;
+      Y += 6.02197014179219f;
+      Y *= F;
+      Y += -3.13396450166353f;
+      Y += E;
+      return Y;
+    }
+
+  private:
+    float maxdB, exp_cr, exp_end_knee, tkgain, tk, cr, bolt;
+};
+
+// One biquad, direct form I, coefficients from the RBJ cookbook (as the library does it)
+class AudioFilterBiquad_F32 : public AudioStream_F32 {
+  public:
+    AudioFilterBiquad_F32(void) : AudioStream_F32(1, inputQueueArray) { init(); }
+    AudioFilterBiquad_F32(const AudioSettings_F32 &settings)
+        : AudioStream_F32(1, inputQueueArray), sampleRate_Hz(settings.sample_rate_Hz) { init(); }
+
+    void setSampleRate_Hz(float fs_Hz) { sampleRate_Hz = fs_Hz; }
+
+    // b[3] and a[3] as Matlab gives them (a[0] == 1)
+    int setFilterCoeff_Matlab(float32_t b[], float32_t a[]) {
+      float32_t c[5] = { b[0], b[1], b[2], -a[1], -a[2] };
+      setCoefficients(c);
+      return 0;
+    }
+
+    void setLowpass(uint32_t stage, float frequency, float q = 0.7071f) {
+      double w0 = frequency * (2.0 * M_PI / sampleRate_Hz);
+      double sinW0 = sin(w0), cosW0 = cos(w0);
+      double alpha = sinW0 / (q * 2.0);
+      double scale = 1.0 / (1.0 + alpha);
+      float32_t c[5] = {
+        (float32_t)((1.0 - cosW0) / 2.0 * scale), (float32_t)((1.0 - cosW0) * scale), (float32_t)((1.0 - cosW0) / 2.0 * scale),
+        (float32_t)(2.0 * cosW0 * scale), (float32_t)((alpha - 1.0) * scale)
+      };
+      setCoefficients(c);
+    }
+
+    void setHighpass(uint32_t stage, float frequency, float q = 0.7071f) {
+      double w0 = frequency * (2.0 * M_PI / sampleRate_Hz);
+      double sinW0 = sin(w0), cosW0 = cos(w0);
+      double alpha = sinW0 / (q * 2.0);
+      double scale = 1.0 / (1.0 + alpha);
+      float32_t c[5] = {
+        (float32_t)((1.0 + cosW0) / 2.0 * scale), (float32_t)(-(1.0 + cosW0) * scale), (float32_t)((1.0 + cosW0) / 2.0 * scale),
+        (float32_t)(2.0 * cosW0 * scale), (float32_t)((alpha - 1.0) * scale)
+      };
+      setCoefficients(c);
+    }
+
+    void setBandpass(uint32_t stage, float frequency, float q = 1.0f) {
+      double w0 = frequency * (2.0 * M_PI / sampleRate_Hz);
+      double sinW0 = sin(w0), cosW0 = cos(w0);
+      double alpha = sinW0 / (q * 2.0);
+      double scale = 1.0 / (1.0 + alpha);
+      float32_t c[5] = {
+        (float32_t)(alpha * scale), 0.0f, (float32_t)(-alpha * scale),
+        (float32_t)(2.0 * cosW0 * scale), (float32_t)((alpha - 1.0) * scale)
+      };
+      setCoefficients(c);
+    }
+
+    void update(void) {
+      audio_block_f32_t *block = receiveWritable_f32();
+      if (!block) return;
+      arm_biquad_cascade_df1_f32(&iir_inst, block->data, block->data, block->length);
+      transmit(block);
+      release(block);
+    }
+
+  private:
+    audio_block_f32_t *inputQueueArray[1];
+    float sampleRate_Hz = AUDIO_SAMPLE_RATE;
+    float32_t coeff[5];
+    float32_t state[4];
+    arm_biquad_casd_df1_inst_f32 iir_inst;
+
+    void init(void) {
+      float32_t passThrough[5] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+      setCoefficients(passThrough);
+    }
+
+    void setCoefficients(const float32_t *c) {
+      memcpy(coeff, c, sizeof(coeff));
+      arm_biquad_cascade_df1_init_f32(&iir_inst, 1, coeff, state);
+    }
+};
+
+#endif
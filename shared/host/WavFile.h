@@ -0,0 +1,136 @@
+#ifndef _WavFile_h
+#define _WavFile_h
+
+/*
+ *
+ * Minimal WAV reading and writing for the host tools and tests.
+ *
+ * Reads 16-, 24- and 32-bit integer PCM and 32-bit float files with any number of channels into
+ * interleaved floats (full scale = 1.0); writes 32-bit float files, so that nothing a test
+ * produces is clipped or quantised on the way out. Other chunks (LIST, fact, ...) are skipped.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+class WavFile {
+  public:
+    int channels = 0;
+    float sampleRate_Hz = 0.0f;
+    std::vector<float> samples;   // interleaved
+
+    int frames(void) const { return channels ? (int)(samples.size() / channels) : 0; }
+
+    // one channel, de-interleaved
+    std::vector<float> channel(int ch) const {
+      std::vector<float> out(frames());
+      for (int ii = 0; ii < frames(); ii++) out[ii] = samples[ii * channels + ch];
+      return out;
+    }
+
+    bool read(const char *path) {
+      FILE *file = fopen(path, "rb");
+      if (!file) return false;
+      bool ok = readFrom(file);
+      fclose(file);
+      return ok;
+    }
+
+    bool write(const char *path) const {
+      FILE *file = fopen(path, "wb");
+      if (!file) return false;
+      uint32_t dataBytes = (uint32_t)(samples.size() * sizeof(float));
+      bool ok = fwrite("RIFF", 1, 4, file) == 4
+          && put32(file, 36 + dataBytes)
+          && fwrite("WAVEfmt ", 1, 8, file) == 8
+          && put32(file, 16)
+          && put16(file, 3)   // IEEE float
+          && put16(file, channels)
+          && put32(file, (uint32_t)sampleRate_Hz)
+          && put32(file, (uint32_t)sampleRate_Hz * channels * sizeof(float))
+          && put16(file, channels * sizeof(float))
+          && put16(file, 32)
+          && fwrite("data", 1, 4, file) == 4
+          && put32(file, dataBytes)
+          && fwrite(samples.data(), sizeof(float), samples.size(), file) == samples.size();
+      fclose(file);
+      return ok;
+    }
+
+  private:
+    bool readFrom(FILE *file) {
+      char id[4];
+      uint32_t size;
+      if (fread(id, 1, 4, file) != 4 || memcmp(id, "RIFF", 4)) return false;
+      if (!get32(file, &size) || fread(id, 1, 4, file) != 4 || memcmp(id, "WAVE", 4)) return false;
+      int format = 0, bits = 0;
+      while (fread(id, 1, 4, file) == 4 && get32(file, &size)) {
+        if (!memcmp(id, "fmt ", 4)) {
+          uint8_t fmt[16];
+          if (size < 16 || fread(fmt, 1, 16, file) != 16) return false;
+          format = fmt[0] | (fmt[1] << 8);
+          channels = fmt[2] | (fmt[3] << 8);
+          sampleRate_Hz = (float)(fmt[4] | (fmt[5] << 8) | (fmt[6] << 16) | ((uint32_t)fmt[7] << 24));
+          bits = fmt[14] | (fmt[15] << 8);
+          if (format == 0xFFFE && size >= 26) {   // WAVE_FORMAT_EXTENSIBLE: the sub-format says which
+            uint8_t ext[10];
+            if (fread(ext, 1, 10, file) != 10) return false;
+            format = ext[8] | (ext[9] << 8);
+            size -= 10;
+          }
+          fseek(file, (size - 16) + (size & 1), SEEK_CUR);
+        } else if (!memcmp(id, "data", 4)) {
+          return readData(file, size, format, bits);
+        } else {
+          fseek(file, size + (size & 1), SEEK_CUR);
+        }
+      }
+      return false;
+    }
+
+    bool readData(FILE *file, uint32_t size, int format, int bits) {
+      if (channels < 1) return false;
+      int bytes = bits / 8;
+      bool pcm = (format == 1) && (bits == 16 || bits == 24 || bits == 32);
+      bool ieee = (format == 3) && (bits == 32);
+      if (!pcm && !ieee) return false;
+      std::vector<uint8_t> raw(size);
+      size = (uint32_t)fread(raw.data(), 1, size, file);
+      size_t count = size / bytes;
+      samples.resize(count - count % channels);
+      for (size_t ii = 0; ii < samples.size(); ii++) {
+        const uint8_t *p = &raw[ii * bytes];
+        if (ieee) {
+          memcpy(&samples[ii], p, sizeof(float));
+        } else {
+          int32_t value = 0;
+          for (int bb = 0; bb < bytes; bb++) value |= (int32_t)((uint32_t)p[bb] << (8 * (4 - bytes + bb)));
+          samples[ii] = value * (1.0f / 2147483648.0f);   // left-aligned in 32 bits, so one scale fits all
+        }
+      }
+      return true;
+    }
+
+    static bool get32(FILE *file, uint32_t *value) {
+      uint8_t b[4];
+      if (fread(b, 1, 4, file) != 4) return false;
+      *value = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+      return true;
+    }
+
+    static bool put16(FILE *file, int value) {
+      uint8_t b[2] = { (uint8_t)value, (uint8_t)(value >> 8) };
+      return fwrite(b, 1, 2, file) == 2;
+    }
+
+    static bool put32(FILE *file, uint32_t value) {
+      uint8_t b[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+      return fwrite(b, 1, 4, file) == 4;
+    }
+};
+
+#endif
@@ -0,0 +1,201 @@
+/*
+  evWDRC_Offline
+
+  Purpose: Runs a WAV file through the same chain as the WDRC_SingleBand sketch (high-pass,
+    feedback canceller, noise reduction, stereo WDRC, lookahead limiter), on a development
+    machine, and writes the result to another WAV file. Useful for listening to a fitting, for
+    comparing versions of the processing sample by sample, and for timing it.
+
+    The chain is built from the same shared nodes, on the host stand-in for the audio library
+    (shared/host), with the sketch's default settings. The feedback canceller's loopback is wired
+    as on the Tympan, but there is no acoustic path here, so it just has nothing to cancel.
+
+  Build and run (PlatformIO "native" environment):
+    pio run -e native
+    .pio/build/native/program in.wav out.wav [--independent] [--block <samples>]
+
+    A mono file is played to both ears; the output is always stereo (32-bit float). The sample
+    rate is taken from the input file.
+
+  Report: the time the processing took against the length of the audio (the realtime factor,
+    below 1 means faster than realtime on this machine) and the mean time per block of every
+    node, from AudioProfiler_F32.
+
+   MIT License.  use at your own risk.
+*/
+
+#include <Tympan_Library.h>
+#include <chrono>
+#include "../../shared/AudioEffectCompWDRCStereo_F32.h"
+#include "../../shared/AudioEffectLookaheadLimiter_F32.h"
+#include "../../shared/AudioFilterBiquadCascade_F32.h"
+#include "../../shared/FilterDesign.h"
+#include "../../shared/AudioEffectFeedbackCancel_F32.h"
+#include "../../shared/AudioEffectNoiseReduction_F32.h"
+#include "../../shared/AudioProfiler_F32.h"
+#include "../../shared/host/HostAudio.h"
+#include "../../shared/host/WavFile.h"
+
+#define LEFT_EAR  0
+#define RIGHT_EAR 1
+
+Tympan myTympan;
+
+//the sketch's defaults (see src/evWDRC_SingleBand.cpp)...keep these in step with it
+const float limiterLookahead_msec = 2.0f;
+const float limiterRelease_msec = 50.0f;
+const int noiseReduction_fft_size = 256;
+const float hpCorner_Hz = 750.0f;
+const int hpOrder = 2;
+const float afcStepSize = 0.002f;
+const int afcTaps = 64;
+const float compRamp_msec = 20.0f;
+
+BTNRH_WDRC::CHA_WDRC gha = {
+  1.0f, // attack time (ms)
+  50.0f,     // release time (ms)
+  44117.0f,  // fs, sampling rate (Hz)...replaced by the file's
+  119.0f,    // maxdB, maximum signal (dB SPL)
+  0.1f,      // compression ratio for lowest-SPL region (ie, the expansion region)
+  40.0f,      // expansion ending kneepoint (see small to defeat the expansion)
+  0.0f,      // tkgain, compression-start gain
+  105.0f,    // tk, compression-start kneepoint
+  1.0f,     // cr, compression ratio
+  105.0f     // bolt, broadband output limiting threshold
+};
+
+int usage(const char *program) {
+  fprintf(stderr, "usage: %s <in.wav> <out.wav> [--independent] [--block <samples>]\n", program);
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  const char *inPath = NULL, *outPath = NULL;
+  bool linked = true;
+  int blockSize = AUDIO_BLOCK_SAMPLES;
+  for (int ii = 1; ii < argc; ii++) {
+    if (!strcmp(argv[ii], "--independent")) linked = false;
+    else if (!strcmp(argv[ii], "--block") && ii + 1 < argc) blockSize = atoi(argv[++ii]);
+    else if (!inPath) inPath = argv[ii];
+    else if (!outPath) outPath = argv[ii];
+    else return usage(argv[0]);
+  }
+  if (!inPath || !outPath) return usage(argv[0]);
+  if (blockSize < 8 || blockSize > MAX_AUDIO_BLOCK_SAMPLES_F32) {
+    fprintf(stderr, "block size must be between 8 and %i\n", MAX_AUDIO_BLOCK_SAMPLES_F32);
+    return 2;
+  }
+
+  WavFile in;
+  if (!in.read(inPath)) {
+    fprintf(stderr, "unable to read %s (16/24/32-bit PCM or 32-bit float WAV)\n", inPath);
+    return 1;
+  }
+  float fs_Hz = in.sampleRate_Hz;
+  gha.fs = fs_Hz;
+  std::vector<float> left = in.channel(0);
+  std::vector<float> right = in.channel(in.channels > 1 ? 1 : 0);
+  int frames = in.frames();
+  int paddedFrames = (frames + blockSize - 1) / blockSize * blockSize;
+  left.resize(paddedFrames, 0.0f);
+  right.resize(paddedFrames, 0.0f);
+
+  //the same graph as the sketch, minus the health monitor
+  AudioSettings_F32 audio_settings(fs_Hz, blockSize);
+  AudioInputI2S_F32 i2s_in(audio_settings);
+  AudioFilterBiquadCascade_F32 iirL, iirR;
+  AudioEffectFeedbackCancel_F32 afcL(audio_settings), afcR(audio_settings);
+  AudioEffectNoiseReduction_F32 noiseReductionL, noiseReductionR;
+  AudioEffectCompWDRCStereo_F32 compWDRC;
+  AudioEffectLookaheadLimiterStereo_F32 limiter;
+  AudioOutputI2S_F32 i2s_out(audio_settings);
+  AudioProfiler_F32 profiler;
+  AudioConnection_F32 patchCord1(i2s_in, 0, iirL, 0);
+  AudioConnection_F32 patchCord2(i2s_in, 1, iirR, 0);
+  AudioConnection_F32 patchCord3(iirL, 0, afcL, 0);
+  AudioConnection_F32 patchCord4(iirR, 0, afcR, 0);
+  AudioConnection_F32 patchCord5(afcL, 0, noiseReductionL, 0);
+  AudioConnection_F32 patchCord6(afcR, 0, noiseReductionR, 0);
+  AudioConnection_F32 patchCord7(noiseReductionL, 0, compWDRC, LEFT_EAR);
+  AudioConnection_F32 patchCord8(noiseReductionR, 0, compWDRC, RIGHT_EAR);
+  AudioConnection_F32 patchCord9(compWDRC, LEFT_EAR, limiter, LEFT_EAR);
+  AudioConnection_F32 patchCord10(compWDRC, RIGHT_EAR, limiter, RIGHT_EAR);
+  AudioConnection_F32 patchCord11(limiter, LEFT_EAR, i2s_out, 0);
+  AudioConnection_F32 patchCord12(limiter, RIGHT_EAR, i2s_out, 1);
+  AudioConnection_F32 patchCord13(limiter, LEFT_EAR, afcL, 1);
+  AudioConnection_F32 patchCord14(limiter, RIGHT_EAR, afcR, 1);
+  AudioConnection_F32 patchCord15(limiter, LEFT_EAR, profiler, 0);
+  AudioMemory_F32(40, audio_settings);
+
+  if (!noiseReductionL.setup(noiseReduction_fft_size, blockSize, fs_Hz)
+      || !noiseReductionR.setup(noiseReduction_fft_size, blockSize, fs_Hz)) {
+    fprintf(stderr, "Unable to set up the noise reduction, passing audio through it untouched\n");
+  }
+  ButterworthDesign hpDesign;
+  float coeffs[5 * FILTER_DESIGN_MAX_SECTIONS];
+  int nSections = hpDesign.design(FilterHighpass, hpCorner_Hz, fs_Hz, hpOrder, coeffs);
+  iirL.setCoefficients(nSections, coeffs);
+  iirR.setCoefficients(nSections, coeffs);
+  compWDRC.setRampTime_msec(compRamp_msec);
+  compWDRC.setLinked(linked);
+  limiter.setLinked(linked);
+  for (int ear = LEFT_EAR; ear <= RIGHT_EAR; ear++) {
+    compWDRC.publishParams(ear, &gha);
+    compWDRC.publishDetector(ear, DetectorPeak, 5.0f);
+    limiter.publishParams(ear, &gha, limiterLookahead_msec, limiterRelease_msec);
+  }
+  afcL.publishParams(afcStepSize, afcTaps, blockSize);   //the round trip of two blocks, less the loopback's one
+  afcR.publishParams(afcStepSize, afcTaps, blockSize);
+  noiseReductionL.publishParams(&gha);
+  noiseReductionR.publishParams(&gha);
+
+  profiler.addNode(&i2s_in, "i2s_in");
+  profiler.addNode(&iirL, "iirL");
+  profiler.addNode(&iirR, "iirR");
+  profiler.addNode(&afcL, "afcL");
+  profiler.addNode(&afcR, "afcR");
+  profiler.addNode(&noiseReductionL, "noiseReductionL");
+  profiler.addNode(&noiseReductionR, "noiseReductionR");
+  profiler.addNode(&compWDRC, "compWDRC");
+  profiler.addNode(&limiter, "limiter");
+  profiler.addNode(&i2s_out, "i2s_out");
+
+  WavFile out;
+  out.channels = 2;
+  out.sampleRate_Hz = fs_Hz;
+  out.samples.resize(2 * paddedFrames);
+  std::vector<float> outLeft(paddedFrames), outRight(paddedFrames);
+
+  auto start = std::chrono::steady_clock::now();
+  HostAudio::process(i2s_in, i2s_out, blockSize, left.data(), right.data(), outLeft.data(), outRight.data(), paddedFrames);
+  double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  for (int ii = 0; ii < paddedFrames; ii++) {
+    out.samples[2 * ii] = outLeft[ii];
+    out.samples[2 * ii + 1] = outRight[ii];
+  }
+  out.samples.resize(2 * frames);
+  if (!out.write(outPath)) {
+    fprintf(stderr, "unable to write %s\n", outPath);
+    return 1;
+  }
+
+  double audio_s = frames / fs_Hz;
+  printf("%s: %i frames at %.0f Hz, %s, block size %i, latency %i samples\n", inPath, frames, fs_Hz,
+      linked ? "linked" : "independent", blockSize,
+      limiter.getLatency_samples() + noiseReductionL.getLatency_samples());
+  printf("processed %.3f s of audio in %.3f s: realtime factor %.4f (%.0fx realtime)\n",
+      audio_s, elapsed_s, elapsed_s / audio_s, audio_s / elapsed_s);
+
+  AUDIO_PROFILE profile;
+  profiler.getSnapshot(&profile);
+  float blockPeriod_us = 1e6f * blockSize / fs_Hz;
+  printf("mean time per block (block period %.0f us):\n", blockPeriod_us);
+  for (int ii = 0; ii < profile.nodeCount; ii++) {
+    float mean_us = profile.nodes[ii].mean_cycles / (F_CPU / 1e6f);
+    printf("  %-16s %8.2f us  %5.2f%%\n", profile.nodes[ii].name, mean_us, 100.0f * mean_us / blockPeriod_us);
+  }
+  float overhead_us = profile.mean_overhead_cycles / (F_CPU / 1e6f);
+  printf("  %-16s %8.2f us  %5.2f%%\n", "(fixed per block)", overhead_us, 100.0f * overhead_us / blockPeriod_us);
+  return 0;
+}
@@ -7,7 +7,16 @@
 
   Purpose: Implements BTNRH's Wide Dynamic Range Compressor, though
     only in a single frequency band.  I've also added an expansion stage
-    to manage noise at very low SPL.
+    to manage noise at very low SPL.  Both ears are processed, either
+    linked (one shared envelope and gain, driven by the louder ear, using
+    the left ear's settings) or independently.  The left ear is channel 0
+    and the right ear channel 1 in the ExtendedSerialManager.  A lookahead
+    limiter behind the compressor holds each ear to its bolt (the left
+    ear's, on the louder of the two, while linked), and an
+    adaptive feedback canceller ahead of it takes out what leaks from each
+    ear's receiver back into its microphone.  A spectral noise reduction
+    stage in front of the compressor is driven by each ear's expansion
+    settings (exp_cr for how hard, exp_end_knee for up to what level).
 
   User Controls:
     Potentiometer on Tympan controls the algorithm gain
@@ -19,12 +28,30 @@
 #include <Arduino.h>
 #include <Tympan_Library.h>
 #include "../../shared/ExtendedSerialManager.h"
+#include "../../shared/AudioMemoryPlanner.h"
+#include "../../shared/AudioEffectCompWDRCStereo_F32.h"
+#include "../../shared/AudioEffectLookaheadLimiter_F32.h"
+#include "../../shared/AudioFilterBiquadCascade_F32.h"
+#include "../../shared/FilterDesign.h"
+#include "../../shared/AudioEffectFeedbackCancel_F32.h"
+#include "../../shared/AudioEffectNoiseReduction_F32.h"
+#include "../../shared/AudioProfiler_F32.h"
+#include "../../shared/AudioHealthMonitor_F32.h"
 
 void setupTympanHardware(void);
 void servicePotentiometer(unsigned long curTime_millis,unsigned long updatePeriod_millis);
 void applyConfiguration(void);
+void allocateAudioMemory(void);
+void printLatencyReport(int algorithm_samples);
 void activateKnob(int channel, int knob);
 bool runCommand(char c);
+bool printMemoryReport(char c);
+bool setLinkMode(char c);
+bool loadFilter(int channel, const float *values, int count);
+void printProfileReport(void);
+void resetProfileReport(void);
+void printHealthReport(void);
+void resetHealthReport(void);
 
 #define OPTION_ATTACK       0
 #define OPTION_RELEASE      1
@@ -33,13 +60,44 @@ bool runCommand(char c);
 #define OPTION_TKGAIN       4
 #define OPTION_TK           5
 #define OPTION_CR           6
-
+#define OPTION_BOLT         7
+#define OPTION_HP_CORNER    8
+#define OPTION_HP_ORDER     9
+#define OPTION_DETECTOR     10
+#define OPTION_RMS_WINDOW   11
+#define OPTION_AFC_STEP     12
+#define OPTION_AFC_TAPS     13
+
+int selectedChannel = 0;
 int selectedOption = OPTION_CR;
 
-BTNRH_WDRC::CHA_WDRC gha = {
+//the audio runs at this rate...everything rate-dependent (time constants, filters) is derived from it
+const float sample_rate_Hz = 44117.0f; //16000, 22050, 24000, 32000, 44117, 48000 or 96000 (see the table in AudioOutputI2S_F32)
+
+//samples per audio block...smaller blocks mean less latency but more per-block overhead (see printLatencyReport())
+const int audio_block_samples = AUDIO_BLOCK_SAMPLES; //8 to MAX_AUDIO_BLOCK_SAMPLES_F32 (128 unless the library is built with more)
+static_assert((audio_block_samples >= 8) && (audio_block_samples <= MAX_AUDIO_BLOCK_SAMPLES_F32), "audio_block_samples must be between 8 and MAX_AUDIO_BLOCK_SAMPLES_F32");
+AudioSettings_F32 audio_settings(sample_rate_Hz, audio_block_samples);
+
+//the I/O round trip: the input has to fill a whole block before it is processed and the output takes
+//a whole block to play out (the converters add a little more, not counted here)
+const int io_latency_samples = 2 * audio_block_samples;
+
+#define LEFT_EAR  0
+#define RIGHT_EAR 1
+
+//brickwall limiter behind the compressor, at each ear's bolt (linked along with the compressor)
+const float limiterLookahead_msec = 2.0f;
+const float limiterRelease_msec = 50.0f;
+
+//noise reduction FFT...a power of two, a multiple of audio_block_samples and at least twice it;
+//bigger gives finer frequency resolution but more latency (fft size - block size) and CPU
+const int noiseReduction_fft_size = 256;
+
+BTNRH_WDRC::CHA_WDRC ghaL = {
   1.0f, // attack time (ms)
   50.0f,     // release time (ms)
-  44100.0f,  // fs, sampling rate (Hz), THIS IS IGNORED!
+  sample_rate_Hz, // fs, sampling rate (Hz)
   119.0f,    // maxdB, maximum signal (dB SPL)
   0.1f,      // compression ratio for lowest-SPL region (ie, the expansion region)
   40.0f,      // expansion ending kneepoint (see small to defeat the expansion)
@@ -48,40 +106,146 @@ BTNRH_WDRC::CHA_WDRC gha = {
   1.0f,     // cr, compression ratio
   105.0f     // bolt, broadband output limiting threshold
 };
-
+BTNRH_WDRC::CHA_WDRC ghaR = ghaL;
+
+//Butterworth high-pass IIR ahead of the compressor, designed whenever its knobs change
+//(or replace it at runtime with "%<ear>=b0,b1,b2,a1,a2,...;", five values per second-order section)
+float hpCorner_Hz[] = { 750.0f, 750.0f };
+float hpOrder[] = { 2.0f, 2.0f };
+float hpDesignedCorner_Hz[] = { 0.0f, 0.0f }; //what the filters were last designed for
+int hpDesignedOrder[] = { 0, 0 };
+ButterworthDesign hpDesign;
+
+//what the compressor's envelope follows...0 = peak, 1 = RMS, 2 = hybrid (see EnvelopeDetector_F32.h)
+float detectorMode[] = { (float)DetectorPeak, (float)DetectorPeak };
+float rmsWindow_msec[] = { 5.0f, 5.0f };
+
+//adaptive feedback canceller...step size in thousandths, so that it shows on the serial menu; 0 freezes
+//the adaptation, and the canceller holds step size x block size to FEEDBACK_CANCEL_MAX_BLOCK_STEP
+float afcStepSize_milli[] = { 2.0f, 2.0f };
+float afcTaps[] = { 64.0f, 64.0f };
+//the loopback already lags by a block, so the rest of the round trip is delayed up front and the taps
+//only have to cover the converters and the acoustic path (see AudioEffectFeedbackCancel_F32.h)
+const int afcBulkDelay_samples = io_latency_samples - audio_block_samples;
+static_assert(afcBulkDelay_samples <= FEEDBACK_CANCEL_MAX_DELAY, "the AFC bulk delay is longer than the canceller holds");
+
+//one row of knobs per ear: channel 0 is the left ear, channel 1 the right ear
 CONFIGURABLE options[] = {
-  { "attack time", &gha.attack, "ms", 1.0f, 100.0f },
-  { "release time", &gha.release, "ms", 10.0f, 500.0f },
-  { "expansion ratio", &gha.exp_cr, "", 0.01f, 2.0f },
-  { "expansion kneepoint", &gha.exp_end_knee, "dB", 0.0f, 100.0f },
-  { "tkgain", &gha.tkgain, "dB", 0.0f, 20.0f },
-  { "tk", &gha.tk, "dB", 0.0f, 100.0f },
-  { "cr", &gha.cr, "", 0.01f, 5.0f }
+  { "attack time", &ghaL.attack, "ms", 1.0f, 100.0f },
+  { "release time", &ghaL.release, "ms", 10.0f, 500.0f },
+  { "expansion ratio", &ghaL.exp_cr, "", 0.01f, 2.0f },
+  { "expansion kneepoint", &ghaL.exp_end_knee, "dB", 0.0f, 100.0f },
+  { "tkgain", &ghaL.tkgain, "dB", 0.0f, 20.0f },
+  { "tk", &ghaL.tk, "dB", 0.0f, 100.0f },
+  { "cr", &ghaL.cr, "", 0.01f, 5.0f },
+  { "bolt", &ghaL.bolt, "dB", 60.0f, 119.0f },
+  { "hp corner", &hpCorner_Hz[LEFT_EAR], "Hz", 50.0f, 2000.0f },
+  { "hp order", &hpOrder[LEFT_EAR], "", 1.0f, 8.0f },
+  { "detector", &detectorMode[LEFT_EAR], "", 0.0f, 2.0f },
+  { "rms window", &rmsWindow_msec[LEFT_EAR], "ms", 1.0f, 10.0f },
+  { "afc step size", &afcStepSize_milli[LEFT_EAR], "x0.001", 0.0f, 10.0f },
+  { "afc filter length", &afcTaps[LEFT_EAR], "taps", 8.0f, (float)FEEDBACK_CANCEL_MAX_TAPS },
+  { "attack time", &ghaR.attack, "ms", 1.0f, 100.0f },
+  { "release time", &ghaR.release, "ms", 10.0f, 500.0f },
+  { "expansion ratio", &ghaR.exp_cr, "", 0.01f, 2.0f },
+  { "expansion kneepoint", &ghaR.exp_end_knee, "dB", 0.0f, 100.0f },
+  { "tkgain", &ghaR.tkgain, "dB", 0.0f, 20.0f },
+  { "tk", &ghaR.tk, "dB", 0.0f, 100.0f },
+  { "cr", &ghaR.cr, "", 0.01f, 5.0f },
+  { "bolt", &ghaR.bolt, "dB", 60.0f, 119.0f },
+  { "hp corner", &hpCorner_Hz[RIGHT_EAR], "Hz", 50.0f, 2000.0f },
+  { "hp order", &hpOrder[RIGHT_EAR], "", 1.0f, 8.0f },
+  { "detector", &detectorMode[RIGHT_EAR], "", 0.0f, 2.0f },
+  { "rms window", &rmsWindow_msec[RIGHT_EAR], "ms", 1.0f, 10.0f },
+  { "afc step size", &afcStepSize_milli[RIGHT_EAR], "x0.001", 0.0f, 10.0f },
+  { "afc filter length", &afcTaps[RIGHT_EAR], "taps", 8.0f, (float)FEEDBACK_CANCEL_MAX_TAPS }
 };
 
 COMMAND commands[] = {
-  { 'd', "do a thing", runCommand }
+  { 'd', "do a thing", runCommand },
+  { 'l', "link the ears (shared gain, left ear settings)", setLinkMode },
+  { 'i', "process the ears independently", setLinkMode },
+  { 'm', "print audio memory use", printMemoryReport }
+};
+
+REPORT reports[] = {
+  { 'p', "per-node CPU profile (cycles per block, worst-case block time histogram)", printProfileReport, resetProfileReport },
+  { 'h', "audio health (overruns, dropped blocks, pool exhausted)", printHealthReport, resetHealthReport }
 };
 
-ExtendedSerialManager esm(options, 1, 7, commands, 1, applyConfiguration, activateKnob, 0, OPTION_CR);
-ExtendedSerialManager esm1(options, 1, 7, commands, 1, applyConfiguration, activateKnob, 0, OPTION_CR);
+const int reportCount = sizeof(reports) / sizeof(reports[0]);
+
+ExtendedSerialManager esm(options, 2, 14, commands, 4, applyConfiguration, activateKnob, 0, OPTION_CR);
+ExtendedSerialManager esm1(options, 2, 14, commands, 4, applyConfiguration, activateKnob, 0, OPTION_CR);
+
+//spare audio blocks on top of what the graph needs (see AudioMemoryPlanner.h)
+const int audio_memory_margin = 4;
 
 //create audio library objects for handling the audio
-Tympan                  myTympan(TympanRev::D);  //TympanRev::D or TympanRev::C
-AudioInputI2S_F32       i2s_in;
-AudioFilterBiquad_F32   iir1; 
-AudioEffectCompWDRC_F32  compWDRC1;   
-AudioOutputI2S_F32       i2s_out; 
-AudioConnection_F32     patchCord1(i2s_in, 0, iir1, 0);
-AudioConnection_F32     patchCord2(iir1, compWDRC1);
-AudioConnection_F32     patchCord3(compWDRC1, 0, i2s_out, 0);
-AudioConnection_F32     patchCord4(compWDRC1, 0, i2s_out, 1);
+Tympan                  myTympan(TympanRev::D, audio_settings);  //TympanRev::D or TympanRev::C
+AudioInputI2S_F32       i2s_in(audio_settings);
+AudioFilterBiquadCascade_F32 iirL;
+AudioFilterBiquadCascade_F32 iirR;
+AudioEffectFeedbackCancel_F32 afcL(audio_settings);
+AudioEffectFeedbackCancel_F32 afcR(audio_settings);
+AudioEffectNoiseReduction_F32 noiseReductionL;
+AudioEffectNoiseReduction_F32 noiseReductionR;
+AudioEffectCompWDRCStereo_F32 compWDRC;
+AudioEffectLookaheadLimiterStereo_F32 limiter;
+AudioOutputI2S_F32       i2s_out(audio_settings);
+AudioProfiler_F32       profiler; //constructed last, so that it runs after everything it profiles
+AudioHealthMonitor_F32  healthMonitor; //likewise, to see what each cycle delivered to the output
+AudioConnectionPlanned_F32 patchCord1(i2s_in, 0, iirL, 0);
+AudioConnectionPlanned_F32 patchCord2(i2s_in, 1, iirR, 0);
+AudioConnectionPlanned_F32 patchCord3(iirL, 0, afcL, 0);
+AudioConnectionPlanned_F32 patchCord4(iirR, 0, afcR, 0);
+AudioConnectionPlanned_F32 patchCord5(afcL, 0, noiseReductionL, 0);
+AudioConnectionPlanned_F32 patchCord6(afcR, 0, noiseReductionR, 0);
+AudioConnectionPlanned_F32 patchCord7(noiseReductionL, 0, compWDRC, LEFT_EAR);
+AudioConnectionPlanned_F32 patchCord8(noiseReductionR, 0, compWDRC, RIGHT_EAR);
+AudioConnectionPlanned_F32 patchCord9(compWDRC, LEFT_EAR, limiter, LEFT_EAR);
+AudioConnectionPlanned_F32 patchCord10(compWDRC, RIGHT_EAR, limiter, RIGHT_EAR);
+AudioConnectionPlanned_F32 patchCord11(limiter, LEFT_EAR, i2s_out, 0);
+AudioConnectionPlanned_F32 patchCord12(limiter, RIGHT_EAR, i2s_out, 1);
+AudioConnectionPlanned_F32 patchCord13(limiter, LEFT_EAR, afcL, 1); //loopback of what each receiver plays, a block late
+AudioConnectionPlanned_F32 patchCord14(limiter, RIGHT_EAR, afcR, 1);
+AudioConnectionPlanned_F32 patchCord15(limiter, LEFT_EAR, profiler, 0); //only to keep the profiler running
+AudioConnectionPlanned_F32 patchCord16(limiter, LEFT_EAR, healthMonitor, 0);
+AudioConnectionPlanned_F32 patchCord17(limiter, RIGHT_EAR, healthMonitor, 1);
+
+//redesign an ear's high-pass only when its knobs have moved, so that coefficients loaded
+//with "%" stay in place until then
+void applyHighpass(int ear, AudioFilterBiquadCascade_F32 *iir) {
+  int order = (int)(hpOrder[ear] + 0.5f);
+  if ((hpCorner_Hz[ear] == hpDesignedCorner_Hz[ear]) && (order == hpDesignedOrder[ear])) return;
+  float coeffs[5 * FILTER_DESIGN_MAX_SECTIONS];
+  int nSections = hpDesign.design(FilterHighpass, hpCorner_Hz[ear], sample_rate_Hz, order, coeffs);
+  if (nSections && iir->setCoefficients(nSections, coeffs)) {
+    hpDesignedCorner_Hz[ear] = hpCorner_Hz[ear];
+    hpDesignedOrder[ear] = order;
+  }
+}
 
 void applyConfiguration(void) {
-  compWDRC1.setParams_from_CHA_WDRC(&gha);
+  //designed here, in loop(), and picked up by the filters at the start of their next block
+  applyHighpass(LEFT_EAR, &iirL);
+  applyHighpass(RIGHT_EAR, &iirR);
+
+  //picked up by the compressor at the start of its next block
+  compWDRC.publishParams(LEFT_EAR, &ghaL);
+  compWDRC.publishParams(RIGHT_EAR, &ghaR);
+  compWDRC.publishDetector(LEFT_EAR, (DETECTOR_MODE)(int)(detectorMode[LEFT_EAR] + 0.5f), rmsWindow_msec[LEFT_EAR]);
+  compWDRC.publishDetector(RIGHT_EAR, (DETECTOR_MODE)(int)(detectorMode[RIGHT_EAR] + 0.5f), rmsWindow_msec[RIGHT_EAR]);
+  limiter.publishParams(LEFT_EAR, &ghaL, limiterLookahead_msec, limiterRelease_msec);
+  limiter.publishParams(RIGHT_EAR, &ghaR, limiterLookahead_msec, limiterRelease_msec);
+  afcL.publishParams(0.001f * afcStepSize_milli[LEFT_EAR], (int)(afcTaps[LEFT_EAR] + 0.5f), afcBulkDelay_samples);
+  afcR.publishParams(0.001f * afcStepSize_milli[RIGHT_EAR], (int)(afcTaps[RIGHT_EAR] + 0.5f), afcBulkDelay_samples);
+  noiseReductionL.publishParams(&ghaL);
+  noiseReductionR.publishParams(&ghaR);
 }
 
 void activateKnob(int channel, int knob) {
+  selectedChannel = channel;
   selectedOption = knob;
 }
 
@@ -90,6 +254,104 @@ bool runCommand(char c) {
   return true;
 }
 
+bool printMemoryReport(char c) {
+  AudioMemoryPlanner &planner = AudioMemoryPlanner::instance();
+  myTympan.printf("Memory: %i blocks (%i planned for %i connections + %i margin), at most %i used, %i now\n",
+      planner.getAllocatedBlocks(), planner.getPlannedBlocks(), planner.getConnections(), planner.getMargin(),
+      AudioMemoryUsageMax_F32(), AudioMemoryUsage_F32());
+  return true;
+}
+
+//size the audio block pool from the connections made so far
+void allocateAudioMemory(void) {
+  AudioMemoryPlanner &planner = AudioMemoryPlanner::instance();
+  planner.reserve(AUDIO_MEMORY_I2S_INPUT_BLOCKS + AUDIO_MEMORY_I2S_OUTPUT_BLOCKS);
+  if (!planner.allocate(audio_memory_margin, audio_settings)) {
+    myTympan.println("Unable to allocate the audio memory");
+  }
+  printMemoryReport('m');
+}
+
+bool loadFilter(int channel, const float *values, int count) {
+  if (count % 5) return false;
+  AudioFilterBiquadCascade_F32 *iir = (channel == LEFT_EAR) ? &iirL : &iirR;
+  return iir->setCoefficients(count / 5, values);
+}
+
+bool setLinkMode(char c) {
+  compWDRC.setLinked(c == 'l');
+  limiter.setLinked(c == 'l');
+  myTympan.println(c == 'l' ? "Ears linked" : "Ears independent");
+  return true;
+}
+
+void printProfileReport(void) {
+  static AUDIO_PROFILE profile;
+  profiler.getSnapshot(&profile);
+  float cyclesPerMicro = F_CPU / 1000000.0f;
+  myTympan.printf("Profile over %lu blocks, block period %.0f us:\n", profile.blocks, profile.budget_cycles / cyclesPerMicro);
+  myTympan.println("  node              min us  mean us   max us  max %");
+  for (int ii = 0; ii < profile.nodeCount; ii++) {
+    AUDIO_PROFILE_NODE *node = &profile.nodes[ii];
+    myTympan.printf("  %-16s %7.1f  %7.1f  %7.1f  %5.1f\n", node->name,
+        node->min_cycles / cyclesPerMicro, node->mean_cycles / cyclesPerMicro, node->max_cycles / cyclesPerMicro,
+        profile.budget_cycles > 0.0f ? 100.0f * node->max_cycles / profile.budget_cycles : 0.0f);
+  }
+  myTympan.printf("  %-16s %7s  %7.1f  %7.1f  %5.1f\n", "(fixed per block)", "",
+      profile.mean_overhead_cycles / cyclesPerMicro, profile.max_overhead_cycles / cyclesPerMicro,
+      profile.budget_cycles > 0.0f ? 100.0f * profile.max_overhead_cycles / profile.budget_cycles : 0.0f);
+  myTympan.println("Block time, % of the block period: blocks");
+  for (int ii = 0; ii < AUDIO_PROFILER_HISTOGRAM_BINS - 1; ii++) {
+    myTympan.printf("  %3i-%3i%%: %lu\n", 10 * ii, 10 * (ii + 1), profile.histogram[ii]);
+  }
+  myTympan.printf("    >=100%%: %lu\n", profile.histogram[AUDIO_PROFILER_HISTOGRAM_BINS - 1]);
+}
+
+void resetProfileReport(void) {
+  profiler.reset();
+}
+
+void printHealthReport(void) {
+  static AUDIO_HEALTH health;
+  static const char *eventNames[] = { "overrun", "dropped block", "pool exhausted" };
+  healthMonitor.getSnapshot(&health);
+  myTympan.printf("Health over %lu blocks: %lu overruns, %lu dropped blocks, pool exhausted in %lu (at most %i blocks in use)\n",
+      health.cycles, health.overruns, health.droppedBlocks, health.poolExhausted, health.poolUsageMax);
+  for (int ii = 0; ii < health.eventCount; ii++) {
+    AUDIO_HEALTH_ENTRY *entry = &health.events[ii];
+    if (entry->event == HealthDroppedBlock) {
+      myTympan.printf("  %10lu ms: %s (%s ear)\n", entry->time_millis, eventNames[entry->event], entry->input == LEFT_EAR ? "left" : "right");
+    } else {
+      myTympan.printf("  %10lu ms: %s\n", entry->time_millis, eventNames[entry->event]);
+    }
+  }
+}
+
+void resetHealthReport(void) {
+  healthMonitor.reset();
+}
+
+//report what the block size costs: the input has to fill a whole block before it is processed and
+//the output takes a whole block to play out, on top of whatever delay the algorithm itself adds; and
+//every block pays a fixed cost to run the graph at all (measured by the profiler), whatever its size
+void printLatencyReport(int algorithm_samples) {
+  static AUDIO_PROFILE profile;
+  int io_samples = io_latency_samples;
+  int total_samples = io_samples + algorithm_samples;
+  myTympan.printf("Block size: %i samples (%.2f ms, %.0f blocks/sec)\n",
+      audio_block_samples, 1000.0f * audio_block_samples / sample_rate_Hz, sample_rate_Hz / audio_block_samples);
+  myTympan.printf("Latency: %i samples (%.2f ms) = %i of block I/O + %i in the algorithm\n",
+      total_samples, 1000.0f * total_samples / sample_rate_Hz, io_samples, algorithm_samples);
+  profiler.getSnapshot(&profile);
+  if (profile.blocks > 1 && profile.budget_cycles > 0.0f) {
+    myTympan.printf("Fixed cost per block: %.1f us mean, %.1f us max = %.1f%% CPU at this block size\n",
+        profile.mean_overhead_cycles / (F_CPU / 1000000.0f), profile.max_overhead_cycles / (F_CPU / 1000000.0f),
+        100.0f * profile.mean_overhead_cycles / profile.budget_cycles);
+  } else {
+    myTympan.println("Fixed cost per block: not measured (no audio yet)");
+  }
+}
+
 //define a function to setup the Teensy Audio Board how I like it
 void setupTympanHardware(void) {
   // Setup the Tympan audio hardware
@@ -115,20 +377,56 @@ void setup(void) {
     //begin the serial comms (for debugging)
   myTympan.beginBothSerial(); delay(1000); //let's use the print functions in "myTympan" so it goes to BT, too!
   myTympan.println("Setup starting...");
-
-  //allocate the dynamic memory for audio processing blocks
-  AudioMemory_F32(20); 
-
-  //setup high-pass IIR...[b,a]=butter(2,750/(44100/2),'high')
-  float32_t hp_b[]={ 0.927221242739230,  -1.854442485478460,   0.927221242739230};
-  float32_t hp_a[]={ 1.000000000000000,  -1.849138705449389,   0.859746265507531};
-  iir1.setFilterCoeff_Matlab(hp_b, hp_a); //one stage of N=2 IIR
-  applyConfiguration();
+  myTympan.printf("Sample rate: %.0f Hz\n", sample_rate_Hz);
+
+  //allocate the dynamic memory for audio processing blocks, sized from the connections above
+  allocateAudioMemory();
+
+  //the noise reduction's FFT buffers are allocated here, once
+  if (!noiseReductionL.setup(noiseReduction_fft_size, audio_block_samples, sample_rate_Hz)
+      || !noiseReductionR.setup(noiseReduction_fft_size, audio_block_samples, sample_rate_Hz)) {
+    myTympan.println("Unable to set up the noise reduction, passing audio through it untouched");
+  }
+
+  compWDRC.setRampTime_msec(20.0f); //ramp gain changes so that big knob jumps don't click
+  applyConfiguration(); //also designs the high-pass IIRs
+  myTympan.printf("Limiter lookahead: %i samples, noise reduction FFT: %i samples\n",
+      limiter.getLatency_samples(), noiseReductionL.getLatency_samples());
+
+  //coalesce bursts of knob changes...apply at most every 50 msec
+  esm.setApplyInterval(50);
+  esm1.setApplyInterval(50);
+
+  //let the serial protocol load new filter coefficients
+  esm.setLoad(loadFilter);
+  esm1.setLoad(loadFilter);
+
+  //profile every node, queried with "@p;" (and restarted with "@p0;")
+  profiler.addNode(&i2s_in, "i2s_in");
+  profiler.addNode(&iirL, "iirL");
+  profiler.addNode(&iirR, "iirR");
+  profiler.addNode(&afcL, "afcL");
+  profiler.addNode(&afcR, "afcR");
+  profiler.addNode(&noiseReductionL, "noiseReductionL");
+  profiler.addNode(&noiseReductionR, "noiseReductionR");
+  profiler.addNode(&compWDRC, "compWDRC");
+  profiler.addNode(&limiter, "limiter");
+  profiler.addNode(&i2s_out, "i2s_out");
+  esm.setReports(reports, reportCount);
+  esm1.setReports(reports, reportCount);
+
+  //watch both ears' output for clicks, queried with "@h;" (and restarted with "@h0;")
+  healthMonitor.setInputs(2);
+  healthMonitor.setPoolSize(AudioMemoryPlanner::instance().getAllocatedBlocks());
 
 
   // Enable the audio shield, select input, and enable output
   setupTympanHardware();
 
+  //let the profiler see some blocks before reporting their fixed cost
+  delay(500);
+  printLatencyReport(limiter.getLatency_samples() + noiseReductionL.getLatency_samples()); //IIR group delay not counted
+
   //End of setup
   myTympan.println("Setup complete.");
 };
@@ -139,13 +437,19 @@ void setup(void) {
 //They do not need to be serviced by the loop() function.
 void loop(void) {
 
+  //myTympan prints to both serial ports, so while either of them speaks binary nothing else may
+  //print: the other port's commands, the potentiometer and the status wait until it is done
+  bool quiet = esm.isBinary() || esm1.isBinary();
+
   //service the potentiometer...if enough time has passed
-  servicePotentiometer(millis(),100); //update every 100msec
-  while (Serial.available()) esm.processByte(Serial.read());
-  while (Serial1.available()) esm1.processByte(Serial1.read());
+  if (!quiet) servicePotentiometer(millis(),100); //update every 100msec
+  if (!esm1.isBinary()) while (Serial.available()) esm.processByte(Serial.read());
+  if (!esm.isBinary()) while (Serial1.available()) esm1.processByte(Serial1.read());
+  esm.service(millis());
+  esm1.service(millis());
 
   //update the memory and CPU usage...if enough time has passed
-  myTympan.printCPUandMemory(millis(),3000); //print every 3000 msec
+  if (!quiet) myTympan.printCPUandMemory(millis(),3000); //print every 3000 msec
 };
 
 
@@ -168,7 +472,7 @@ void servicePotentiometer(unsigned long curTime_millis,unsigned long updatePerio
     if (abs(val - prev_val) > 0.05) { //is it different than befor?
       prev_val = val;  //save the value for comparison for the next time around
 
-      snprintf(potentiometerCmdBuffer, 32, "*%i%c%i;", 0, 'A' + selectedOption, int(100 * val));
+      snprintf(potentiometerCmdBuffer, 32, "*%i%c%i;", selectedChannel, 'A' + selectedOption, int(100 * val));
       myTympan.println(potentiometerCmdBuffer);
       esm.processExtendedCommand(potentiometerCmdBuffer);
     }
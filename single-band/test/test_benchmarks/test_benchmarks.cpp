@@ -0,0 +1,218 @@
+/*
+  Fixed-seed regression suite: the biquad cascade, the WDRC compressor (stereo, independent and
+  linked, with linked reported against one mono compressor) and the serial parser.
+
+  Every test first checks that the code still does what it should on a fixed-seed signal, then
+  times it and compares the cost with the stored baseline (test/benchmark_baseline.json), failing
+  if it got slower by more than BENCH_THRESHOLD (50% by default). Results are printed as JSON
+  lines; see shared/host/Benchmark.h for the environment variables.
+
+  Run with: pio test -e native -f test_benchmarks
+  New baseline (e.g. on a new machine): BENCH_UPDATE=1 pio test -e native -f test_benchmarks
+*/
+
+#include <unity.h>
+#include <Tympan_Library.h>
+#include "../../../shared/AudioFilterBiquadCascade_F32.h"
+#include "../../../shared/FilterDesign.h"
+#include "../../../shared/AudioEffectCompWDRCStereo_F32.h"
+#include "../../../shared/AudioEffectCompWDRCBuffered_F32.h"
+#include "../../../shared/ExtendedSerialManager.h"
+#include "../../../shared/host/Benchmark.h"
+#include "../../../shared/host/HostAudio.h"
+
+#define SAMPLE_RATE 44117.0f
+#define BLOCK_SIZE 128
+#define SAMPLES (344 * BLOCK_SIZE)   // about a second of audio
+#define SEED 12345
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+AudioSettings_F32 audio_settings(SAMPLE_RATE, BLOCK_SIZE);
+float inLeft[SAMPLES], inRight[SAMPLES], outLeft[SAMPLES], outRight[SAMPLES];
+
+void setUp(void) {
+  AudioMemory_F32(16, audio_settings);
+  HostNoise noise(SEED);
+  for (int ii = 0; ii < SAMPLES; ii++) {
+    inLeft[ii] = 0.1f * noise.gaussian();
+    inRight[ii] = 0.05f * noise.gaussian();
+  }
+}
+
+HostGraph *graph = NULL;
+
+void tearDown(void) {
+  delete graph;
+  graph = NULL;
+}
+
+struct CascadeGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  AudioFilterBiquadCascade_F32 iir;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioConnection_F32 patchCord1 { i2s_in, 0, iir, 0 };
+  AudioConnection_F32 patchCord2 { iir, 0, i2s_out, 0 };
+};
+
+struct CompressorGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  AudioEffectCompWDRCStereo_F32 compWDRC;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioConnection_F32 patchCord1 { i2s_in, 0, compWDRC, 0 };
+  AudioConnection_F32 patchCord2 { i2s_in, 1, compWDRC, 1 };
+  AudioConnection_F32 patchCord3 { compWDRC, 0, i2s_out, 0 };
+  AudioConnection_F32 patchCord4 { compWDRC, 1, i2s_out, 1 };
+};
+
+struct MonoCompressorGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  AudioEffectCompWDRCBuffered_F32 compWDRC;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioConnection_F32 patchCord1 { i2s_in, 0, compWDRC, 0 };
+  AudioConnection_F32 patchCord2 { compWDRC, 0, i2s_out, 0 };
+};
+
+void test_biquad_cascade(void) {
+  CascadeGraph *g = new CascadeGraph;
+  graph = g;
+  AudioInputI2S_F32 &i2s_in = g->i2s_in;
+  AudioOutputI2S_F32 &i2s_out = g->i2s_out;
+  AudioFilterBiquadCascade_F32 &iir = g->iir;
+
+  ButterworthDesign design;
+  float coeffs[5 * FILTER_DESIGN_MAX_SECTIONS];
+  int nSections = design.design(FilterHighpass, 750.0f, SAMPLE_RATE, 8, coeffs);
+  TEST_ASSERT_EQUAL_INT(4, nSections);
+  iir.setCoefficients(nSections, coeffs);
+  HostAudio::process(i2s_in, i2s_out, BLOCK_SIZE, inLeft, NULL, outLeft, NULL, SAMPLES);
+
+  // against the same sections in double precision
+  double state[FILTER_DESIGN_MAX_SECTIONS][2] = {};
+  double maxError = 0.0;
+  for (int ii = 0; ii < SAMPLES; ii++) {
+    double x = inLeft[ii];
+    for (int jj = 0; jj < nSections; jj++) {
+      const float *c = &coeffs[5 * jj];
+      double y = c[0] * x + state[jj][0];
+      state[jj][0] = c[1] * x - c[3] * y + state[jj][1];
+      state[jj][1] = c[2] * x - c[4] * y;
+      x = y;
+    }
+    maxError = fmax(maxError, fabs(x - outLeft[ii]));
+  }
+  TEST_ASSERT_LESS_THAN_FLOAT(1e-4f, maxError);
+
+  BENCH_TIMING timing = Benchmark::time([&]() {
+    HostAudio::process(i2s_in, i2s_out, BLOCK_SIZE, inLeft, NULL, outLeft, NULL, SAMPLES);
+  });
+  TEST_ASSERT_TRUE_MESSAGE(Benchmark::check("biquad_cascade.4_sections.ns_per_sample", timing.ns / SAMPLES, "ns/sample"), "biquad cascade regressed");
+}
+
+void test_wdrc(void) {
+  CompressorGraph *g = new CompressorGraph;
+  graph = g;
+  AudioInputI2S_F32 &i2s_in = g->i2s_in;
+  AudioOutputI2S_F32 &i2s_out = g->i2s_out;
+  AudioEffectCompWDRCStereo_F32 &compWDRC = g->compWDRC;
+  compWDRC.setRampTime_msec(0.0f);
+  compWDRC.setLinked(false);
+
+  // linear 20 dB gain (cr 1, no expansion, bolt out of reach): every sample exactly times 10
+  BTNRH_WDRC::CHA_WDRC linear = { 1.0f, 50.0f, SAMPLE_RATE, 119.0f, 1.0f, 0.0f, 20.0f, 105.0f, 1.0f, 150.0f };
+  compWDRC.publishParams(0, &linear);
+  compWDRC.publishParams(1, &linear);
+  HostAudio::process(i2s_in, i2s_out, BLOCK_SIZE, inLeft, inRight, outLeft, outRight, SAMPLES);
+  for (int ii = 0; ii < SAMPLES; ii++) {
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f * fabsf(inLeft[ii]) + 1e-7f, 10.0f * inLeft[ii], outLeft[ii]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f * fabsf(inRight[ii]) + 1e-7f, 10.0f * inRight[ii], outRight[ii]);
+  }
+
+  // and timed with every region of the curve in use
+  BTNRH_WDRC::CHA_WDRC fitting = { 1.0f, 50.0f, SAMPLE_RATE, 119.0f, 0.5f, 60.0f, 10.0f, 70.0f, 2.0f, 100.0f };
+  compWDRC.publishParams(0, &fitting);
+  compWDRC.publishParams(1, &fitting);
+  BENCH_TIMING timing = Benchmark::time([&]() {
+    HostAudio::process(i2s_in, i2s_out, BLOCK_SIZE, inLeft, inRight, outLeft, outRight, SAMPLES);
+  });
+  TEST_ASSERT_TRUE_MESSAGE(Benchmark::check("wdrc.stereo_independent.ns_per_sample", timing.ns / SAMPLES, "ns/sample"), "WDRC regressed");
+
+  // linked, against one mono compressor on the same fitting: one gain computation for the two
+  // ears, plus the detector's max and the right ear's envelope kept in step
+  compWDRC.setLinked(true);
+  BENCH_TIMING linked = Benchmark::time([&]() {
+    HostAudio::process(i2s_in, i2s_out, BLOCK_SIZE, inLeft, inRight, outLeft, outRight, SAMPLES);
+  });
+  TEST_ASSERT_TRUE_MESSAGE(Benchmark::check("wdrc.stereo_linked.ns_per_sample", linked.ns / SAMPLES, "ns/sample"), "linked WDRC regressed");
+  delete g;
+  graph = NULL;
+
+  MonoCompressorGraph *mono = new MonoCompressorGraph;
+  graph = mono;
+  mono->compWDRC.setRampTime_msec(0.0f);
+  mono->compWDRC.publishParams(&fitting);
+  BENCH_TIMING single = Benchmark::time([&]() {
+    HostAudio::process(mono->i2s_in, mono->i2s_out, BLOCK_SIZE, inLeft, NULL, outLeft, NULL, SAMPLES);
+  });
+  Benchmark::report("wdrc.mono.ns_per_sample", single.ns / SAMPLES, "ns/sample");
+  Benchmark::report("wdrc.stereo_linked.relative_to_mono", linked.ns / single.ns, "x");
+  Benchmark::report("wdrc.stereo_independent.relative_to_mono", timing.ns / single.ns, "x");
+}
+
+float knobValues[2 * 14];
+CONFIGURABLE knobs[2 * 14];
+int applies = 0;
+bool runCommand(char c) { return true; }
+COMMAND commands[] = { { 'x', "do nothing", runCommand } };
+void apply(void) { applies++; }
+void activate(int channel, int knob) {}
+
+void test_esm_parsing(void) {
+  for (int ii = 0; ii < 2 * 14; ii++) {
+    knobValues[ii] = 50.0f;
+    knobs[ii] = { "knob", &knobValues[ii], "dB", 0.0f, 100.0f };
+  }
+  applies = 0;
+  ExtendedSerialManager esm(knobs, 2, 14, commands, 1, apply, activate, 0, 0);
+
+  // a fixed-seed stream of extended-mode commands, as a remote app might send them
+  static char script[64 * 1024];
+  int length = 0, commandCount = 0, applyCount = 0;
+  HostNoise noise(SEED);
+  length += snprintf(script + length, sizeof(script) - length, "/");
+  while (length < (int)sizeof(script) - 256) {
+    int channel = noise.uniform() > 0.0f ? 1 : 0;
+    char knob = 'A' + (int)((noise.uniform() + 1.0f) * 6.99f);
+    int value = (int)((noise.uniform() + 1.0f) * 49.5f);
+    int type = (int)((noise.uniform() + 1.0f) * 2.0f);
+    switch (type) {
+      case 0: length += snprintf(script + length, sizeof(script) - length, "*%i%c%i;", channel, knob, value); break;
+      case 1: length += snprintf(script + length, sizeof(script) - length, "&%i%c;", channel, knob); break;
+      case 2: length += snprintf(script + length, sizeof(script) - length, "+%i%c;", channel, knob); break;
+      default: length += snprintf(script + length, sizeof(script) - length, "=%i=%i,1,2,3,4,5,6,7,8,9,10,11,12,13;", channel, value); break;
+    }
+    commandCount++;
+    if (type != 1) applyCount++;  // all but the query apply once
+  }
+
+  FILE *devNull = fopen("/dev/null", "w");
+  if (devNull) myTympan.setOutput(devNull);
+  for (int ii = 0; ii < length; ii++) esm.processByte(script[ii]);
+  TEST_ASSERT_EQUAL_INT(applyCount, applies);
+
+  BENCH_TIMING timing = Benchmark::time([&]() {
+    for (int ii = 0; ii < length; ii++) esm.processByte(script[ii]);
+  });
+  myTympan.setOutput(stdout);
+  if (devNull) fclose(devNull);
+  TEST_ASSERT_TRUE_MESSAGE(Benchmark::check("esm.mixed_script.ns_per_command", timing.ns / commandCount, "ns/command"), "parser regressed");
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_biquad_cascade);
+  RUN_TEST(test_wdrc);
+  RUN_TEST(test_esm_parsing);
+  return UNITY_END();
+}
@@ -0,0 +1,188 @@
+/*
+  The biquad cascade (shared/AudioFilterBiquadCascade_F32.h): what it refuses, and its cost.
+
+  Coefficients that are not finite, or a section with a pole on or outside the unit circle, must
+  be refused, leaving the filter running on what it had; the same set loaded over the serial
+  protocol must get ACK=0. Sections right inside the stability triangle are still taken.
+
+  Reports the cost per sample (wall time and TSC ticks) for 0 to 8 sections, and per section.
+
+  Run with: pio test -e native -f test_biquad_cascade
+*/
+
+#include <unity.h>
+#include <Tympan_Library.h>
+#include "../../../shared/AudioFilterBiquadCascade_F32.h"
+#include "../../../shared/FilterDesign.h"
+#include "../../../shared/ExtendedSerialManager.h"
+#include "../../../shared/host/Benchmark.h"
+#include "../../../shared/host/HostAudio.h"
+
+#define SAMPLE_RATE 44117.0f
+#define BLOCK_SIZE 128
+#define SAMPLES (344 * BLOCK_SIZE)   // about a second of audio
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+AudioSettings_F32 audio_settings(SAMPLE_RATE, BLOCK_SIZE);
+float in[SAMPLES], out[SAMPLES], reference[SAMPLES];
+
+void setUp(void) {
+  AudioMemory_F32(16, audio_settings);
+  HostNoise noise(12345);
+  for (int ii = 0; ii < SAMPLES; ii++) in[ii] = 0.1f * noise.gaussian();
+}
+
+HostGraph *graph = NULL;
+
+void tearDown(void) {
+  delete graph;
+  graph = NULL;
+}
+
+struct CascadeGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  AudioFilterBiquadCascade_F32 iir;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioConnection_F32 patchCord1 { i2s_in, 0, iir, 0 };
+  AudioConnection_F32 patchCord2 { iir, 0, i2s_out, 0 };
+};
+
+// b0, b1, b2, a1, a2
+static const float unstable[][5] = {
+  { 1.0f, 0.0f, 0.0f, 0.0f, 1.0f },      // poles on the unit circle
+  { 1.0f, 0.0f, 0.0f, 0.0f, -1.0f },
+  { 1.0f, 0.0f, 0.0f, 1.5f, 0.5f },      // a real pole on it (a1 = 1 + a2)
+  { 1.0f, 0.0f, 0.0f, -1.5f, 0.5f },
+  { 1.0f, 0.0f, 0.0f, -2.1f, 1.2f },     // outside
+  { NAN, 0.0f, 0.0f, 0.0f, 0.0f },
+  { 1.0f, 0.0f, INFINITY, 0.0f, 0.0f },
+  { 1.0f, 0.0f, 0.0f, -INFINITY, 0.0f },
+};
+
+// right inside the triangle
+static const float barelyStable[][5] = {
+  { 1.0f, 0.0f, 0.0f, 0.0f, 0.9999f },
+  { 1.0f, 0.0f, 0.0f, -1.9997f, 0.9999f },
+  { 1.0f, 0.0f, 0.0f, 0.4999f, -0.5f },
+};
+
+void test_rejects_bad_coefficients(void) {
+  CascadeGraph *g = new CascadeGraph;
+  graph = g;
+  ButterworthDesign design;
+  float coeffs[5 * FILTER_DESIGN_MAX_SECTIONS];
+  int nSections = design.design(FilterHighpass, 750.0f, SAMPLE_RATE, 4, coeffs);
+  TEST_ASSERT_TRUE(g->iir.setCoefficients(nSections, coeffs));
+  HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, in, NULL, reference, NULL, SAMPLES);
+  delete g;
+
+  // the same, with a bad set offered after every block: the output must not change
+  graph = g = new CascadeGraph;
+  TEST_ASSERT_TRUE(g->iir.setCoefficients(nSections, coeffs));
+  int nUnstable = sizeof(unstable) / sizeof(unstable[0]);
+  for (int start = 0; start < SAMPLES; start += BLOCK_SIZE) {
+    HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, &in[start], NULL, &out[start], NULL, BLOCK_SIZE);
+    float bad[5 * FILTER_DESIGN_MAX_SECTIONS];
+    memcpy(bad, coeffs, sizeof(bad));
+    memcpy(&bad[5 * (nSections - 1)], unstable[(start / BLOCK_SIZE) % nUnstable], 5 * sizeof(float));
+    TEST_ASSERT_FALSE(g->iir.setCoefficients(nSections, bad));
+    TEST_ASSERT_FALSE(g->iir.setCoefficients(1, unstable[(start / BLOCK_SIZE) % nUnstable]));
+  }
+  TEST_ASSERT_EQUAL_MEMORY(reference, out, sizeof(out));
+
+  for (const float *c : barelyStable) TEST_ASSERT_TRUE(g->iir.setCoefficients(1, c));
+
+  // a0 of 0 comes out as inf
+  const float b[3] = { 1.0f, 0.0f, 0.0f }, a[3] = { 0.0f, 0.5f, 0.0f };
+  TEST_ASSERT_FALSE(g->iir.setFilterCoeff_Matlab(b, a));
+}
+
+// over the serial protocol, with the single-band sketch's load callback
+AudioFilterBiquadCascade_F32 *loadTarget;
+bool loadFilter(int channel, const float *values, int count) {
+  if (count % 5) return false;
+  return loadTarget->setCoefficients(count / 5, values);
+}
+
+float knobValue = 0.0f;
+CONFIGURABLE knobs[1] = { { "knob", &knobValue, "", 0.0f, 1.0f } };
+bool runCommand(char c) { return true; }
+COMMAND commands[] = { { 'x', "do nothing", runCommand } };
+void apply(void) {}
+void activate(int channel, int knob) {}
+
+// the last line the manager printed in response to str
+static void lastResponse(ExtendedSerialManager &manager, FILE *log, const char *str, char *line, int size) {
+  fseek(log, 0, SEEK_END);
+  long start = ftell(log);
+  while (*str) manager.processByte(*str++);
+  fflush(log);
+  fseek(log, start, SEEK_SET);
+  line[0] = '\0';
+  char next[128];
+  while (fgets(next, sizeof(next), log)) {
+    next[strcspn(next, "\r\n")] = '\0';
+    if (next[0]) snprintf(line, size, "%s", next);
+  }
+}
+
+void test_load_acks(void) {
+  CascadeGraph *g = new CascadeGraph;
+  graph = g;
+  loadTarget = &g->iir;
+  FILE *log = tmpfile();
+  TEST_ASSERT_NOT_NULL(log);
+  myTympan.setOutput(log);
+  ExtendedSerialManager manager(knobs, 1, 1, commands, 1, apply, activate, 0, 0);
+  manager.setLoad(loadFilter);
+  manager.processByte('/');
+
+  char line[128];
+  lastResponse(manager, log, "%0=0.5,0.5,0,0.2,0.1;", line, sizeof(line));
+  TEST_ASSERT_EQUAL_STRING("ACK=1", line);
+  lastResponse(manager, log, "%0=1,0,0,0,1;", line, sizeof(line));
+  TEST_ASSERT_EQUAL_STRING("ACK=0", line);
+  lastResponse(manager, log, "%0=1,0,0,-2.1,1.2;", line, sizeof(line));
+  TEST_ASSERT_EQUAL_STRING("ACK=0", line);
+  lastResponse(manager, log, "%0=1,0,0,0,nan;", line, sizeof(line));
+  TEST_ASSERT_EQUAL_STRING("ACK=0", line);
+  lastResponse(manager, log, "%0=1,0,0,0,0,1,0,0,1.5,0.5;", line, sizeof(line));   // the second one
+  TEST_ASSERT_EQUAL_STRING("ACK=0", line);
+
+  myTympan.setOutput(stdout);
+  fclose(log);
+}
+
+void test_cost(void) {
+  const int counts[] = { 0, 1, 2, 4, 8 };
+  char name[80];
+  CascadeGraph *g = new CascadeGraph;
+  graph = g;
+  ButterworthDesign design;
+  float coeffs[5 * FILTER_DESIGN_MAX_SECTIONS];
+  for (int nSections : counts) {
+    if (nSections > 0) TEST_ASSERT_EQUAL_INT(nSections, design.design(FilterHighpass, 750.0f, SAMPLE_RATE, 2 * nSections, coeffs));
+    TEST_ASSERT_TRUE(g->iir.setCoefficients(nSections, coeffs));
+    BENCH_TIMING timing = Benchmark::time([&]() {
+      HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, SAMPLES);
+    });
+    snprintf(name, sizeof(name), "biquad_cascade.%i_sections.ns_per_sample", nSections);
+    Benchmark::report(name, timing.ns / SAMPLES, "ns/sample");
+    snprintf(name, sizeof(name), "biquad_cascade.%i_sections.cycles_per_sample", nSections);
+    Benchmark::report(name, timing.cycles / SAMPLES, "cycles/sample");
+    if (nSections > 0) {
+      snprintf(name, sizeof(name), "biquad_cascade.%i_sections.cycles_per_sample_per_section", nSections);
+      Benchmark::report(name, timing.cycles / SAMPLES / nSections, "cycles/sample/section");
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_rejects_bad_coefficients);
+  RUN_TEST(test_load_acks);
+  RUN_TEST(test_cost);
+  return UNITY_END();
+}
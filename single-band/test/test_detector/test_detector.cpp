@@ -0,0 +1,178 @@
+/*
+  The envelope detector (shared/EnvelopeDetector_F32.h): calibration, and its cost per sample.
+
+  A steady sine must read its amplitude in RMS mode (and, in hybrid mode, halfway between that
+  and its rectified mean), and the block kernel must give what the same running sum gives one
+  sample (and one function call) at a time.
+
+  Reports cycles per sample (TSC ticks) for:
+    - the detector alone, RMS and hybrid, as the block kernel and as a per-sample call
+    - the RMS for windows of 1, 5 and 10 ms (the running sum is summed afresh once per window,
+      one add per sample on average, so the cost hardly depends on the window)
+    - the detector plus the attack/release follower, as WDRCChannel_F32 runs them, in each mode
+      (peak mode skips the detector, so it is the follower alone)
+
+  Run with: pio test -e native -f test_detector
+*/
+
+#include <unity.h>
+#include <Tympan_Library.h>
+#include "../../../shared/WDRCChannel_F32.h"
+#include "../../../shared/host/Benchmark.h"
+#include "../../../shared/host/HostAudio.h"
+
+#define SAMPLE_RATE 44117.0f
+#define BLOCK_SIZE 128
+#define SIGNAL_SAMPLES (64 * BLOCK_SIZE)
+#define BLOCKS_PER_RUN 2000
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+BTNRH_WDRC::CHA_WDRC gha = { 1.0f, 50.0f, SAMPLE_RATE, 119.0f, 1.0f, 0.0f, 0.0f, 105.0f, 1.0f, 150.0f };
+float signal_[SIGNAL_SAMPLES], level[SIGNAL_SAMPLES], reference[SIGNAL_SAMPLES];
+
+void setUp(void) {
+  HostNoise noise(12345);
+  for (int ii = 0; ii < SIGNAL_SAMPLES; ii++) signal_[ii] = 0.1f * noise.gaussian();
+}
+
+void tearDown(void) {}
+
+// the same running sum of squares as the block kernel, one call per sample
+class PerSampleDetector {
+  public:
+    void configure(DETECTOR_MODE mode, float window_msec, float fs_Hz) {
+      window = (int)(window_msec * 0.001f * fs_Hz + 0.5f);
+      if (window < 1) window = 1;
+      if (window > ENVELOPE_DETECTOR_MAX_WINDOW) window = ENVELOPE_DETECTOR_MAX_WINDOW;
+      memset(ring, 0, sizeof(ring));
+      ringPos = 0;
+      sum = 0.0f;
+      this->mode = mode;
+      scale = 2.0f / window;
+    }
+
+    __attribute__((noinline)) float detect(float x) {
+      float sq = x * x;
+      sum += sq - ring[ringPos];
+      ring[ringPos] = sq;
+      if (++ringPos >= window) {
+        ringPos = 0;
+        sum = 0.0f;
+        for (int jj = 0; jj < window; jj++) sum += ring[jj];
+      }
+      float rms = sqrtf((sum > 0.0f) ? sum * scale : 0.0f);
+      return (mode == DetectorHybrid) ? 0.5f * (fabsf(x) + rms) : rms;
+    }
+
+  private:
+    DETECTOR_MODE mode = DetectorRMS;
+    int window = 1;
+    float scale = 2.0f;
+    float ring[ENVELOPE_DETECTOR_MAX_WINDOW];
+    int ringPos = 0;
+    float sum = 0.0f;
+};
+
+void test_sine_reads_amplitude(void) {
+  const float amplitude = 0.3f;
+  for (int ii = 0; ii < SIGNAL_SAMPLES; ii++) signal_[ii] = amplitude * sinf(2.0f * (float)M_PI * 1000.0f * ii / SAMPLE_RATE);
+  const DETECTOR_MODE modes[] = { DetectorRMS, DetectorHybrid };
+  for (DETECTOR_MODE mode : modes) {
+    EnvelopeDetector_F32 detector;
+    detector.configure(mode, 10.0f, SAMPLE_RATE);
+    detector.detect(signal_, level, SIGNAL_SAMPLES);
+    if (mode == DetectorRMS) {
+      for (int ii = SIGNAL_SAMPLES / 2; ii < SIGNAL_SAMPLES; ii++) TEST_ASSERT_FLOAT_WITHIN(0.01f * amplitude, amplitude, level[ii]);
+    } else {
+      // |x| swings around the RMS; on average it is 2/pi of the amplitude
+      double mean = 0.0;
+      for (int ii = SIGNAL_SAMPLES / 2; ii < SIGNAL_SAMPLES; ii++) mean += level[ii];
+      mean /= SIGNAL_SAMPLES / 2;
+      TEST_ASSERT_FLOAT_WITHIN(0.01f * amplitude, 0.5f * amplitude * (1.0f + 2.0f / (float)M_PI), mean);
+    }
+  }
+}
+
+void test_block_matches_per_sample(void) {
+  const DETECTOR_MODE modes[] = { DetectorRMS, DetectorHybrid };
+  for (DETECTOR_MODE mode : modes) {
+    EnvelopeDetector_F32 detector;
+    PerSampleDetector perSample;
+    detector.configure(mode, 5.0f, SAMPLE_RATE);
+    perSample.configure(mode, 5.0f, SAMPLE_RATE);
+    for (int start = 0; start < SIGNAL_SAMPLES; start += BLOCK_SIZE) detector.detect(&signal_[start], &level[start], BLOCK_SIZE);
+    for (int ii = 0; ii < SIGNAL_SAMPLES; ii++) reference[ii] = perSample.detect(signal_[ii]);
+    for (int ii = 0; ii < SIGNAL_SAMPLES; ii++) TEST_ASSERT_FLOAT_WITHIN(1e-6f * reference[ii] + 1e-9f, reference[ii], level[ii]);
+  }
+}
+
+static const char *modeName(DETECTOR_MODE mode) {
+  return mode == DetectorPeak ? "peak" : (mode == DetectorRMS ? "rms" : "hybrid");
+}
+
+void test_cost(void) {
+  char name[80];
+  const double samples = (double)BLOCKS_PER_RUN * BLOCK_SIZE;
+  const DETECTOR_MODE modes[] = { DetectorPeak, DetectorRMS, DetectorHybrid };
+  float out[BLOCK_SIZE];
+
+  // the detector alone: block kernel against a call per sample
+  for (DETECTOR_MODE mode : modes) {
+    if (mode == DetectorPeak) continue;
+    EnvelopeDetector_F32 detector;
+    PerSampleDetector perSample;
+    detector.configure(mode, 5.0f, SAMPLE_RATE);
+    perSample.configure(mode, 5.0f, SAMPLE_RATE);
+    BENCH_TIMING block = Benchmark::time([&]() {
+      for (int ii = 0; ii < BLOCKS_PER_RUN; ii++) detector.detect(&signal_[(ii % 64) * BLOCK_SIZE], out, BLOCK_SIZE);
+    });
+    BENCH_TIMING calls = Benchmark::time([&]() {
+      for (int ii = 0; ii < BLOCKS_PER_RUN; ii++) {
+        const float *x = &signal_[(ii % 64) * BLOCK_SIZE];
+        for (int jj = 0; jj < BLOCK_SIZE; jj++) out[jj] = perSample.detect(x[jj]);
+      }
+    });
+    snprintf(name, sizeof(name), "detector.%s.block.cycles_per_sample", modeName(mode));
+    Benchmark::report(name, block.cycles / samples, "cycles/sample");
+    snprintf(name, sizeof(name), "detector.%s.per_sample.cycles_per_sample", modeName(mode));
+    Benchmark::report(name, calls.cycles / samples, "cycles/sample");
+  }
+
+  // the window length
+  const float windows_msec[] = { 1.0f, 5.0f, 10.0f };
+  for (float window_msec : windows_msec) {
+    EnvelopeDetector_F32 detector;
+    detector.configure(DetectorRMS, window_msec, SAMPLE_RATE);
+    BENCH_TIMING timing = Benchmark::time([&]() {
+      for (int ii = 0; ii < BLOCKS_PER_RUN; ii++) detector.detect(&signal_[(ii % 64) * BLOCK_SIZE], out, BLOCK_SIZE);
+    });
+    snprintf(name, sizeof(name), "detector.rms.%.0fms_window.cycles_per_sample", window_msec);
+    Benchmark::report(name, timing.cycles / samples, "cycles/sample");
+  }
+
+  // with the follower, as the compressor runs it
+  for (DETECTOR_MODE mode : modes) {
+    WDRCChannel_F32 *channel = new WDRCChannel_F32;
+    channel->publishParams(&gha);
+    channel->publishDetector(mode, 5.0f);
+    channel->acquireParams();
+    BENCH_TIMING timing = Benchmark::time([&]() {
+      for (int ii = 0; ii < BLOCKS_PER_RUN; ii++) channel->calcEnvelope_block(&signal_[(ii % 64) * BLOCK_SIZE], out, BLOCK_SIZE);
+    });
+    delete channel;
+    snprintf(name, sizeof(name), "detector.%s.envelope.cycles_per_sample", modeName(mode));
+    Benchmark::report(name, timing.cycles / samples, "cycles/sample");
+    snprintf(name, sizeof(name), "detector.%s.envelope.ns_per_sample", modeName(mode));
+    Benchmark::report(name, timing.ns / samples, "ns/sample");
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_sine_reads_amplitude);
+  RUN_TEST(test_block_matches_per_sample);
+  RUN_TEST(test_cost);
+  return UNITY_END();
+}
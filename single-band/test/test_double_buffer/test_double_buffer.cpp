@@ -0,0 +1,157 @@
+/*
+  Stress test for DoubleBuffer: a writer hammering publish() and a reader checking every value it
+  acquires for torn copies.
+
+  DoubleBuffer relies on one guarantee of the Teensy: the reader (the audio interrupt) can preempt
+  the writer (loop()) at any instruction, but the writer never runs while the reader does. Two
+  plain threads would not give that guarantee, so the reader runs the way the audio interrupt
+  does: as the handler of a periodic timer signal delivered to the writer's thread, which lands
+  anywhere in publish(). Every published value is filled with one
+  sequence number; a read that mixes two, or goes back in time, is torn.
+
+  As a check that the test can see torn reads at all, the same run against a single slot that is
+  written in place must find some.
+
+  Run with: pio test -e native -f test_double_buffer
+*/
+
+#include <unity.h>
+#include <atomic>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include "../../../shared/DoubleBuffer.h"
+#include "../../../shared/host/HostAudio.h"
+
+#define VALUES 64         // about the size of a biquad cascade's coefficients
+#define INTERRUPTS 20000
+#define INTERRUPT_PERIOD_NS 37000   // a little faster than 128-sample blocks at 96 kHz
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+typedef struct {
+  uint32_t sequence;
+  float values[VALUES];
+} PARAMS;
+
+// what DoubleBuffer is there to prevent: one slot, written in place
+class SingleBuffer {
+  public:
+    void publish(const PARAMS &value) {
+      slot = value;
+      __asm__ volatile ("" ::: "memory");
+      pending = true;
+    }
+    const PARAMS *acquire(void) {
+      if (!pending) return NULL;
+      pending = false;
+      return &slot;
+    }
+  private:
+    PARAMS slot;
+    volatile bool pending = false;
+};
+
+// the reader's tally, kept by the signal handler
+static volatile unsigned long interruptsHandled, reads, tornReads, staleReads;
+static volatile uint32_t lastSequence;
+static void (*readParams)(void);
+
+template <typename BUFFER>
+struct Stress {
+  static BUFFER buffer;
+
+  static void read(void) {
+    const PARAMS *params = buffer.acquire();
+    if (!params) return;
+    PARAMS copy = *params;   // what the audio side would work from for the block
+    reads = reads + 1;
+    bool torn = false;
+    for (int ii = 0; ii < VALUES; ii++) torn |= (copy.values[ii] != (float)(copy.sequence & 0xFFFFF));
+    if (torn) tornReads = tornReads + 1;
+    if (copy.sequence < lastSequence) staleReads = staleReads + 1;
+    lastSequence = copy.sequence;
+  }
+
+  static void run(void) {
+    interruptsHandled = reads = tornReads = staleReads = 0;
+    lastSequence = 0;
+    readParams = read;
+    std::atomic<bool> done(false);
+    std::atomic<pid_t> writerId(0);
+
+    // loop(), publishing as fast as it can
+    std::thread writer([&]() {
+      writerId = (pid_t)syscall(SYS_gettid);
+      PARAMS params;
+      for (uint32_t sequence = 1; !done; sequence++) {
+        params.sequence = sequence;
+        for (int ii = 0; ii < VALUES; ii++) params.values[ii] = (float)(sequence & 0xFFFFF);
+        buffer.publish(params);
+      }
+    });
+    while (!writerId) sched_yield();
+
+    // the "audio interrupt": a periodic timer signal, delivered to the writer's thread wherever
+    // it happens to be
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGUSR1;
+    event._sigev_un._tid = writerId;
+    timer_t timer;
+    TEST_ASSERT_EQUAL_INT(0, timer_create(CLOCK_MONOTONIC, &event, &timer));
+    struct itimerspec period = { { 0, INTERRUPT_PERIOD_NS }, { 0, INTERRUPT_PERIOD_NS } };
+    timer_settime(timer, 0, &period, NULL);
+    while (interruptsHandled < INTERRUPTS) usleep(10000);
+    timer_delete(timer);
+    done = true;
+    writer.join();
+  }
+};
+
+template <typename BUFFER> BUFFER Stress<BUFFER>::buffer;
+
+static void onSignal(int signal) {
+  readParams();
+  interruptsHandled = interruptsHandled + 1;
+}
+
+void setUp(void) {
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = onSignal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGUSR1, &action, NULL);
+}
+
+void tearDown(void) {
+  signal(SIGUSR1, SIG_IGN);
+}
+
+void test_double_buffer_never_tears(void) {
+  Stress<DoubleBuffer<PARAMS>>::run();
+  printf("DoubleBuffer: %lu reads, %lu torn, %lu stale\n", reads, tornReads, staleReads);
+  TEST_ASSERT_TRUE(reads > INTERRUPTS / 2);
+  TEST_ASSERT_EQUAL_INT(0, tornReads);
+  TEST_ASSERT_EQUAL_INT(0, staleReads);
+}
+
+void test_single_slot_tears(void) {
+  Stress<SingleBuffer>::run();
+  printf("single slot: %lu reads, %lu torn\n", reads, tornReads);
+  TEST_ASSERT_TRUE(tornReads > 0);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_double_buffer_never_tears);
+  RUN_TEST(test_single_slot_tears);
+  return UNITY_END();
+}
@@ -0,0 +1,176 @@
+/*
+  Batches in the ExtendedSerialManager: one apply per batch, and no batch left hanging.
+
+  A client moving seven knobs one by one costs seven applies, or one inside a batch; the benchmark
+  reports the applies and the time per seven changes both ways (parsing and responses included),
+  and the time of one apply on its own, with an apply that does what the single-band sketch's
+  does for the compressor and the high-pass (publish the parameters, design the filters). A batch that is aborted, times out or is interrupted by a mode switch must put
+  its knobs back and apply nothing.
+
+  Run with: pio test -e native -f test_esm_batch
+*/
+
+#include <unity.h>
+#include <Tympan_Library.h>
+#include "../../../shared/AudioEffectCompWDRCStereo_F32.h"
+#include "../../../shared/AudioFilterBiquadCascade_F32.h"
+#include "../../../shared/FilterDesign.h"
+#include "../../../shared/ExtendedSerialManager.h"
+#include "../../../shared/host/Benchmark.h"
+
+#define CHANNELS 2
+#define KNOBS 14
+#define CHANGES 7
+#define BATCHES_PER_RUN 2000
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+float values[CHANNELS * KNOBS];
+CONFIGURABLE knobs[CHANNELS * KNOBS];
+bool runCommand(char c) { return true; }
+COMMAND commands[] = { { 'x', "do nothing", runCommand } };
+void activate(int channel, int knob) {}
+
+AudioEffectCompWDRCStereo_F32 compWDRC;
+AudioFilterBiquadCascade_F32 iir[CHANNELS];
+ButterworthDesign hpDesign;
+int applies = 0;
+
+// the single-band sketch's applyConfiguration(), for the nodes that matter most
+void apply(void) {
+  applies++;
+  for (int ch = 0; ch < CHANNELS; ch++) {
+    const float *v = &values[ch * KNOBS];
+    BTNRH_WDRC::CHA_WDRC gha = { v[0], v[1], 44117.0f, 119.0f, 0.1f, v[2], v[3], v[4], v[5], v[6] };
+    compWDRC.publishParams(ch, &gha);
+    float coeffs[5 * FILTER_DESIGN_MAX_SECTIONS];
+    int nSections = hpDesign.design(FilterHighpass, 100.0f + 10.0f * v[7], 44117.0f, 4, coeffs);
+    iir[ch].setCoefficients(nSections, coeffs);
+  }
+}
+
+ExtendedSerialManager *manager;
+FILE *devNull;
+
+void setUp(void) {
+  for (int ii = 0; ii < CHANNELS * KNOBS; ii++) {
+    values[ii] = 50.0f;
+    knobs[ii] = { "knob", &values[ii], "", 0.0f, 100.0f };
+  }
+  applies = 0;
+  devNull = fopen("/dev/null", "w");
+  if (devNull) myTympan.setOutput(devNull);
+  manager = new ExtendedSerialManager(knobs, CHANNELS, KNOBS, commands, 1, apply, activate, 0, 0);
+  manager->processByte('/');
+}
+
+void tearDown(void) {
+  delete manager;
+  myTympan.setOutput(stdout);
+  if (devNull) fclose(devNull);
+}
+
+static void feed(const char *str) {
+  while (*str) manager->processByte(*str++);
+}
+
+static uint16_t crc16(uint16_t crc, uint8_t b) {
+  crc ^= (uint16_t)b << 8;
+  for (int ii = 0; ii < 8; ii++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  return crc;
+}
+
+static const char *changes[CHANGES] = { "*0A10;", "*0B20;", "*0C30;", "*0D40;", "*0E50;", "*0F60;", "*1H70;" };
+
+static void sendChanges(void) {
+  for (int ii = 0; ii < CHANGES; ii++) feed(changes[ii]);
+}
+
+static void expectUnchanged(void) {
+  for (int ii = 0; ii < CHANNELS * KNOBS; ii++) TEST_ASSERT_EQUAL_FLOAT(50.0f, values[ii]);
+}
+
+void test_one_apply_per_batch(void) {
+  sendChanges();
+  TEST_ASSERT_EQUAL_INT(CHANGES, applies);
+  applies = 0;
+  feed("[;");
+  sendChanges();
+  TEST_ASSERT_EQUAL_INT(0, applies);
+  feed("];");
+  TEST_ASSERT_EQUAL_INT(1, applies);
+  TEST_ASSERT_EQUAL_FLOAT(70.0f, values[KNOBS + 7]);
+
+  BENCH_TIMING unbatched = Benchmark::time([&]() {
+    for (int ii = 0; ii < BATCHES_PER_RUN; ii++) sendChanges();
+  });
+  BENCH_TIMING batched = Benchmark::time([&]() {
+    for (int ii = 0; ii < BATCHES_PER_RUN; ii++) {
+      feed("[;");
+      sendChanges();
+      feed("];");
+    }
+  });
+  BENCH_TIMING applyOnly = Benchmark::time([&]() {
+    for (int ii = 0; ii < BATCHES_PER_RUN; ii++) apply();
+  });
+  Benchmark::report("esm.apply.ns_per_apply", applyOnly.ns / BATCHES_PER_RUN, "ns");
+  Benchmark::report("esm.unbatched.applies_per_7_changes", CHANGES, "applies");
+  Benchmark::report("esm.unbatched.ns_per_7_changes", unbatched.ns / BATCHES_PER_RUN, "ns");
+  Benchmark::report("esm.batched.applies_per_7_changes", 1, "applies");
+  Benchmark::report("esm.batched.ns_per_7_changes", batched.ns / BATCHES_PER_RUN, "ns");
+}
+
+void test_abort_rolls_back(void) {
+  feed("[;");
+  sendChanges();
+  feed("]0;");
+  expectUnchanged();
+  TEST_ASSERT_EQUAL_INT(0, applies);
+  feed("[;");   // and a new one can be started
+  feed("*0A10;");
+  feed("];");
+  TEST_ASSERT_EQUAL_INT(1, applies);
+}
+
+void test_idle_batch_times_out(void) {
+  feed("[;");
+  sendChanges();
+  manager->service(1000);
+  manager->service(1000 + TYMPAN_ESM_BATCH_TIMEOUT_MILLIS - 1);
+  TEST_ASSERT_EQUAL_FLOAT(10.0f, values[0]);   // still open
+  feed("*0G5;");   // and kept open by what arrives
+  manager->service(1000 + TYMPAN_ESM_BATCH_TIMEOUT_MILLIS);
+  manager->service(1000 + 2 * TYMPAN_ESM_BATCH_TIMEOUT_MILLIS - 1);
+  TEST_ASSERT_EQUAL_FLOAT(10.0f, values[0]);
+  manager->service(1000 + 2 * TYMPAN_ESM_BATCH_TIMEOUT_MILLIS);
+  expectUnchanged();
+  feed("];");   // nothing left to commit
+  TEST_ASSERT_EQUAL_INT(0, applies);
+}
+
+void test_mode_switch_ends_batch(void) {
+  feed("[;");
+  sendChanges();
+  feed("!~;");   // to binary mode...
+  expectUnchanged();
+  uint16_t crc = crc16(crc16(0xFFFF, 1), TYMPAN_ESM_BINARY_EXIT);
+  const uint8_t exitFrame[] = { TYMPAN_ESM_BINARY_SYNC, 1, TYMPAN_ESM_BINARY_EXIT, (uint8_t)(crc & 0xff), (uint8_t)(crc >> 8) };
+  for (uint8_t b : exitFrame) manager->processByte((char)b);
+  TEST_ASSERT_FALSE(manager->isBinary());   // ...and back to basic
+  manager->processByte('/');
+  feed("[;");   // a new batch starts right away
+  feed("*0A10;");
+  feed("];");
+  TEST_ASSERT_EQUAL_INT(1, applies);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_one_apply_per_batch);
+  RUN_TEST(test_abort_rolls_back);
+  RUN_TEST(test_idle_batch_times_out);
+  RUN_TEST(test_mode_switch_ends_batch);
+  return UNITY_END();
+}
@@ -0,0 +1,215 @@
+/*
+  Robustness of the ExtendedSerialManager's binary mode.
+
+  Non-finite values are refused, and the parser finds its way back to the frames that follow a
+  corrupted length byte, an oversized one or a frame the client abandoned halfway through. The
+  manager's responses are written to a memory buffer and parsed back into frames.
+
+  Run with: pio test -e native -f test_esm_binary
+*/
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "../../../shared/ExtendedSerialManager.h"
+
+#define CHANNELS 2
+#define KNOBS 14
+#define OUTPUT_SIZE 4096
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+float values[CHANNELS * KNOBS];
+CONFIGURABLE knobs[CHANNELS * KNOBS];
+int applies = 0;
+
+bool runCommand(char c) { return true; }
+COMMAND commands[] = { { 'x', "do nothing", runCommand } };
+void apply(void) { applies++; }
+void activate(int channel, int knob) {}
+
+ExtendedSerialManager *manager;
+char output[OUTPUT_SIZE];
+FILE *outputFile;
+int outputRead;   // how much of the output the test has looked at
+
+void setUp(void) {
+  for (int ii = 0; ii < CHANNELS * KNOBS; ii++) {
+    values[ii] = 50.0f;
+    knobs[ii] = { "knob", &values[ii], "dB", 0.0f, 100.0f };
+  }
+  applies = 0;
+  outputFile = fmemopen(output, OUTPUT_SIZE, "w");
+  setvbuf(outputFile, NULL, _IONBF, 0);
+  myTympan.setOutput(outputFile);
+  manager = new ExtendedSerialManager(knobs, CHANNELS, KNOBS, commands, 1, apply, activate, 0, 0);
+  manager->processByte('~');
+  outputRead = (int)ftell(outputFile);   // past the ACK=1 line
+}
+
+void tearDown(void) {
+  delete manager;
+  myTympan.setOutput(stdout);
+  fclose(outputFile);
+}
+
+static uint16_t crc16(uint16_t crc, uint8_t b) {
+  crc ^= (uint16_t)b << 8;
+  for (int ii = 0; ii < 8; ii++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  return crc;
+}
+
+// wraps a payload into a frame, returns the frame length
+static int frame(const uint8_t *payload, int length, uint8_t *out) {
+  uint16_t crc = crc16(0xFFFF, length);
+  out[0] = TYMPAN_ESM_BINARY_SYNC;
+  out[1] = (uint8_t)length;
+  for (int ii = 0; ii < length; ii++) {
+    out[2 + ii] = payload[ii];
+    crc = crc16(crc, payload[ii]);
+  }
+  out[2 + length] = (uint8_t)(crc & 0xff);
+  out[3 + length] = (uint8_t)(crc >> 8);
+  return length + 4;
+}
+
+static int getFrame(int channel, int knob, uint8_t *out) {
+  uint8_t payload[3] = { TYMPAN_ESM_BINARY_GET, (uint8_t)channel, (uint8_t)knob };
+  return frame(payload, sizeof(payload), out);
+}
+
+static void feed(const uint8_t *bytes, int length) {
+  for (int ii = 0; ii < length; ii++) manager->processByte((char)bytes[ii]);
+}
+
+// the next response frame's payload (checking its framing and CRC); returns its length
+static int nextResponse(uint8_t *payload) {
+  int written = (int)ftell(outputFile);
+  const uint8_t *bytes = (const uint8_t *)output;
+  TEST_ASSERT_TRUE_MESSAGE(written - outputRead >= 4, "no response");
+  TEST_ASSERT_EQUAL_INT(TYMPAN_ESM_BINARY_SYNC, bytes[outputRead]);
+  int length = bytes[outputRead + 1];
+  TEST_ASSERT_TRUE(written - outputRead >= length + 4);
+  uint16_t crc = crc16(0xFFFF, length);
+  for (int ii = 0; ii < length; ii++) {
+    payload[ii] = bytes[outputRead + 2 + ii];
+    crc = crc16(crc, payload[ii]);
+  }
+  TEST_ASSERT_EQUAL_INT(crc & 0xff, bytes[outputRead + 2 + length]);
+  TEST_ASSERT_EQUAL_INT(crc >> 8, bytes[outputRead + 3 + length]);
+  outputRead += length + 4;
+  return length;
+}
+
+static void expectAck(int status) {
+  uint8_t payload[256];
+  TEST_ASSERT_EQUAL_INT(2, nextResponse(payload));
+  TEST_ASSERT_EQUAL_INT(TYMPAN_ESM_BINARY_ACK, payload[0]);
+  TEST_ASSERT_EQUAL_INT(status, payload[1]);
+}
+
+static void expectValue(int channel, int knob, float value) {
+  uint8_t payload[256];
+  float received;
+  TEST_ASSERT_EQUAL_INT(3 + sizeof(float), nextResponse(payload));
+  TEST_ASSERT_EQUAL_INT(TYMPAN_ESM_BINARY_VALUE, payload[0]);
+  TEST_ASSERT_EQUAL_INT(channel, payload[1]);
+  TEST_ASSERT_EQUAL_INT(knob, payload[2]);
+  memcpy(&received, &payload[3], sizeof(float));
+  TEST_ASSERT_EQUAL_FLOAT(value, received);
+}
+
+static void expectNothingMore(void) {
+  TEST_ASSERT_EQUAL_INT(outputRead, (int)ftell(outputFile));
+}
+
+void test_non_finite_set_is_refused(void) {
+  const float refused[] = { NAN, INFINITY, -INFINITY };
+  for (float value : refused) {
+    uint8_t payload[7] = { TYMPAN_ESM_BINARY_SET, 1, 3 }, bytes[16];
+    memcpy(&payload[3], &value, sizeof(float));
+    feed(bytes, frame(payload, sizeof(payload), bytes));
+    expectAck(0);
+  }
+  TEST_ASSERT_EQUAL_FLOAT(50.0f, values[KNOBS + 3]);
+  TEST_ASSERT_EQUAL_INT(0, applies);
+  expectNothingMore();
+}
+
+void test_resync_after_corrupt_length(void) {
+  // the first frame's length says 5 instead of 3, so it swallows the sync and length bytes of
+  // the second one; the second one must still be answered
+  values[4] = 12.5f;
+  uint8_t bytes[32];
+  int length = getFrame(0, 2, bytes);
+  bytes[1] = 5;
+  length += getFrame(0, 4, &bytes[length]);
+  feed(bytes, length);
+  expectAck(0);
+  expectValue(0, 4, 12.5f);
+  expectNothingMore();
+}
+
+void test_resync_after_oversized_length(void) {
+  uint8_t bytes[32] = { TYMPAN_ESM_BINARY_SYNC, 200 };
+  int length = 2 + getFrame(1, 0, &bytes[2]);
+  feed(bytes, length);
+  expectAck(0);
+  expectValue(1, 0, 50.0f);
+  expectNothingMore();
+}
+
+void test_abandoned_frame_times_out(void) {
+  uint8_t bytes[16];
+  getFrame(0, 1, bytes);
+  feed(bytes, 3);   // sync, length and opcode, then nothing
+  manager->service(1000);
+  manager->service(1000 + TYMPAN_ESM_BINARY_TIMEOUT_MILLIS - 1);
+  expectNothingMore();   // still waiting
+  manager->service(1000 + TYMPAN_ESM_BINARY_TIMEOUT_MILLIS);
+  expectAck(0);
+  feed(bytes, getFrame(0, 1, bytes));
+  expectValue(0, 1, 50.0f);
+  expectNothingMore();
+}
+
+void test_sync_inside_abandoned_frame(void) {
+  // a frame cut short after its first bytes, then the start of a real one: when the first
+  // times out, the second must be picked up from the bytes already received
+  uint8_t bytes[32] = { TYMPAN_ESM_BINARY_SYNC, 7, TYMPAN_ESM_BINARY_SET };
+  int length = 3 + getFrame(1, 2, &bytes[3]);
+  feed(bytes, length - 2);   // all but the second frame's CRC
+  manager->service(0);
+  manager->service(TYMPAN_ESM_BINARY_TIMEOUT_MILLIS);
+  expectAck(0);
+  expectNothingMore();
+  feed(&bytes[length - 2], 2);
+  expectValue(1, 2, 50.0f);
+  expectNothingMore();
+}
+
+void test_non_finite_ascii_values_are_refused(void) {
+  uint8_t bytes[8], payload[1] = { TYMPAN_ESM_BINARY_EXIT };
+  feed(bytes, frame(payload, sizeof(payload), bytes));
+  expectAck(1);
+  manager->processByte('/');
+  const char *command = "=0=1,2,3,4,5,6,nan,8,9,10,11,12,13,14;";
+  for (const char *c = command; *c; c++) manager->processByte(*c);
+  fputc('\0', outputFile);
+  TEST_ASSERT_NOT_NULL(strstr(&output[outputRead], "ACK=0"));
+  TEST_ASSERT_EQUAL_FLOAT(50.0f, values[6]);
+  TEST_ASSERT_EQUAL_INT(0, applies);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_non_finite_set_is_refused);
+  RUN_TEST(test_resync_after_corrupt_length);
+  RUN_TEST(test_resync_after_oversized_length);
+  RUN_TEST(test_abandoned_frame_times_out);
+  RUN_TEST(test_sync_inside_abandoned_frame);
+  RUN_TEST(test_non_finite_ascii_values_are_refused);
+  return UNITY_END();
+}
@@ -0,0 +1,169 @@
+/*
+  Throughput of the ExtendedSerialManager parser, per command type.
+
+  Every command is fed byte by byte through processByte(), as loop() does with what comes off the
+  serial port, with the responses going to /dev/null. The knob table has the single-band sketch's
+  shape (two ears, fourteen knobs each). Reports ns/command and commands/sec for each type, see
+  shared/host/Benchmark.h for the output format.
+
+  Run with: pio test -e native -f test_esm_throughput
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include "../../../shared/ExtendedSerialManager.h"
+#include "../../../shared/host/Benchmark.h"
+
+#define CHANNELS 2
+#define KNOBS 14
+#define COMMANDS_PER_RUN 20000
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+float values[CHANNELS * KNOBS];
+CONFIGURABLE knobs[CHANNELS * KNOBS];
+int applies = 0;
+
+bool runCommand(char c) { return true; }
+COMMAND commands[] = {
+  { 'x', "do nothing", runCommand },
+  { 'y', "do nothing either", runCommand },
+};
+
+void apply(void) { applies++; }
+void activate(int channel, int knob) {}
+
+ExtendedSerialManager *manager;
+
+void setUp(void) {
+  for (int ii = 0; ii < CHANNELS * KNOBS; ii++) {
+    values[ii] = 50.0f;
+    knobs[ii] = { "knob", &values[ii], "dB", 0.0f, 100.0f };
+  }
+  applies = 0;
+  manager = new ExtendedSerialManager(knobs, CHANNELS, KNOBS, commands, 2, apply, activate, 0, 0);
+}
+
+void tearDown(void) {
+  delete manager;
+}
+
+static void feed(const char *bytes, int length) {
+  for (int ii = 0; ii < length; ii++) manager->processByte(bytes[ii]);
+}
+
+static void feed(const char *str) {
+  feed(str, strlen(str));
+}
+
+static uint16_t crc16(uint16_t crc, uint8_t b) {
+  crc ^= (uint16_t)b << 8;
+  for (int ii = 0; ii < 8; ii++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  return crc;
+}
+
+// wraps a payload into a frame, returns the frame length
+static int frame(const uint8_t *payload, int length, char *out) {
+  uint16_t crc = crc16(0xFFFF, length);
+  out[0] = (char)TYMPAN_ESM_BINARY_SYNC;
+  out[1] = (char)length;
+  for (int ii = 0; ii < length; ii++) {
+    out[2 + ii] = (char)payload[ii];
+    crc = crc16(crc, payload[ii]);
+  }
+  out[2 + length] = (char)(crc & 0xff);
+  out[3 + length] = (char)(crc >> 8);
+  return length + 4;
+}
+
+// times COMMANDS_PER_RUN copies of one command and reports it under esm.<type>
+static void benchmarkCommand(const char *type, const char *bytes, int length) {
+  BENCH_TIMING timing = Benchmark::time([&]() {
+    for (int ii = 0; ii < COMMANDS_PER_RUN; ii++) feed(bytes, length);
+  });
+  double nsPerCommand = timing.ns / COMMANDS_PER_RUN;
+  char name[64];
+  snprintf(name, sizeof(name), "esm.%s.ns_per_command", type);
+  Benchmark::report(name, nsPerCommand, "ns/command");
+  snprintf(name, sizeof(name), "esm.%s.commands_per_sec", type);
+  Benchmark::report(name, 1e9 / nsPerCommand, "commands/s");
+}
+
+static void benchmarkCommand(const char *type, const char *str) {
+  benchmarkCommand(type, str, strlen(str));
+}
+
+void test_basic_run(void) {
+  benchmarkCommand("basic_run", "x");
+}
+
+void test_extended_set(void) {
+  feed("/");
+  benchmarkCommand("set", "*1C25;");
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 25.0f, values[KNOBS + 2]);
+  TEST_ASSERT_TRUE(applies > 0);
+}
+
+void test_extended_query(void) {
+  feed("/");
+  benchmarkCommand("query", "&1C;");
+}
+
+void test_extended_increment(void) {
+  feed("/");
+  benchmarkCommand("increment", "+0A;");
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 100.0f, values[0]);
+}
+
+void test_extended_run(void) {
+  feed("/");
+  benchmarkCommand("run", "!x;");
+}
+
+void test_extended_apply_slice(void) {
+  feed("/");
+  benchmarkCommand("apply_slice", "=1=1.5,2.5,3.5,4.5,5.5,6.5,7.5,8.5,9.5,10.5,11.5,12.5,13.5,14.5;");
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 14.5f, values[2 * KNOBS - 1]);
+}
+
+void test_extended_layout(void) {
+  feed("/");
+  benchmarkCommand("layout", "#;");
+}
+
+void test_binary_set(void) {
+  feed("~");
+  uint8_t payload[7] = { TYMPAN_ESM_BINARY_SET, 1, 3 };
+  float value = 42.0f;
+  memcpy(&payload[3], &value, sizeof(float));
+  char bytes[16];
+  int length = frame(payload, sizeof(payload), bytes);
+  benchmarkCommand("binary_set", bytes, length);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 42.0f, values[KNOBS + 3]);
+}
+
+void test_binary_get(void) {
+  feed("~");
+  uint8_t payload[3] = { TYMPAN_ESM_BINARY_GET, 0, 5 };
+  char bytes[16];
+  int length = frame(payload, sizeof(payload), bytes);
+  benchmarkCommand("binary_get", bytes, length);
+}
+
+int main(int argc, char **argv) {
+  FILE *devNull = fopen("/dev/null", "w");
+  if (devNull) myTympan.setOutput(devNull);
+  UNITY_BEGIN();
+  RUN_TEST(test_basic_run);
+  RUN_TEST(test_extended_set);
+  RUN_TEST(test_extended_query);
+  RUN_TEST(test_extended_increment);
+  RUN_TEST(test_extended_run);
+  RUN_TEST(test_extended_apply_slice);
+  RUN_TEST(test_extended_layout);
+  RUN_TEST(test_binary_set);
+  RUN_TEST(test_binary_get);
+  return UNITY_END();
+}
@@ -0,0 +1,281 @@
+/*
+  The table-based WDRC kernels of FastWDRC.h (TYMPAN_WDRC_FAST) against the stock ones.
+
+  The dB conversions are checked over their whole range against the math library in double
+  precision, the tables and (with SSE2) the polynomials both, and the gain the fast compressor
+  hands out for two reference signals (a noise level sweep and tone bursts) against the same
+  curve evaluated in double precision, for three fittings (one with cr < 1 and the compression
+  kneepoint above the expansion's). Four samples at a time and through the tables alone (blocks
+  of three) both must hold. The stock gain is measured the same way for comparison (its log2 is
+  a cubic approximation), and the fast gain must also match the stock one directly to within
+  that. The envelope is the same recursion either way and must come out the same.
+
+  Reports the worst errors in dB and the cost per sample, fast and stock, of envelope plus gain
+  and of the gain alone. These are host numbers (SSE2); the Teensy's have not been measured.
+
+  Run with: pio test -e native -f test_fast_wdrc
+*/
+
+#include <unity.h>
+#include <Tympan_Library.h>
+#include "../../../shared/FastWDRC.h"
+#include "../../../shared/host/Benchmark.h"
+#include "../../../shared/host/HostAudio.h"
+
+#define SAMPLE_RATE 44117.0f
+#define BLOCK_SIZE 128
+#define SIGNAL_SAMPLES (10 * 44117)
+#define BLOCKS_PER_RUN 2000
+#define TOLERANCE_DB 1e-4
+#define STOCK_TOLERANCE_DB 0.05   // the stock log2's error, doubled by slopes of 1 in dB/dB
+#define KNEE_MARGIN_DB 0.02
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+static const BTNRH_WDRC::CHA_WDRC fittings[] = {
+  { 1.0f, 50.0f, SAMPLE_RATE, 119.0f, 0.5f, 60.0f, 10.0f, 70.0f, 2.0f, 100.0f },
+  { 5.0f, 300.0f, SAMPLE_RATE, 115.0f, 0.7f, 45.0f, 25.0f, 50.0f, 3.5f, 95.0f },
+  { 1.0f, 50.0f, SAMPLE_RATE, 119.0f, 0.5f, 40.0f, 0.0f, 105.0f, 0.5f, 105.0f },   // cr < 1, tk >= exp_end_knee
+};
+
+static float signal_[SIGNAL_SAMPLES], envFast[SIGNAL_SAMPLES], envStock[SIGNAL_SAMPLES], gain[SIGNAL_SAMPLES];
+static float stockGainOut[SIGNAL_SAMPLES];
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// noise rising from -100 to 0 dBFS
+static void levelSweep(float *x, int n) {
+  HostNoise noise(777);
+  for (int ii = 0; ii < n; ii++) x[ii] = powf(10.0f, -5.0f + 5.0f * ii / n) * noise.gaussian();
+}
+
+// 1 kHz at -6 and -46 dBFS, alternating every 100 ms
+static void toneBursts(float *x, int n) {
+  int burst = (int)(0.1f * SAMPLE_RATE);
+  for (int ii = 0; ii < n; ii++) {
+    float amplitude = ((ii / burst) & 1) ? 0.005f : 0.5f;
+    x[ii] = amplitude * sinf(2.0f * (float)M_PI * 1000.0f * ii / SAMPLE_RATE);
+  }
+}
+
+// the BTNRH WDRC circuit in double precision, as AudioCalcGainWDRC_F32 lays it out
+static double referenceGain_dB(double env, const BTNRH_WDRC::CHA_WDRC &f) {
+  double tk = f.tk, cr = f.cr;
+  if (tk + f.tkgain > f.bolt) tk = f.bolt - f.tkgain;
+  double tkgo = f.tkgain + tk * (1.0 - 1.0 / cr);
+  double pblt = cr * (f.bolt - tkgo);
+  double crConst = 1.0 / cr - 1.0;
+  double kneeGain = (tk < f.exp_end_knee) ? crConst * f.exp_end_knee + tkgo : f.tkgain;
+  double pdb = 20.0 * log10(env) + f.maxdB;
+  double expCr = (f.exp_cr > 0.01f) ? f.exp_cr : 0.01f;
+  if (pdb < f.exp_end_knee) return kneeGain - (f.exp_end_knee - pdb) * (1.0 / expCr - 1.0);
+  if (pdb < tk && cr >= 1.0) return f.tkgain;
+  if (pdb > pblt) return f.bolt + (pdb - pblt) / 10.0 - pdb;
+  return crConst * pdb + tkgo;
+}
+
+// With cr < 1 and tk >= exp_end_knee the curve jumps at exp_end_knee (the expansion hangs off
+// tkgain, the compression line is elsewhere); which side a level right at it lands on is down to
+// the last digits of the log2, so levels that close are left out of the comparisons.
+static bool nearJump(double env, const BTNRH_WDRC::CHA_WDRC &f) {
+  return fabs(20.0 * log10(env) + f.maxdB - f.exp_end_knee) < KNEE_MARGIN_DB;
+}
+
+static double maxGainError_dB(const float *env, const float *g, int n, const BTNRH_WDRC::CHA_WDRC &f) {
+  double worst = 0.0;
+  for (int ii = 0; ii < n; ii++) {
+    if (!nearJump(env[ii], f)) worst = fmax(worst, fabs(20.0 * log10((double)g[ii]) - referenceGain_dB(env[ii], f)));
+  }
+  return worst;
+}
+
+static double maxDifference_dB(const float *env, const float *a, const float *b, int n, const BTNRH_WDRC::CHA_WDRC &f) {
+  double worst = 0.0;
+  for (int ii = 0; ii < n; ii++) {
+    if (!nearJump(env[ii], f)) worst = fmax(worst, fabs(20.0 * log10((double)a[ii] / b[ii])));
+  }
+  return worst;
+}
+
+void test_db_conversions(void) {
+  double worstDb2 = 0.0, worstUndb2 = 0.0;
+  for (int ii = 0; ii <= 1000000; ii++) {
+    double x = pow(10.0, -9.0 + 12.0 * ii / 1000000.0);   // -180 to +60 dB
+    worstDb2 = fmax(worstDb2, fabs(FastDB::db2((float)x) - 20.0 * log10((double)(float)x)));
+    float dB = (float)(-180.0 + 240.0 * ii / 1000000.0);
+    worstUndb2 = fmax(worstUndb2, fabs(20.0 * log10((double)FastDB::undb2(dB)) - dB));
+  }
+  Benchmark::report("fast_wdrc.db2.max_error_dB", worstDb2, "dB");
+  Benchmark::report("fast_wdrc.undb2.max_error_dB", worstUndb2, "dB");
+  TEST_ASSERT_TRUE(worstDb2 < TOLERANCE_DB);
+  TEST_ASSERT_TRUE(worstUndb2 < TOLERANCE_DB);
+
+  // negative exponents down to the smallest normal float, and the edges of the range
+  TEST_ASSERT_EQUAL_FLOAT(0.25f, FastDB::exp2(-2.0f));
+  TEST_ASSERT_EQUAL_FLOAT(ldexpf(1.0f, -126), FastDB::exp2(-126.0f));
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, FastDB::exp2(-127.0f));
+  TEST_ASSERT_EQUAL_FLOAT(ldexpf(1.0f, 127), FastDB::exp2(200.0f));
+
+#if defined(__SSE2__)
+  double worstDb2x4 = 0.0, worstUndb2x4 = 0.0;
+  for (int ii = 0; ii <= 1000000; ii += 4) {
+    float x[4], dB[4], y[4];
+    for (int jj = 0; jj < 4; jj++) {
+      x[jj] = (float)pow(10.0, -9.0 + 12.0 * (ii + jj) / 1000000.0);
+      dB[jj] = (float)(-180.0 + 240.0 * (ii + jj) / 1000000.0);
+    }
+    _mm_storeu_ps(y, FastDB::db2(_mm_loadu_ps(x)));
+    for (int jj = 0; jj < 4; jj++) worstDb2x4 = fmax(worstDb2x4, fabs(y[jj] - 20.0 * log10((double)x[jj])));
+    _mm_storeu_ps(y, FastDB::undb2(_mm_loadu_ps(dB)));
+    for (int jj = 0; jj < 4; jj++) worstUndb2x4 = fmax(worstUndb2x4, fabs(20.0 * log10((double)y[jj]) - dB[jj]));
+  }
+  Benchmark::report("fast_wdrc.db2.sse.max_error_dB", worstDb2x4, "dB");
+  Benchmark::report("fast_wdrc.undb2.sse.max_error_dB", worstUndb2x4, "dB");
+  TEST_ASSERT_TRUE(worstDb2x4 < TOLERANCE_DB);
+  TEST_ASSERT_TRUE(worstUndb2x4 < TOLERANCE_DB);
+
+  float edges[4] = { -2.0f, -126.0f, -127.0f, 200.0f }, y[4];
+  _mm_storeu_ps(y, FastDB::exp2(_mm_loadu_ps(edges)));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f * 0.25f, 0.25f, y[0]);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f * ldexpf(1.0f, -126), ldexpf(1.0f, -126), y[1]);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, y[2]);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f * ldexpf(1.0f, 127), ldexpf(1.0f, 127), y[3]);
+#endif
+}
+
+static void checkSignal(const char *signalName, void (*make)(float *, int)) {
+  char name[80];
+  make(signal_, SIGNAL_SAMPLES);
+  for (int ff = 0; ff < (int)(sizeof(fittings) / sizeof(fittings[0])); ff++) {
+    const BTNRH_WDRC::CHA_WDRC &f = fittings[ff];
+    FastEnvelope_F32 fastEnvelope;
+    AudioCalcEnvelope_F32 stockEnvelope;
+    FastGainWDRC_F32 fastGain;
+    AudioCalcGainWDRC_F32 stockGain;
+    fastEnvelope.setSampleRate_Hz(SAMPLE_RATE);
+    fastEnvelope.setAttackRelease_msec(f.attack, f.release);
+    stockEnvelope.setSampleRate_Hz(SAMPLE_RATE);
+    stockEnvelope.setAttackRelease_msec(f.attack, f.release);
+    fastGain.setParams_from_CHA_WDRC(&f);
+    stockGain.setParams_from_CHA_WDRC((BTNRH_WDRC::CHA_WDRC *)&f);
+
+    for (int start = 0; start < SIGNAL_SAMPLES; start += BLOCK_SIZE) {
+      int n = (SIGNAL_SAMPLES - start < BLOCK_SIZE) ? SIGNAL_SAMPLES - start : BLOCK_SIZE;
+      fastEnvelope.smooth_env(&signal_[start], &envFast[start], n);
+      stockEnvelope.smooth_env(&signal_[start], &envStock[start], n);
+    }
+    TEST_ASSERT_EQUAL_MEMORY(envStock, envFast, sizeof(envFast));
+
+    // skip the first 10 ms, where the envelope is still coming up from 0
+    int skip = (int)(0.01f * SAMPLE_RATE), n = SIGNAL_SAMPLES - skip;
+    stockGain.calcGainFromEnvelope(envStock, stockGainOut, SIGNAL_SAMPLES);
+    double stockError = maxGainError_dB(&envStock[skip], &stockGainOut[skip], n, f);
+    fastGain.calcGainFromEnvelope(envFast, gain, SIGNAL_SAMPLES);
+    double fastError = maxGainError_dB(&envFast[skip], &gain[skip], n, f);
+    double fastStock = maxDifference_dB(&envFast[skip], &gain[skip], &stockGainOut[skip], n, f);
+    for (int start = 0; start < SIGNAL_SAMPLES; start += 3) {
+      fastGain.calcGainFromEnvelope(&envFast[start], &gain[start], (SIGNAL_SAMPLES - start < 3) ? SIGNAL_SAMPLES - start : 3);
+    }
+    double tablesError = maxGainError_dB(&envFast[skip], &gain[skip], n, f);
+
+    snprintf(name, sizeof(name), "fast_wdrc.%s.fitting%i.fast.max_error_dB", signalName, ff);
+    Benchmark::report(name, fastError, "dB");
+    snprintf(name, sizeof(name), "fast_wdrc.%s.fitting%i.tables.max_error_dB", signalName, ff);
+    Benchmark::report(name, tablesError, "dB");
+    snprintf(name, sizeof(name), "fast_wdrc.%s.fitting%i.stock.max_error_dB", signalName, ff);
+    Benchmark::report(name, stockError, "dB");
+    snprintf(name, sizeof(name), "fast_wdrc.%s.fitting%i.fast_vs_stock_dB", signalName, ff);
+    Benchmark::report(name, fastStock, "dB");
+    TEST_ASSERT_TRUE(fastError < TOLERANCE_DB);
+    TEST_ASSERT_TRUE(tablesError < TOLERANCE_DB);
+    TEST_ASSERT_TRUE(fastStock < STOCK_TOLERANCE_DB);
+  }
+}
+
+// the points where the expansion used to hang off the compression line instead of tkgain
+void test_expansion_with_cr_below_1(void) {
+  const BTNRH_WDRC::CHA_WDRC &f = fittings[2];
+  FastGainWDRC_F32 fastGain;
+  AudioCalcGainWDRC_F32 stockGain;
+  fastGain.setParams_from_CHA_WDRC(&f);
+  stockGain.setParams_from_CHA_WDRC((BTNRH_WDRC::CHA_WDRC *)&f);
+  float env[8] = { 1e-6f, 1e-4f, 1e-3f, 1e-2f, 3e-6f, 3e-5f, 3e-4f, 0.1f }, fast[8], stock[8];
+  fastGain.calcGainFromEnvelope(env, fast, 8);
+  stockGain.calcGainFromEnvelope(env, stock, 8);
+  for (int ii = 0; ii < 8; ii++) {
+    TEST_ASSERT_FLOAT_WITHIN(STOCK_TOLERANCE_DB, 20.0f * log10f(stock[ii]), 20.0f * log10f(fast[ii]));
+    TEST_ASSERT_FLOAT_WITHIN(TOLERANCE_DB, referenceGain_dB(env[ii], f), 20.0 * log10((double)fast[ii]));
+  }
+
+  // an exp_cr of 0 is taken as 0.01, as the stock one does
+  BTNRH_WDRC::CHA_WDRC zero = f;
+  zero.exp_cr = 0.0f;
+  fastGain.setParams_from_CHA_WDRC(&zero);
+  fastGain.calcGainFromEnvelope(env, fast, 8);
+  for (int ii = 0; ii < 8; ii++) {
+    double reference = referenceGain_dB(env[ii], zero);   // 99 dB per dB: errors grow 100-fold
+    if (reference > -600.0) TEST_ASSERT_FLOAT_WITHIN(100.0 * TOLERANCE_DB, reference, 20.0 * log10((double)fast[ii]));
+    else TEST_ASSERT_TRUE(fast[ii] < 1e-30f);
+  }
+}
+
+void test_gain_level_sweep(void) { checkSignal("level_sweep", levelSweep); }
+void test_gain_tone_bursts(void) { checkSignal("tone_bursts", toneBursts); }
+
+void test_cost(void) {
+  const BTNRH_WDRC::CHA_WDRC &f = fittings[0];
+  levelSweep(signal_, SIGNAL_SAMPLES);
+  const float *x = &signal_[SIGNAL_SAMPLES / 2];   // around -50 dBFS, in the compression region
+  float env[BLOCK_SIZE];
+  FastEnvelope_F32 fastEnvelope;
+  AudioCalcEnvelope_F32 stockEnvelope;
+  FastGainWDRC_F32 fastGain;
+  AudioCalcGainWDRC_F32 stockGain;
+  fastEnvelope.setSampleRate_Hz(SAMPLE_RATE);
+  stockEnvelope.setSampleRate_Hz(SAMPLE_RATE);
+  fastGain.setParams_from_CHA_WDRC(&f);
+  stockGain.setParams_from_CHA_WDRC((BTNRH_WDRC::CHA_WDRC *)&f);
+
+  BENCH_TIMING fast = Benchmark::time([&]() {
+    for (int ii = 0; ii < BLOCKS_PER_RUN; ii++) {
+      fastEnvelope.smooth_env((float *)x, env, BLOCK_SIZE);
+      fastGain.calcGainFromEnvelope(env, gain, BLOCK_SIZE);
+    }
+  });
+  BENCH_TIMING stock = Benchmark::time([&]() {
+    for (int ii = 0; ii < BLOCKS_PER_RUN; ii++) {
+      stockEnvelope.smooth_env((float *)x, env, BLOCK_SIZE);
+      stockGain.calcGainFromEnvelope(env, gain, BLOCK_SIZE);
+    }
+  });
+
+  // the gain on its own, which is where the two differ
+  fastEnvelope.smooth_env((float *)x, env, BLOCK_SIZE);
+  BENCH_TIMING fastGainOnly = Benchmark::time([&]() {
+    for (int ii = 0; ii < BLOCKS_PER_RUN; ii++) fastGain.calcGainFromEnvelope(env, gain, BLOCK_SIZE);
+  });
+  BENCH_TIMING stockGainOnly = Benchmark::time([&]() {
+    for (int ii = 0; ii < BLOCKS_PER_RUN; ii++) stockGain.calcGainFromEnvelope(env, gain, BLOCK_SIZE);
+  });
+
+  double samples = (double)BLOCKS_PER_RUN * BLOCK_SIZE;
+  Benchmark::report("fast_wdrc.fast.gain.cycles_per_sample", fastGainOnly.cycles / samples, "cycles/sample");
+  Benchmark::report("fast_wdrc.stock.gain.cycles_per_sample", stockGainOnly.cycles / samples, "cycles/sample");
+  Benchmark::report("fast_wdrc.fast.ns_per_sample", fast.ns / samples, "ns/sample");
+  Benchmark::report("fast_wdrc.stock.ns_per_sample", stock.ns / samples, "ns/sample");
+  Benchmark::report("fast_wdrc.fast.cycles_per_sample", fast.cycles / samples, "cycles/sample");
+  Benchmark::report("fast_wdrc.stock.cycles_per_sample", stock.cycles / samples, "cycles/sample");
+  Benchmark::report("fast_wdrc.speedup", stock.ns / fast.ns, "x");
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_db_conversions);
+  RUN_TEST(test_gain_level_sweep);
+  RUN_TEST(test_gain_tone_bursts);
+  RUN_TEST(test_expansion_with_cr_below_1);
+  RUN_TEST(test_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,223 @@
+/*
+  The feedback canceller (shared/AudioEffectFeedbackCancel_F32.h) in a closed loop: how much more
+  gain it allows before the loop howls, and its cost per sample.
+
+  A signal (the WAV file named by FEEDBACK_WAV, its first channel, or speech-shaped noise if
+  none is given) is run through the canceller and a linear compressor (tkgain, as in the
+  sketch), with the output fed back into the input through a simulated receiver-to-microphone
+  path: the two blocks of I/O round trip of the Tympan, a few samples of converter delay and a
+  short resonant acoustic path peaking at -20 dB. The output is clipped at full scale, as the DAC
+  would. The signal is scaled to -60 dBFS RMS so that clipping only comes from the loop.
+
+  For each setup the gain is raised in 1 dB steps until the loop is no longer stable, i.e. the
+  output power over the last two seconds is more than 3 dB above the gain times the input power.
+  Reports the highest stable gain without the canceller, with it, and with it but without the
+  bulk delay on the reference (where the 64 taps can't reach past the round trip), and the added
+  stable gain; the canceller as the sketch sets it up must add at least 10 dB. A step size far
+  too large for the block must be held to the canceller's limit, leaving the loop stable.
+
+  Cost: the canceller alone, adapting, for 32 to 256 taps; ns and cycles (TSC ticks) per sample.
+
+  Run with: pio test -e native -f test_feedback
+  On a recording: FEEDBACK_WAV=speech.wav pio test -e native -f test_feedback
+*/
+
+#include <unity.h>
+#include <Tympan_Library.h>
+#include <vector>
+#include "../../../shared/AudioEffectFeedbackCancel_F32.h"
+#include "../../../shared/AudioEffectCompWDRCBuffered_F32.h"
+#include "../../../shared/host/Benchmark.h"
+#include "../../../shared/host/HostAudio.h"
+#include "../../../shared/host/WavFile.h"
+
+#define SAMPLE_RATE 44117.0f
+#define BLOCK_SIZE 128
+#define SECONDS 6
+#define MEASURE_SECONDS 2
+#define AFC_STEP_SIZE 0.002f    // the sketch's defaults
+#define AFC_TAPS 64
+#define AFC_OVERSIZED_STEP 0.1f  // step size x block size of 12.8, left alone the taps would diverge
+#define CONVERTER_DELAY 8       // samples
+#define PATH_TAPS 32
+#define MAX_GAIN_DB 60
+#define MIN_ADDED_GAIN_DB 10.0f
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+AudioSettings_F32 audio_settings(SAMPLE_RATE, BLOCK_SIZE);
+std::vector<float> input, mic, output;
+float path[CONVERTER_DELAY + PATH_TAPS];
+
+void setUp(void) {
+  AudioMemory_F32(16, audio_settings);
+}
+
+HostGraph *graph = NULL;
+
+void tearDown(void) {
+  delete graph;
+  graph = NULL;
+}
+
+struct LoopGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  AudioEffectFeedbackCancel_F32 afc { audio_settings };
+  AudioEffectCompWDRCBuffered_F32 compWDRC;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioConnection_F32 patchCord1 { i2s_in, 0, afc, 0 };
+  AudioConnection_F32 patchCord2 { afc, 0, compWDRC, 0 };
+  AudioConnection_F32 patchCord3 { compWDRC, 0, i2s_out, 0 };
+  AudioConnection_F32 patchCord4 { compWDRC, 0, afc, 1 };   // loopback, a block late as in the sketch
+
+  LoopGraph(float gain_dB, float stepSize, int bulkDelay) {
+    BTNRH_WDRC::CHA_WDRC gha = { 1.0f, 50.0f, SAMPLE_RATE, 119.0f, 1.0f, 0.0f, gain_dB, 105.0f, 1.0f, 200.0f };
+    compWDRC.setRampTime_msec(0.0f);
+    compWDRC.publishParams(&gha);
+    afc.publishParams(stepSize, AFC_TAPS, bulkDelay);
+  }
+};
+
+struct CancellerGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  AudioEffectFeedbackCancel_F32 afc;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioConnection_F32 patchCord1 { i2s_in, 0, afc, 0 };
+  AudioConnection_F32 patchCord2 { i2s_in, 1, afc, 1 };
+  AudioConnection_F32 patchCord3 { afc, 0, i2s_out, 0 };
+};
+
+static void loadSignal(void) {
+  int samples = (int)(SECONDS * SAMPLE_RATE) / BLOCK_SIZE * BLOCK_SIZE;
+  input.assign(samples, 0.0f);
+  const char *wavPath = getenv("FEEDBACK_WAV");
+  WavFile wav;
+  if (wavPath && wav.read(wavPath) && wav.frames() > 0) {
+    std::vector<float> ch = wav.channel(0);
+    for (int ii = 0; ii < samples; ii++) input[ii] = ch[ii % ch.size()];
+  } else {
+    // lowpassed noise, syllable-rate amplitude modulation
+    HostNoise noise(12345);
+    float y = 0.0f;
+    for (int ii = 0; ii < samples; ii++) {
+      y = 0.9f * y + 0.1f * noise.gaussian();
+      input[ii] = y * (1.2f + sinf(2.0f * (float)M_PI * 4.0f * ii / SAMPLE_RATE));
+    }
+  }
+  double power = 0.0;
+  for (float x : input) power += x * x;
+  float scale = 0.001f / sqrtf(power / samples + 1e-20);
+  for (float &x : input) x *= scale;
+  mic.assign(samples, 0.0f);
+  output.assign(samples, 0.0f);
+}
+
+// converter delay, then a decaying 3 kHz resonance, scaled to peak at -20 dB
+static void makePath(void) {
+  memset(path, 0, sizeof(path));
+  for (int ii = 0; ii < PATH_TAPS; ii++) {
+    path[CONVERTER_DELAY + ii] = expf(-ii / 5.0f) * cosf(2.0f * (float)M_PI * 3000.0f * ii / SAMPLE_RATE);
+  }
+  double peak = 0.0;
+  for (int ff = 1; ff < 1000; ff++) {
+    double w = M_PI * ff / 1000.0, re = 0.0, im = 0.0;
+    for (int ii = 0; ii < CONVERTER_DELAY + PATH_TAPS; ii++) {
+      re += path[ii] * cos(w * ii);
+      im -= path[ii] * sin(w * ii);
+    }
+    peak = fmax(peak, sqrt(re * re + im * im));
+  }
+  for (float &h : path) h *= 0.1f / peak;
+}
+
+// the output power over the last seconds, relative to the gain times the input power (in dB)
+static float runLoop(float gain_dB, float stepSize, int bulkDelay) {
+  LoopGraph *g = new LoopGraph(gain_dB, stepSize, bulkDelay);
+  graph = g;
+  const int samples = (int)input.size();
+  const int roundTrip = 2 * BLOCK_SIZE;   // what's played from block k is in the input of block k + 2
+  for (int start = 0; start < samples; start += BLOCK_SIZE) {
+    for (int ii = start; ii < start + BLOCK_SIZE; ii++) {
+      float fed = 0.0f;
+      for (int jj = 0; jj < CONVERTER_DELAY + PATH_TAPS; jj++) {
+        int played = ii - roundTrip - jj;
+        if (played >= 0) fed += path[jj] * output[played];
+      }
+      mic[ii] = input[ii] + fed;
+    }
+    HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, &mic[start], NULL, &output[start], NULL, BLOCK_SIZE);
+    for (int ii = start; ii < start + BLOCK_SIZE; ii++) {
+      if (!isfinite(output[ii]) || output[ii] > 1.0f) output[ii] = 1.0f;   // clipped by the DAC
+      else if (output[ii] < -1.0f) output[ii] = -1.0f;
+    }
+  }
+  delete g;
+  graph = NULL;
+
+  int from = samples - (int)(MEASURE_SECONDS * SAMPLE_RATE);
+  double inPower = 0.0, outPower = 0.0;
+  for (int ii = from; ii < samples; ii++) {
+    inPower += input[ii] * input[ii];
+    outPower += output[ii] * output[ii];
+  }
+  return 10.0f * log10f(outPower / inPower) - gain_dB;
+}
+
+static int maxStableGain_dB(float stepSize, int bulkDelay) {
+  int gain_dB = 0;
+  while (gain_dB < MAX_GAIN_DB && runLoop(gain_dB + 1, stepSize, bulkDelay) < 3.0f) gain_dB++;
+  return gain_dB;
+}
+
+void test_added_stable_gain(void) {
+  loadSignal();
+  makePath();
+  int off = maxStableGain_dB(0.0f, BLOCK_SIZE);
+  int on = maxStableGain_dB(AFC_STEP_SIZE, BLOCK_SIZE);
+  int noBulkDelay = maxStableGain_dB(AFC_STEP_SIZE, 0);
+  Benchmark::report("feedback.max_stable_gain.off_dB", off, "dB");
+  Benchmark::report("feedback.max_stable_gain.on_dB", on, "dB");
+  Benchmark::report("feedback.max_stable_gain.on_without_bulk_delay_dB", noBulkDelay, "dB");
+  Benchmark::report("feedback.added_stable_gain_dB", on - off, "dB");
+  TEST_ASSERT_TRUE(on - off >= MIN_ADDED_GAIN_DB);
+  TEST_ASSERT_TRUE(on > noBulkDelay);
+
+  // a step far too large for the block is held to the limit, and the loop stays stable
+  float oversized = runLoop(off, AFC_OVERSIZED_STEP, BLOCK_SIZE);
+  Benchmark::report("feedback.oversized_step.excess_dB", oversized, "dB");
+  TEST_ASSERT_TRUE(oversized < 3.0f);
+}
+
+void test_cost(void) {
+  char name[80];
+  const int tapCounts[] = { 32, 64, 128, 256 };
+  const int samples = 344 * BLOCK_SIZE;   // about a second
+  std::vector<float> microphone(samples), reference(samples), out(samples);
+  HostNoise noise(777);
+  for (int ii = 0; ii < samples; ii++) {
+    reference[ii] = 0.1f * noise.gaussian();
+    microphone[ii] = 0.1f * noise.gaussian();
+  }
+  for (int taps : tapCounts) {
+    CancellerGraph *g = new CancellerGraph;
+    graph = g;
+    g->afc.publishParams(AFC_STEP_SIZE, taps, BLOCK_SIZE);
+    BENCH_TIMING timing = Benchmark::time([&]() {
+      HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, microphone.data(), reference.data(), out.data(), NULL, samples);
+    });
+    delete g;
+    graph = NULL;
+    snprintf(name, sizeof(name), "feedback.%i_taps.ns_per_sample", taps);
+    Benchmark::report(name, timing.ns / samples, "ns/sample");
+    snprintf(name, sizeof(name), "feedback.%i_taps.cycles_per_sample", taps);
+    Benchmark::report(name, timing.cycles / samples, "cycles/sample");
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_added_stable_gain);
+  RUN_TEST(test_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,139 @@
+/*
+  The runtime Butterworth design (shared/FilterDesign.h).
+
+  Order 2 at 750 Hz and 44.1 kHz must reproduce the sketch's original hard-coded high-pass
+  (hp_b/hp_a, from Matlab's butter(2, 750/22050, 'high')) to float precision. An odd order must
+  end in a first-order section with the real pole, and every order, lowpass and highpass, must be
+  3 dB down at the corner, flat in the passband and zero at the far end of the stopband. A repeated
+  design must come from the cache, and one pushed out of it must be designed again. Corners at or
+  above Nyquist, and orders out of range, give no sections.
+
+  Run with: pio test -e native -f test_filter_design
+*/
+
+#include <unity.h>
+#include <complex>
+#include "../../../shared/FilterDesign.h"
+#include "../../../shared/host/HostAudio.h"
+
+#define SAMPLE_RATE 44100.0f
+#define CORNER_HZ 750.0f
+#define COEFF_TOLERANCE 2.5e-7f   // two float ulps around 1
+#define RESPONSE_TOLERANCE_DB 0.01f
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+// the sketch's high-pass before it was designed at runtime
+const double hp_b[] = { 0.927221242739230, -1.854442485478460, 0.927221242739230 };
+const double hp_a[] = { 1.000000000000000, -1.849138705449389, 0.859746265507531 };
+
+float coeffs[5 * FILTER_DESIGN_MAX_SECTIONS];
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// the cascade's magnitude response at f_Hz, in dB
+static float response_dB(const float *c, int nSections, float f_Hz, float fs_Hz) {
+  std::complex<double> z1 = std::polar(1.0, -2.0 * M_PI * f_Hz / fs_Hz), z2 = z1 * z1;
+  std::complex<double> h = 1.0;
+  for (int ii = 0; ii < nSections; ii++, c += 5) {
+    h *= ((double)c[0] + (double)c[1] * z1 + (double)c[2] * z2) / (1.0 + (double)c[3] * z1 + (double)c[4] * z2);
+  }
+  return (float)(20.0 * log10(std::abs(h) + 1e-30));
+}
+
+void test_reproduces_original_highpass(void) {
+  ButterworthDesign design;
+  TEST_ASSERT_EQUAL_INT(1, design.design(FilterHighpass, CORNER_HZ, SAMPLE_RATE, 2, coeffs));
+  for (int ii = 0; ii < 3; ii++) TEST_ASSERT_FLOAT_WITHIN(COEFF_TOLERANCE, (float)hp_b[ii], coeffs[ii]);
+  TEST_ASSERT_FLOAT_WITHIN(COEFF_TOLERANCE, (float)hp_a[1], coeffs[3]);
+  TEST_ASSERT_FLOAT_WITHIN(COEFF_TOLERANCE, (float)hp_a[2], coeffs[4]);
+}
+
+void test_odd_order(void) {
+  ButterworthDesign design;
+  const double K = tan(M_PI * CORNER_HZ / SAMPLE_RATE);
+  for (int type = FilterLowpass; type <= FilterHighpass; type++) {
+    TEST_ASSERT_EQUAL_INT(2, design.design((FILTER_TYPE)type, CORNER_HZ, SAMPLE_RATE, 3, coeffs));
+
+    // the pole pair first (Q = 1 for order 3), then the real pole at -(1 - K) / (1 + K)
+    const float *pair = &coeffs[0];
+    TEST_ASSERT_FLOAT_WITHIN(COEFF_TOLERANCE, (float)((1.0 - K + K * K) / (1.0 + K + K * K)), pair[4]);
+    const float *single = &coeffs[5];
+    TEST_ASSERT_FLOAT_WITHIN(COEFF_TOLERANCE, (float)((K - 1.0) / (K + 1.0)), single[3]);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, single[2]);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, single[4]);
+    if (type == FilterLowpass) {
+      TEST_ASSERT_FLOAT_WITHIN(COEFF_TOLERANCE, (float)(K / (1.0 + K)), single[0]);
+      TEST_ASSERT_EQUAL_FLOAT(single[0], single[1]);
+    } else {
+      TEST_ASSERT_FLOAT_WITHIN(COEFF_TOLERANCE, (float)(1.0 / (1.0 + K)), single[0]);
+      TEST_ASSERT_EQUAL_FLOAT(-single[0], single[1]);
+    }
+  }
+}
+
+void test_response_every_order(void) {
+  ButterworthDesign design;
+  for (int order = 1; order <= FILTER_DESIGN_MAX_ORDER; order++) {
+    for (int type = FilterLowpass; type <= FilterHighpass; type++) {
+      int nSections = design.design((FILTER_TYPE)type, CORNER_HZ, SAMPLE_RATE, order, coeffs);
+      TEST_ASSERT_EQUAL_INT((order + 1) / 2, nSections);
+      float pass_Hz = type == FilterLowpass ? 0.0f : 0.5f * SAMPLE_RATE;
+      float stop_Hz = type == FilterLowpass ? 0.5f * SAMPLE_RATE : 0.0f;
+      TEST_ASSERT_FLOAT_WITHIN(RESPONSE_TOLERANCE_DB, -10.0f * log10f(2.0f), response_dB(coeffs, nSections, CORNER_HZ, SAMPLE_RATE));
+      TEST_ASSERT_FLOAT_WITHIN(RESPONSE_TOLERANCE_DB, 0.0f, response_dB(coeffs, nSections, pass_Hz, SAMPLE_RATE));
+      TEST_ASSERT_TRUE(response_dB(coeffs, nSections, stop_Hz, SAMPLE_RATE) < -100.0f);
+    }
+  }
+}
+
+void test_cache(void) {
+  ButterworthDesign design;
+  float first[5 * FILTER_DESIGN_MAX_SECTIONS];
+  int nSections = design.design(FilterHighpass, CORNER_HZ, SAMPLE_RATE, 4, first);
+  TEST_ASSERT_EQUAL_UINT32(1, design.getCacheMisses());
+  TEST_ASSERT_EQUAL_UINT32(0, design.getCacheHits());
+
+  // the same design again comes from the cache, and is the same
+  TEST_ASSERT_EQUAL_INT(nSections, design.design(FilterHighpass, CORNER_HZ, SAMPLE_RATE, 4, coeffs));
+  TEST_ASSERT_EQUAL_UINT32(1, design.getCacheMisses());
+  TEST_ASSERT_EQUAL_UINT32(1, design.getCacheHits());
+  TEST_ASSERT_EQUAL_INT(0, memcmp(first, coeffs, 5 * nSections * sizeof(float)));
+
+  // any difference in the key is a new design
+  design.design(FilterLowpass, CORNER_HZ, SAMPLE_RATE, 4, coeffs);
+  design.design(FilterHighpass, CORNER_HZ + 1.0f, SAMPLE_RATE, 4, coeffs);
+  design.design(FilterHighpass, CORNER_HZ, 48000.0f, 4, coeffs);
+  design.design(FilterHighpass, CORNER_HZ, SAMPLE_RATE, 5, coeffs);
+  TEST_ASSERT_EQUAL_UINT32(5, design.getCacheMisses());
+  TEST_ASSERT_EQUAL_UINT32(1, design.getCacheHits());
+
+  // a full cache's worth of other designs pushes the first one out
+  for (int ii = 0; ii < FILTER_DESIGN_CACHE_SIZE; ii++) design.design(FilterLowpass, 100.0f * (ii + 1), SAMPLE_RATE, 2, coeffs);
+  unsigned long misses = design.getCacheMisses();
+  TEST_ASSERT_EQUAL_INT(nSections, design.design(FilterHighpass, CORNER_HZ, SAMPLE_RATE, 4, coeffs));
+  TEST_ASSERT_EQUAL_UINT32(misses + 1, design.getCacheMisses());
+  TEST_ASSERT_EQUAL_INT(0, memcmp(first, coeffs, 5 * nSections * sizeof(float)));
+}
+
+void test_impossible_designs(void) {
+  ButterworthDesign design;
+  TEST_ASSERT_EQUAL_INT(0, design.design(FilterHighpass, 0.5f * SAMPLE_RATE, SAMPLE_RATE, 2, coeffs));
+  TEST_ASSERT_EQUAL_INT(0, design.design(FilterLowpass, 0.6f * SAMPLE_RATE, SAMPLE_RATE, 2, coeffs));
+  TEST_ASSERT_EQUAL_INT(0, design.design(FilterHighpass, 0.0f, SAMPLE_RATE, 2, coeffs));
+  TEST_ASSERT_EQUAL_INT(0, design.design(FilterHighpass, CORNER_HZ, SAMPLE_RATE, 0, coeffs));
+  TEST_ASSERT_EQUAL_INT(0, design.design(FilterHighpass, CORNER_HZ, SAMPLE_RATE, FILTER_DESIGN_MAX_ORDER + 1, coeffs));
+  TEST_ASSERT_EQUAL_UINT32(0, design.getCacheMisses());   // and nothing was cached
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_reproduces_original_highpass);
+  RUN_TEST(test_odd_order);
+  RUN_TEST(test_response_every_order);
+  RUN_TEST(test_cache);
+  RUN_TEST(test_impossible_designs);
+  return UNITY_END();
+}
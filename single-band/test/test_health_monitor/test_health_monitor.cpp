@@ -0,0 +1,136 @@
+/*
+  The health monitor (shared/AudioHealthMonitor_F32.h): exhaustion of the block pool.
+
+  A node in the graph grabs every free block on some cycles, and either gives them back within
+  the cycle (seen through the library's maximum usage) or holds on to them past its end (seen
+  in the usage itself). Each such cycle must be counted once, and no other; the monitor's own
+  high-water mark must follow, and the library's maximum must be left as the library has it.
+  reset() must clear the high-water mark without bringing back peaks from before.
+
+  Run with: pio test -e native -f test_health_monitor
+*/
+
+#include <unity.h>
+#include <Tympan_Library.h>
+#include "../../../shared/AudioHealthMonitor_F32.h"
+#include "../../../shared/host/HostAudio.h"
+
+#define SAMPLE_RATE 44117.0f
+#define BLOCK_SIZE 128
+#define POOL_BLOCKS 8
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+AudioSettings_F32 audio_settings(SAMPLE_RATE, BLOCK_SIZE);
+float in[BLOCK_SIZE], out[BLOCK_SIZE];
+
+void setUp(void) {
+  AudioMemory_F32(POOL_BLOCKS, audio_settings);
+}
+
+HostGraph *graph = NULL;
+
+void tearDown(void) {
+  delete graph;
+  graph = NULL;
+}
+
+// passes its input through; when told to, takes every free block, for the cycle or until the next
+class PoolHog : public AudioStream_F32 {
+  public:
+    PoolHog(void) : AudioStream_F32(1, inputQueueArray) {}
+
+    bool grab = false;
+    bool hold = false;
+
+    void update(void) {
+      giveBack();
+      if (grab) {
+        while (held < POOL_BLOCKS && (blocks[held] = AudioStream_F32::allocate_f32()) != NULL) held++;
+        if (!hold) giveBack();
+      }
+      audio_block_f32_t *block = AudioStream_F32::receiveReadOnly_f32();
+      if (!block) return;
+      AudioStream_F32::transmit(block);
+      AudioStream_F32::release(block);
+    }
+
+    ~PoolHog(void) { giveBack(); }
+
+  private:
+    audio_block_f32_t *inputQueueArray[1];
+    audio_block_f32_t *blocks[POOL_BLOCKS];
+    int held = 0;
+
+    void giveBack(void) {
+      while (held > 0) AudioStream_F32::release(blocks[--held]);
+    }
+};
+
+struct MonitorGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  PoolHog hog;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioHealthMonitor_F32 healthMonitor;
+  AudioConnection_F32 patchCord1 { i2s_in, 0, hog, 0 };
+  AudioConnection_F32 patchCord2 { hog, 0, i2s_out, 0 };
+  AudioConnection_F32 patchCord3 { hog, 0, healthMonitor, 0 };
+
+  MonitorGraph(void) {
+    healthMonitor.setInputs(1);
+    healthMonitor.setPoolSize(POOL_BLOCKS);
+  }
+
+  void run(int cycles) {
+    for (int ii = 0; ii < cycles; ii++) HostAudio::process(i2s_in, i2s_out, BLOCK_SIZE, in, NULL, out, NULL, BLOCK_SIZE);
+  }
+};
+
+void test_pool_exhaustion(void) {
+  MonitorGraph *g = new MonitorGraph;
+  graph = g;
+  AUDIO_HEALTH health;
+
+  g->run(10);
+  g->healthMonitor.getSnapshot(&health);
+  TEST_ASSERT_EQUAL_UINT32(0, health.poolExhausted);
+  int normalUsage = health.poolUsageMax;
+  TEST_ASSERT_TRUE(normalUsage > 0 && normalUsage < POOL_BLOCKS);
+
+  // every block taken and given back within one cycle
+  g->hog.grab = true;
+  g->run(1);
+  g->hog.grab = false;
+  g->run(10);
+  g->healthMonitor.getSnapshot(&health);
+  TEST_ASSERT_EQUAL_UINT32(1, health.poolExhausted);
+  TEST_ASSERT_EQUAL_INT(POOL_BLOCKS, health.poolUsageMax);
+  TEST_ASSERT_EQUAL_INT(1, health.eventCount);
+  TEST_ASSERT_EQUAL_INT(HealthPoolExhausted, health.events[0].event);
+  TEST_ASSERT_EQUAL_INT(POOL_BLOCKS, AudioMemoryUsageMax_F32());   // untouched
+
+  // held past the end of three cycles
+  g->hog.grab = true;
+  g->hog.hold = true;
+  g->run(3);
+  g->hog.grab = false;
+  g->run(10);
+  g->healthMonitor.getSnapshot(&health);
+  TEST_ASSERT_EQUAL_UINT32(4, health.poolExhausted);
+
+  // a reset starts the high-water mark over, from what is in use from then on (at the ends of
+  // cycles now, with the library's maximum at the pool size)
+  g->healthMonitor.reset();
+  g->run(10);
+  g->healthMonitor.getSnapshot(&health);
+  TEST_ASSERT_EQUAL_UINT32(0, health.poolExhausted);
+  TEST_ASSERT_TRUE(health.poolUsageMax > 0 && health.poolUsageMax <= normalUsage);
+  TEST_ASSERT_EQUAL_INT(POOL_BLOCKS, AudioMemoryUsageMax_F32());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_pool_exhaustion);
+  return UNITY_END();
+}
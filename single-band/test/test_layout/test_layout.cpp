@@ -0,0 +1,165 @@
+/*
+  Heap use and wall time of the layout ("#;" / "J") for 1, 8 and 99 channels of 14 knobs.
+
+  The layout is rendered once when the manager is constructed (where it makes all its
+  allocations) and afterwards only its value slots are patched, so asking for it must not touch
+  the heap at all, however many channels there are. If the cache cannot be allocated the manager
+  streams the layout in fixed-size chunks instead, which must not touch the heap either, and must
+  print the same thing. malloc and friends are wrapped here to count what is held and the peak.
+
+  Reports, per channel count: the heap the manager holds (mostly the cache), the peak heap growth
+  while the layout is printed (from the cache and streamed) and the time to print it. See
+  shared/host/Benchmark.h for the output format.
+
+  Run with: pio test -e native -f test_layout
+*/
+
+#include <unity.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+#include "../../../shared/ExtendedSerialManager.h"
+#include "../../../shared/host/Benchmark.h"
+
+#define KNOBS 14
+#define MAX_CHANNELS 99
+#define OUTPUT_SIZE (1024 * 1024)
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+// heap accounting, on top of glibc's allocator
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static long heapInUse = 0, heapPeak = 0;
+static bool failAllocations = false;
+
+static void *counted(void *ptr) {
+  if (ptr) {
+    heapInUse += malloc_usable_size(ptr);
+    if (heapInUse > heapPeak) heapPeak = heapInUse;
+  }
+  return ptr;
+}
+
+extern "C" void *malloc(size_t size) {
+  return failAllocations ? NULL : counted(__libc_malloc(size));
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+  return failAllocations ? NULL : counted(__libc_calloc(count, size));
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+  if (failAllocations) return NULL;
+  if (ptr) heapInUse -= malloc_usable_size(ptr);
+  return counted(__libc_realloc(ptr, size));
+}
+
+extern "C" void free(void *ptr) {
+  if (ptr) heapInUse -= malloc_usable_size(ptr);
+  __libc_free(ptr);
+}
+
+float values[MAX_CHANNELS * KNOBS];
+CONFIGURABLE knobs[MAX_CHANNELS * KNOBS];
+bool runCommand(char c) { return true; }
+COMMAND commands[] = { { 'x', "do nothing", runCommand } };
+void apply(void) {}
+void activate(int channel, int knob) {}
+
+static char cachedOutput[OUTPUT_SIZE], streamedOutput[OUTPUT_SIZE];
+FILE *cachedFile = NULL, *streamedFile = NULL;
+
+void setUp(void) {
+  for (int ii = 0; ii < MAX_CHANNELS * KNOBS; ii++) {
+    values[ii] = 0.5f * ii;
+    knobs[ii] = { "knob", &values[ii], "dB", 0.0f, 1000.0f };
+  }
+  // opened (and unbuffered) up front, so that printing to them allocates nothing
+  cachedFile = fmemopen(cachedOutput, OUTPUT_SIZE, "w");
+  streamedFile = fmemopen(streamedOutput, OUTPUT_SIZE, "w");
+  setvbuf(cachedFile, NULL, _IONBF, 0);
+  setvbuf(streamedFile, NULL, _IONBF, 0);
+}
+
+void tearDown(void) {
+  myTympan.setOutput(stdout);
+  fclose(cachedFile);
+  fclose(streamedFile);
+}
+
+// prints the layout into file, returns the peak heap growth while doing so
+static long printLayout(ExtendedSerialManager &manager, FILE *file) {
+  rewind(file);
+  myTympan.setOutput(file);
+  long start = heapInUse;
+  heapPeak = heapInUse;
+  manager.processByte('#');
+  manager.processByte(';');
+  fputc('\0', file);
+  myTympan.setOutput(stdout);
+  return heapPeak - start;
+}
+
+static void removeSpaces(char *str) {
+  char *dst = str;
+  for (char *src = str; *src; src++) if (*src != ' ') *dst++ = *src;
+  *dst = '\0';
+}
+
+static void measure(int channels) {
+  char name[64];
+  long before = heapInUse;
+  ExtendedSerialManager *cached = new ExtendedSerialManager(knobs, channels, KNOBS, commands, 1, apply, activate, 0, 0);
+  long managerBytes = heapInUse - before - (long)malloc_usable_size(cached);
+  failAllocations = true;   // no room for the cache: this one streams
+  ExtendedSerialManager streamed(knobs, channels, KNOBS, commands, 1, apply, activate, 0, 0);
+  failAllocations = false;
+  myTympan.setOutput(cachedFile);   // the acknowledgements are overwritten below
+  cached->processByte('/');   // extended mode
+  streamed.processByte('/');
+
+  // the same layout either way (but for the padding of the cached values), including a value
+  // changed since the cache was built
+  values[KNOBS * channels - 1] = 123.25f;
+  long cachedPeak = printLayout(*cached, cachedFile);
+  long streamedPeak = printLayout(streamed, streamedFile);
+  TEST_ASSERT_NOT_NULL(strstr(cachedOutput, "123.25"));
+  TEST_ASSERT_NOT_NULL(strstr(streamedOutput, "'Channel 0'"));
+  removeSpaces(cachedOutput);
+  removeSpaces(streamedOutput);
+  TEST_ASSERT_EQUAL_STRING(streamedOutput, cachedOutput);
+  TEST_ASSERT_EQUAL_INT(0, cachedPeak);
+  TEST_ASSERT_EQUAL_INT(0, streamedPeak);
+
+  BENCH_TIMING cachedTiming = Benchmark::time([&]() { printLayout(*cached, cachedFile); });
+  BENCH_TIMING streamedTiming = Benchmark::time([&]() { printLayout(streamed, streamedFile); });
+  delete cached;
+
+  snprintf(name, sizeof(name), "layout.%ich.manager_heap_bytes", channels);
+  Benchmark::report(name, managerBytes, "bytes");
+  snprintf(name, sizeof(name), "layout.%ich.cached.peak_heap_bytes", channels);
+  Benchmark::report(name, cachedPeak, "bytes");
+  snprintf(name, sizeof(name), "layout.%ich.cached.ns_per_layout", channels);
+  Benchmark::report(name, cachedTiming.ns, "ns/layout");
+  snprintf(name, sizeof(name), "layout.%ich.streamed.peak_heap_bytes", channels);
+  Benchmark::report(name, streamedPeak, "bytes");
+  snprintf(name, sizeof(name), "layout.%ich.streamed.ns_per_layout", channels);
+  Benchmark::report(name, streamedTiming.ns, "ns/layout");
+}
+
+void test_layout_1_channel(void) { measure(1); }
+void test_layout_8_channels(void) { measure(8); }
+void test_layout_99_channels(void) { measure(99); }
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_layout_1_channel);
+  RUN_TEST(test_layout_8_channels);
+  RUN_TEST(test_layout_99_channels);
+  return UNITY_END();
+}
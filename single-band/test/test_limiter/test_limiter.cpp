@@ -0,0 +1,192 @@
+/*
+  The lookahead limiter (shared/AudioEffectLookaheadLimiter_F32.h): its latency, linking, and cost.
+
+  Latency: noise below the threshold must come out untouched, exactly getLatency_samples() late,
+  and a click above it must come out at that same delay, held to the threshold, with the gain
+  already down by the time it arrives.
+
+  Linking: the left ear quiet and the right ear loud, with only the left ear's bolt low enough to
+  limit. Linked, both ears get the same gain (what the right ear's peak needs under the left
+  ear's bolt); independent, neither is touched. Unlinking carries on from the gain applied.
+
+  Reports the cost per sample (wall time and TSC ticks) of the mono node and of the stereo node,
+  linked and independent, per ear.
+
+  Run with: pio test -e native -f test_limiter
+*/
+
+#include <unity.h>
+#include <Tympan_Library.h>
+#include "../../../shared/AudioEffectLookaheadLimiter_F32.h"
+#include "../../../shared/host/Benchmark.h"
+#include "../../../shared/host/HostAudio.h"
+
+#define SAMPLE_RATE 44117.0f
+#define BLOCK_SIZE 128
+#define SAMPLES (344 * BLOCK_SIZE)   // about a second of audio
+#define LOOKAHEAD_MSEC 2.0f
+#define RELEASE_MSEC 50.0f
+#define LEFT_EAR 0
+#define RIGHT_EAR 1
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+AudioSettings_F32 audio_settings(SAMPLE_RATE, BLOCK_SIZE);
+float inL[SAMPLES], inR[SAMPLES], outL[SAMPLES], outR[SAMPLES];
+
+// bolt 20 dB below full scale (a threshold of 0.1), and at full scale
+const BTNRH_WDRC::CHA_WDRC lowBolt = { 1.0f, 50.0f, SAMPLE_RATE, 119.0f, 1.0f, 0.0f, 0.0f, 105.0f, 1.0f, 99.0f };
+const BTNRH_WDRC::CHA_WDRC highBolt = { 1.0f, 50.0f, SAMPLE_RATE, 119.0f, 1.0f, 0.0f, 0.0f, 105.0f, 1.0f, 119.0f };
+
+void setUp(void) {
+  AudioMemory_F32(16, audio_settings);
+}
+
+HostGraph *graph = NULL;
+
+void tearDown(void) {
+  delete graph;
+  graph = NULL;
+}
+
+struct MonoGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  AudioEffectLookaheadLimiter_F32 limiter;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioConnection_F32 patchCordIn { i2s_in, 0, limiter, 0 };
+  AudioConnection_F32 patchCordOut { limiter, 0, i2s_out, 0 };
+
+  MonoGraph(void) { limiter.publishParams(&lowBolt, LOOKAHEAD_MSEC, RELEASE_MSEC); }
+};
+
+struct StereoGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  AudioEffectLookaheadLimiterStereo_F32 limiter;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioConnection_F32 patchCordInL { i2s_in, 0, limiter, LEFT_EAR };
+  AudioConnection_F32 patchCordInR { i2s_in, 1, limiter, RIGHT_EAR };
+  AudioConnection_F32 patchCordOutL { limiter, LEFT_EAR, i2s_out, 0 };
+  AudioConnection_F32 patchCordOutR { limiter, RIGHT_EAR, i2s_out, 1 };
+
+  StereoGraph(bool linked) {
+    limiter.publishParams(LEFT_EAR, &lowBolt, LOOKAHEAD_MSEC, RELEASE_MSEC);
+    limiter.publishParams(RIGHT_EAR, &highBolt, LOOKAHEAD_MSEC, RELEASE_MSEC);
+    limiter.setLinked(linked);
+  }
+};
+
+void test_latency(void) {
+  MonoGraph *g = new MonoGraph;
+  graph = g;
+  int latency = g->limiter.getLatency_samples();
+  TEST_ASSERT_EQUAL_INT((int)(LOOKAHEAD_MSEC * 0.001f * SAMPLE_RATE + 0.5f), latency);
+
+  // below the threshold: the input, delayed
+  HostNoise noise(12345);
+  for (int ii = 0; ii < SAMPLES; ii++) inL[ii] = 0.02f * noise.gaussian();
+  HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, inL, NULL, outL, NULL, SAMPLES);
+  for (int ii = 0; ii < latency; ii++) TEST_ASSERT_EQUAL_FLOAT(0.0f, outL[ii]);
+  TEST_ASSERT_EQUAL_MEMORY(inL, &outL[latency], (SAMPLES - latency) * sizeof(float));
+
+  // a click five times over the threshold, landing in the middle of a block, into an empty
+  // delay line
+  delete g;
+  graph = g = new MonoGraph;
+  const float threshold = 0.1f;
+  const int click = 100 * BLOCK_SIZE + BLOCK_SIZE / 2;
+  memset(inL, 0, sizeof(inL));
+  for (int ii = click; ii < click + 10; ii++) inL[ii] = 0.5f;
+  HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, inL, NULL, outL, NULL, SAMPLES);
+  int first = -1;
+  float peak = 0.0f;
+  for (int ii = 0; ii < SAMPLES; ii++) {
+    if (first < 0 && outL[ii] != 0.0f) first = ii;
+    peak = fmaxf(peak, fabsf(outL[ii]));
+  }
+  TEST_ASSERT_EQUAL_INT(click + latency, first);
+  TEST_ASSERT_TRUE(peak <= threshold);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f * threshold, threshold, outL[first]);   // gain settled, not clamped hard
+  Benchmark::report("limiter.latency_samples", first - click, "samples");
+}
+
+// the gain each ear got, once settled; both ears are steady
+static float settledGain(const float *in, const float *out, int end) {
+  return out[end - 1] / in[end - 1];
+}
+
+void test_linked_shares_gain(void) {
+  for (int ii = 0; ii < SAMPLES; ii++) {
+    inL[ii] = 0.01f;
+    inR[ii] = 0.5f;
+  }
+
+  StereoGraph *independent = new StereoGraph(false);
+  graph = independent;
+  HostAudio::process(independent->i2s_in, independent->i2s_out, BLOCK_SIZE, inL, inR, outL, outR, SAMPLES);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 1.0f, settledGain(inL, outL, SAMPLES));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 1.0f, settledGain(inR, outR, SAMPLES));
+  delete independent;
+
+  // the right ear's peak under the left ear's bolt: 0.1 / 0.5
+  StereoGraph *linked = new StereoGraph(true);
+  graph = linked;
+  HostAudio::process(linked->i2s_in, linked->i2s_out, BLOCK_SIZE, inL, inR, outL, outR, SAMPLES / 2);
+  float gainL = settledGain(inL, outL, SAMPLES / 2), gainR = settledGain(inR, outR, SAMPLES / 2);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.2f, gainR);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, gainR, gainL);
+  for (int ii = 0; ii < SAMPLES / 2; ii++) TEST_ASSERT_TRUE(fabsf(outR[ii]) <= 0.1f);
+
+  // unlinked, the right ear recovers over its release from the gain it had, without a jump
+  linked->limiter.setLinked(false);
+  HostAudio::process(linked->i2s_in, linked->i2s_out, BLOCK_SIZE, inL + SAMPLES / 2, inR + SAMPLES / 2,
+      outL + SAMPLES / 2, outR + SAMPLES / 2, SAMPLES / 2);
+  float maxStep = 0.0f;
+  for (int ii = SAMPLES / 2; ii < SAMPLES; ii++) maxStep = fmaxf(maxStep, fabsf(outR[ii] - outR[ii - 1]));
+  TEST_ASSERT_TRUE(maxStep < 1e-3f);
+  TEST_ASSERT_TRUE(outR[SAMPLES - 1] > 0.45f);
+}
+
+void test_cost(void) {
+  HostNoise noise(12345);
+  for (int ii = 0; ii < SAMPLES; ii++) {
+    inL[ii] = 0.2f * noise.gaussian();   // over the threshold now and then
+    inR[ii] = 0.2f * noise.gaussian();
+  }
+
+  MonoGraph *mono = new MonoGraph;
+  graph = mono;
+  BENCH_TIMING monoTiming = Benchmark::time([&]() {
+    HostAudio::process(mono->i2s_in, mono->i2s_out, BLOCK_SIZE, inL, NULL, outL, NULL, SAMPLES);
+  });
+  delete mono;
+
+  StereoGraph *independent = new StereoGraph(false);
+  graph = independent;
+  BENCH_TIMING independentTiming = Benchmark::time([&]() {
+    HostAudio::process(independent->i2s_in, independent->i2s_out, BLOCK_SIZE, inL, inR, outL, outR, SAMPLES);
+  });
+  delete independent;
+
+  StereoGraph *linked = new StereoGraph(true);
+  graph = linked;
+  BENCH_TIMING linkedTiming = Benchmark::time([&]() {
+    HostAudio::process(linked->i2s_in, linked->i2s_out, BLOCK_SIZE, inL, inR, outL, outR, SAMPLES);
+  });
+
+  // per ear, so that the three compare directly
+  Benchmark::report("limiter.mono.ns_per_sample", monoTiming.ns / SAMPLES, "ns/sample");
+  Benchmark::report("limiter.mono.cycles_per_sample", monoTiming.cycles / SAMPLES, "cycles/sample");
+  Benchmark::report("limiter.independent.ns_per_sample", independentTiming.ns / (2 * SAMPLES), "ns/sample");
+  Benchmark::report("limiter.independent.cycles_per_sample", independentTiming.cycles / (2 * SAMPLES), "cycles/sample");
+  Benchmark::report("limiter.linked.ns_per_sample", linkedTiming.ns / (2 * SAMPLES), "ns/sample");
+  Benchmark::report("limiter.linked.cycles_per_sample", linkedTiming.cycles / (2 * SAMPLES), "cycles/sample");
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_latency);
+  RUN_TEST(test_linked_shares_gain);
+  RUN_TEST(test_cost);
+  return UNITY_END();
+}
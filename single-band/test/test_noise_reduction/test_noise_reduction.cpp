@@ -0,0 +1,133 @@
+/*
+  The spectral noise reduction (shared/AudioEffectNoiseReduction_F32.h): that it stays out of the
+  way when the expansion is off, and its cost against the FFT size.
+
+  Bypass: with exp_cr at 1 the output must be the input delayed by getLatency_samples(), the same
+  delay as when it is working, and turning it off in the middle of the signal must end there too
+  once the frames from before have overlapped out. Working (exp_cr at 0.1, the sketch's default)
+  on steady noise below the kneepoint, it must take the noise down.
+
+  Cost: one second of noise through the node for FFT sizes of 256 to 2048 (128-sample blocks),
+  and bypassed. Reports ns and cycles (TSC ticks) per sample and the CPU time per second of audio.
+
+  Run with: pio test -e native -f test_noise_reduction
+*/
+
+#include <unity.h>
+#include <Tympan_Library.h>
+#include "../../../shared/AudioEffectNoiseReduction_F32.h"
+#include "../../../shared/host/Benchmark.h"
+#include "../../../shared/host/HostAudio.h"
+
+#define SAMPLE_RATE 44117.0f
+#define BLOCK_SIZE 128
+#define FFT_SIZE 256   // the sketch's
+#define SAMPLES (344 * BLOCK_SIZE)   // about a second of audio
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+AudioSettings_F32 audio_settings(SAMPLE_RATE, BLOCK_SIZE);
+float in[SAMPLES], out[SAMPLES];
+
+// the sketch's fitting, with the given expansion ratio
+static BTNRH_WDRC::CHA_WDRC fitting(float exp_cr) {
+  BTNRH_WDRC::CHA_WDRC gha = { 1.0f, 50.0f, SAMPLE_RATE, 119.0f, exp_cr, 40.0f, 0.0f, 105.0f, 1.0f, 105.0f };
+  return gha;
+}
+
+void setUp(void) {
+  AudioMemory_F32(16, audio_settings);
+  HostNoise noise(12345);
+  for (int ii = 0; ii < SAMPLES; ii++) in[ii] = 0.0001f * noise.gaussian();   // about 39 dB SPL
+}
+
+HostGraph *graph = NULL;
+
+void tearDown(void) {
+  delete graph;
+  graph = NULL;
+}
+
+struct NoiseReductionGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  AudioEffectNoiseReduction_F32 noiseReduction;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioConnection_F32 patchCordIn { i2s_in, 0, noiseReduction, 0 };
+  AudioConnection_F32 patchCordOut { noiseReduction, 0, i2s_out, 0 };
+
+  NoiseReductionGraph(int fftSize, float exp_cr) {
+    TEST_ASSERT_TRUE(noiseReduction.setup(fftSize, BLOCK_SIZE, SAMPLE_RATE));
+    BTNRH_WDRC::CHA_WDRC gha = fitting(exp_cr);
+    noiseReduction.publishParams(&gha);
+  }
+};
+
+static void assertDelayedInput(int latency, int from) {
+  for (int ii = from; ii < SAMPLES; ii++) TEST_ASSERT_FLOAT_WITHIN(1e-9f, in[ii - latency], out[ii]);
+}
+
+void test_bypassed_without_expansion(void) {
+  NoiseReductionGraph *g = new NoiseReductionGraph(FFT_SIZE, 1.0f);
+  graph = g;
+  int latency = g->noiseReduction.getLatency_samples();
+  TEST_ASSERT_EQUAL_INT(FFT_SIZE - BLOCK_SIZE, latency);
+  HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, SAMPLES);
+  for (int ii = 0; ii < latency; ii++) TEST_ASSERT_EQUAL_FLOAT(0.0f, out[ii]);
+  assertDelayedInput(latency, latency);
+}
+
+void test_working_then_bypassed(void) {
+  NoiseReductionGraph *g = new NoiseReductionGraph(FFT_SIZE, 0.1f);
+  graph = g;
+  int latency = g->noiseReduction.getLatency_samples();
+  const int half = SAMPLES / 2;
+  HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, half);
+
+  // steady noise under the 40 dB SPL kneepoint: the last quarter second must come out lower
+  double inPower = 0.0, outPower = 0.0;
+  for (int ii = half - SAMPLES / 4; ii < half; ii++) {
+    inPower += in[ii - latency] * in[ii - latency];
+    outPower += out[ii] * out[ii];
+  }
+  Benchmark::report("noise_reduction.steady_noise.attenuation_dB", 10.0 * log10(inPower / outPower), "dB");
+  TEST_ASSERT_TRUE(outPower < 0.5 * inPower);
+
+  BTNRH_WDRC::CHA_WDRC gha = fitting(1.0f);
+  g->noiseReduction.publishParams(&gha);
+  HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, in + half, NULL, out + half, NULL, SAMPLES - half);
+  assertDelayedInput(latency, half + FFT_SIZE);
+}
+
+void test_cost_per_fft_size(void) {
+  char name[80];
+  const int fftSizes[] = { 256, 512, 1024, 2048 };
+  for (int fftSize : fftSizes) {
+    for (int bypassed = 0; bypassed < 2; bypassed++) {
+      if (bypassed && fftSize != FFT_SIZE) continue;
+      NoiseReductionGraph *g = new NoiseReductionGraph(fftSize, bypassed ? 1.0f : 0.1f);
+      graph = g;
+      BENCH_TIMING timing = Benchmark::time([&]() {
+        HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, in, NULL, out, NULL, SAMPLES);
+      });
+      delete g;
+      graph = NULL;
+
+      const char *kind = bypassed ? "bypassed" : "working";
+      snprintf(name, sizeof(name), "noise_reduction.%i_fft.%s.ns_per_sample", fftSize, kind);
+      Benchmark::report(name, timing.ns / SAMPLES, "ns/sample");
+      snprintf(name, sizeof(name), "noise_reduction.%i_fft.%s.cycles_per_sample", fftSize, kind);
+      Benchmark::report(name, timing.cycles / SAMPLES, "cycles/sample");
+      snprintf(name, sizeof(name), "noise_reduction.%i_fft.%s.ms_per_audio_second", fftSize, kind);
+      Benchmark::report(name, timing.ns * 1e-6 / (SAMPLES / SAMPLE_RATE), "ms");
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_bypassed_without_expansion);
+  RUN_TEST(test_working_then_bypassed);
+  RUN_TEST(test_cost_per_fft_size);
+  return UNITY_END();
+}
@@ -0,0 +1,135 @@
+/*
+  Linking and unlinking the stereo compressor (shared/AudioEffectCompWDRCStereo_F32.h) under a
+  steady signal.
+
+  A 1 kHz tone at -20 dBFS on the left ear and -30 dBFS on the right, through a compressing
+  fitting, so that the linked gain (set by the louder left ear) is not the right ear's own. The
+  node boots linked and the mode is flipped every quarter second. Every switch must blend into
+  the new gain: no sample may come out more than 6 dB under the quieter of the two steady
+  outputs for that ear, and the gain may not move by more than a fraction of a dB from one
+  sample to the next (the tone's peaks ripple it a little anyway).
+
+  Run with: pio test -e native -f test_stereo_link
+*/
+
+#include <unity.h>
+#include <Tympan_Library.h>
+#include "../../../shared/AudioEffectCompWDRCStereo_F32.h"
+#include "../../../shared/host/Benchmark.h"
+#include "../../../shared/host/HostAudio.h"
+
+#define SAMPLE_RATE 44117.0f
+#define BLOCK_SIZE 128
+#define SWITCH_SAMPLES (86 * BLOCK_SIZE)   // about a quarter second, in whole blocks
+#define SAMPLES (16 * SWITCH_SAMPLES)
+#define LEFT_EAR 0
+#define RIGHT_EAR 1
+#define MAX_STEP_DB 0.25f
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+AudioSettings_F32 audio_settings(SAMPLE_RATE, BLOCK_SIZE);
+float inL[SAMPLES], inR[SAMPLES], outL[SAMPLES], outR[SAMPLES];
+
+// 3:1 from 50 dB SPL, with expansion below 40
+const BTNRH_WDRC::CHA_WDRC fitting = { 1.0f, 50.0f, SAMPLE_RATE, 119.0f, 0.5f, 40.0f, 10.0f, 50.0f, 3.0f, 105.0f };
+
+void setUp(void) {
+  AudioMemory_F32(16, audio_settings);
+  for (int ii = 0; ii < SAMPLES; ii++) {
+    float x = sinf(2.0f * (float)M_PI * 1000.0f * ii / SAMPLE_RATE);
+    inL[ii] = 0.1f * x;
+    inR[ii] = 0.0316f * x;
+  }
+}
+
+HostGraph *graph = NULL;
+
+void tearDown(void) {
+  delete graph;
+  graph = NULL;
+}
+
+struct StereoGraph : HostGraph {
+  AudioInputI2S_F32 i2s_in { audio_settings };
+  AudioEffectCompWDRCStereo_F32 compWDRC;
+  AudioOutputI2S_F32 i2s_out { audio_settings };
+  AudioConnection_F32 patchCordInL { i2s_in, 0, compWDRC, LEFT_EAR };
+  AudioConnection_F32 patchCordInR { i2s_in, 1, compWDRC, RIGHT_EAR };
+  AudioConnection_F32 patchCordOutL { compWDRC, LEFT_EAR, i2s_out, 0 };
+  AudioConnection_F32 patchCordOutR { compWDRC, RIGHT_EAR, i2s_out, 1 };
+
+  StereoGraph(bool linked) {
+    compWDRC.publishParams(LEFT_EAR, &fitting);
+    compWDRC.publishParams(RIGHT_EAR, &fitting);
+    compWDRC.setLinked(linked);
+  }
+};
+
+// the settled gain (dB) of an ear with the mode held
+static float steadyGain_dB(bool linked, const float *in, float *out) {
+  StereoGraph *g = new StereoGraph(linked);
+  graph = g;
+  HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, inL, inR, outL, outR, SWITCH_SAMPLES);
+  delete g;
+  graph = NULL;
+  float inPeak = 0.0f, outPeak = 0.0f;
+  for (int ii = SWITCH_SAMPLES / 2; ii < SWITCH_SAMPLES; ii++) {
+    inPeak = fmaxf(inPeak, fabsf(in[ii]));
+    outPeak = fmaxf(outPeak, fabsf(out[ii]));
+  }
+  return 20.0f * log10f(outPeak / inPeak);
+}
+
+static void checkEar(const char *ear, const float *in, const float *out, float floor_dB) {
+  char name[80];
+  float amplitude = 0.0f;
+  for (int ii = 0; ii < SAMPLES; ii++) amplitude = fmaxf(amplitude, fabsf(in[ii]));
+  int dropouts = 0;
+  float maxStep = 0.0f, last_dB = 0.0f;
+  bool haveLast = false;
+  for (int ii = SWITCH_SAMPLES / 2; ii < SAMPLES; ii++) {
+    if (fabsf(in[ii]) < 0.5f * amplitude) {
+      haveLast = false;
+      continue;
+    }
+    float gain_dB = 20.0f * log10f(fabsf(out[ii] / in[ii]) + 1e-20f);
+    if (gain_dB < floor_dB - 6.0f) dropouts++;
+    if (haveLast) maxStep = fmaxf(maxStep, fabsf(gain_dB - last_dB));
+    last_dB = gain_dB;
+    haveLast = true;
+  }
+  snprintf(name, sizeof(name), "stereo_link.%s.samples_6dB_under", ear);
+  Benchmark::report(name, dropouts, "samples");
+  snprintf(name, sizeof(name), "stereo_link.%s.max_gain_step_dB", ear);
+  Benchmark::report(name, maxStep, "dB");
+  TEST_ASSERT_EQUAL_INT(0, dropouts);
+  TEST_ASSERT_TRUE(maxStep < MAX_STEP_DB);
+}
+
+void test_toggle_under_steady_signal(void) {
+  float linkedL = steadyGain_dB(true, inL, outL), linkedR = steadyGain_dB(true, inR, outR);
+  float ownL = steadyGain_dB(false, inL, outL), ownR = steadyGain_dB(false, inR, outR);
+  Benchmark::report("stereo_link.right.linked_gain_dB", linkedR, "dB");
+  Benchmark::report("stereo_link.right.own_gain_dB", ownR, "dB");
+  TEST_ASSERT_TRUE(fabsf(linkedR - ownR) > 3.0f);   // the switch has something to do
+
+  StereoGraph *g = new StereoGraph(true);
+  graph = g;
+  bool linked = true;
+  for (int start = 0; start < SAMPLES; start += SWITCH_SAMPLES) {
+    int n = (SAMPLES - start < SWITCH_SAMPLES) ? SAMPLES - start : SWITCH_SAMPLES;
+    HostAudio::process(g->i2s_in, g->i2s_out, BLOCK_SIZE, inL + start, inR + start, outL + start, outR + start, n);
+    linked = !linked;
+    g->compWDRC.setLinked(linked);
+  }
+  checkEar("left", inL, outL, fminf(linkedL, ownL));
+  checkEar("right", inR, outR, fminf(linkedR, ownR));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_toggle_under_steady_signal);
+  return UNITY_END();
+}
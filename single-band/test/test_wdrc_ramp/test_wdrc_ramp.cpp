@@ -0,0 +1,121 @@
+/*
+  The gain ramp of WDRCChannel_F32: no jumps, and a multiply-add per sample.
+
+  With a steady input the gain curve hands out a constant gain, so everything the gain does after
+  a parameter change is the ramp. It must move from the gain that was applied to the new one in
+  even steps, also when a second change arrives halfway through the first ramp. The cost of the
+  gain stage is reported with and without a ramp running.
+
+  Run with: pio test -e native -f test_wdrc_ramp
+*/
+
+#include <unity.h>
+#include <Tympan_Library.h>
+#include "../../../shared/WDRCChannel_F32.h"
+#include "../../../shared/host/Benchmark.h"
+#include "../../../shared/host/HostAudio.h"
+
+#define SAMPLE_RATE 44117.0f
+#define BLOCK_SIZE 128
+#define RAMP_MSEC 20.0f
+#define BLOCKS_PER_RUN 2000
+
+Tympan myTympan;
+bool enable_printCPUandMemory = false;
+
+WDRCChannel_F32 *channel;
+BTNRH_WDRC::CHA_WDRC gha = { 1.0f, 50.0f, SAMPLE_RATE, 119.0f, 1.0f, 0.0f, 0.0f, 105.0f, 1.0f, 150.0f };
+float level[BLOCK_SIZE], env[BLOCK_SIZE], gain[BLOCK_SIZE];
+
+void setUp(void) {
+  channel = new WDRCChannel_F32;
+  channel->setRampTime_msec(RAMP_MSEC);
+  for (int ii = 0; ii < BLOCK_SIZE; ii++) level[ii] = 0.01f;   // a steady -40 dBFS
+}
+
+void tearDown(void) {
+  delete channel;
+}
+
+// one block; returns the largest step of the gain, including the one from the previous block's
+// last gain
+static float runBlock(float *lastGain) {
+  channel->acquireParams();
+  channel->calcEnvelope_block(level, env, BLOCK_SIZE);
+  channel->calcGain_block(env, gain, BLOCK_SIZE);
+  float maxStep = 0.0f;
+  for (int ii = 0; ii < BLOCK_SIZE; ii++) {
+    maxStep = fmaxf(maxStep, fabsf(gain[ii] - *lastGain));
+    *lastGain = gain[ii];
+  }
+  return maxStep;
+}
+
+static void setGain_dB(float tkgain) {
+  gha.tkgain = tkgain;
+  channel->publishParams(&gha);
+}
+
+void test_ramp_has_no_jumps(void) {
+  float lastGain = 1.0f, rampSamples = RAMP_MSEC * 0.001f * SAMPLE_RATE;
+  setGain_dB(0.0f);
+  for (int ii = 0; ii < 100; ii++) runBlock(&lastGain);   // settle the envelope
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, 1.0f, lastGain);
+
+  // 0 to 30 dB: even steps of (31.6 - 1) / rampSamples
+  setGain_dB(30.0f);
+  float step = (powf(10.0f, 1.5f) - 1.0f) / (int)rampSamples;
+  float maxStep = runBlock(&lastGain);
+  maxStep = fmaxf(maxStep, runBlock(&lastGain));
+  maxStep = fmaxf(maxStep, runBlock(&lastGain));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f * step, step, maxStep);
+  float midRamp = lastGain;
+  TEST_ASSERT_TRUE(midRamp > 1.0f && midRamp < 31.6f);
+
+  // back to 10 dB halfway through: from where the gain is, not from the curve it was heading for
+  setGain_dB(10.0f);
+  step = fabsf(powf(10.0f, 0.5f) - midRamp) / (int)rampSamples;
+  maxStep = 0.0f;
+  for (int ii = 0; ii < (int)rampSamples / BLOCK_SIZE + 2; ii++) maxStep = fmaxf(maxStep, runBlock(&lastGain));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f * step, step, maxStep);
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, powf(10.0f, 0.5f), lastGain);
+
+  // and then it stays put
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, runBlock(&lastGain));
+}
+
+void test_ramp_cost(void) {
+  HostNoise noise(12345);
+  for (int ii = 0; ii < BLOCK_SIZE; ii++) level[ii] = fabsf(0.1f * noise.gaussian());
+  BTNRH_WDRC::CHA_WDRC fitting = { 1.0f, 50.0f, SAMPLE_RATE, 119.0f, 0.5f, 60.0f, 10.0f, 70.0f, 2.0f, 100.0f };
+  channel->publishParams(&fitting);
+  channel->acquireParams();
+  channel->calcEnvelope_block(level, env, BLOCK_SIZE);
+
+  BENCH_TIMING steady = Benchmark::time([&]() {
+    for (int ii = 0; ii < BLOCKS_PER_RUN; ii++) channel->calcGain_block(env, gain, BLOCK_SIZE);
+  });
+
+  // a ramp long enough to run through every timed block
+  channel->setRampTime_msec(1e6f);
+  fitting.tkgain = 20.0f;
+  channel->publishParams(&fitting);
+  channel->acquireParams();
+  BENCH_TIMING ramping = Benchmark::time([&]() {
+    for (int ii = 0; ii < BLOCKS_PER_RUN; ii++) channel->calcGain_block(env, gain, BLOCK_SIZE);
+  });
+
+  double samples = (double)BLOCKS_PER_RUN * BLOCK_SIZE;
+  Benchmark::report("wdrc_gain.steady.ns_per_sample", steady.ns / samples, "ns/sample");
+  Benchmark::report("wdrc_gain.ramping.ns_per_sample", ramping.ns / samples, "ns/sample");
+  Benchmark::report("wdrc_gain.ramp.ns_per_sample", (ramping.ns - steady.ns) / samples, "ns/sample");
+  Benchmark::report("wdrc_gain.steady.cycles_per_sample", steady.cycles / samples, "cycles/sample");
+  Benchmark::report("wdrc_gain.ramping.cycles_per_sample", ramping.cycles / samples, "cycles/sample");
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_ramp_has_no_jumps);
+  RUN_TEST(test_ramp_cost);
+  return UNITY_END();
+}